@@ -7,54 +7,62 @@
 #include "hardware/clocks.h"
 
 #include "AD9850.hpp"
+#include "adc_capture.hpp"
+#include "command_channel.hpp"
 #include "command_processor.hpp"
+#include "command_handler.hpp"
+#include "dither.hpp"
+#include "frequency_table.hpp"
+#include "lock_timer.hpp"
+#include "pulsed_output.hpp"
+#include "network_analyzer.hpp"
+#include "quadrature_encoder.hpp"
+#include "sequencer.hpp"
+#include "telemetry.hpp"
+#include "uart_channel.hpp"
 
 const uint OSC_HZ = AD9850::OSC_HZ;
-const uint W_CLK  = 10;
-const uint FQ_UD  = 11;
-const uint DATA   = 12;
-const uint RESET  = 13;
+const uint W_CLK   = 10;
+const uint FQ_UD   = 11;
+const uint DATA    = 12;
+const uint RESET   = 13;
+const uint TRIGGER = 14;
+const uint MARKER  = 15;
+const uint ENCODER_A = 16;     // Tuning encoder, B on GPIO 17.
+const uint LOCK_INPUT = 18;     // Lock or ready output of the device under test.
+const uint PULSE_GATE = 19;     // External gate for the pulsed output.
+const uint ADC_INPUT = 0;       // GPIO 26, detector for the network analyzer.
 
 const uint UART_TX = 0;
 const uint UART_RX = 1;
 
-/**
- * @brief  Alarm callback.
- * @note   Put your timeout handler code in here.
- */
-int64_t alarm_callback(alarm_id_t id, void *user_data) 
-{
-    return 0;
-}
+#ifndef SIGGEN_UART_BAUD
+#define SIGGEN_UART_BAUD 115200
+#endif
+const uint UART_BAUD = SIGGEN_UART_BAUD;
+
+using DDS = AD9850Fixed<W_CLK, FQ_UD, DATA, RESET>;
 
 /**
- * @brief  Print the error to the stdout in json format.
- * @param  command  Structure containing the returned error.
+ * @brief  Shift a word into the DDS from RAM.  The fixed-pin writer is
+ *         inlined into this plain function, as GCC won't place a class
+ *         template member in RAM itself.
  */
-void show_error(command_t command)
+void __not_in_flash_func(write_dds_word)(uint64_t word, uint32_t marker_mask)
 {
-    std::cout << 
-        R"({)" << 
-        R"(  "command_number":)" << command.command_number << "," 
-        R"(  "error":)"          << R"(")"  << command.error.value() << R"(")" <<
-        R"(})" << std::endl;
+    DDS::write_word(word, marker_mask);
 }
 
 /**
- * @brief  Acknowledges the given command by pringing the 
- *         current DDS state.
- * @param  command_number   Identifier for command being acked.
- * @param  dds              Current dds from which state is being pulled.
+ * @brief  Alarm callback.  Ticks the command handler's state pushes.
+ * @param  user_data  The command handler.
+ * @return Time to the next tick, from when this one was due, so the
+ *         ticks don't drift.
  */
-void ack_command(int command_number, AD9850 dds)
+int64_t alarm_callback(alarm_id_t id, void *user_data) 
 {
-    std::cout << 
-        R"({)" << 
-        R"(  "command_number":)" <<  command_number << "," 
-        R"(  "frequency":)"      <<  dds.get_frequency() << ","
-        R"(  "phase":)"          <<  dds.get_phase() << ","
-        R"(  "enable_out":)"     << (dds.get_enabled() ? "true" : "false") <<
-        R"(})" << std::endl;
+    CommandHandler::push_tick(user_data);
+    return -static_cast<int64_t>(CommandHandler::PUSH_TICK_US);
 }
 
 /**
@@ -64,76 +72,107 @@ int main()
 {
     stdio_init_all();
 
-    // Period timer is here for future expansion.
+    // Start the cycle counter used for the telemetry timings.
     //
-    add_alarm_in_ms(2000, alarm_callback, NULL, false);
-
-    // Initialize GPIO pins and UART..
-    // Pin 0 is TX, 1 is RX.
-    // Pin functions have to be set before calling uart_init 
-    // to avoid losing data.
-    //
-    // The UART has to be enabled in the make file for this
-    // to work.
-    //
-    gpio_set_function(UART_TX, UART_FUNCSEL_NUM(uart0, UART_TX));
-    gpio_set_function(UART_RX, UART_FUNCSEL_NUM(uart0, UART_RX));
-    uart_init(uart0, 115200);
+    Telemetry::start_cycle_counter();
+    telemetry.reset();
 
     // Create an instance of the DDS.
     //
-    AD9850 dds(OSC_HZ, W_CLK, FQ_UD, DATA, RESET);
+    DDS dds(OSC_HZ, write_dds_word);
+    dds.attach_marker(MARKER);
     dds.set_frequency(1000);
     dds.commit();
     
-    // Create an instance of the command processor
-    // to monitor stdio for incoming commands.
+    // Create the hardware commit trigger.  It generates FQ_UD
+    // from a PIO state machine when a command is armed.
+    //
+    CommitTrigger trigger(pio0, TRIGGER, FQ_UD, MARKER);
+
+    // Create a command processor for each command channel, USB
+    // (stdio) and UART0 on GPIO 0 (TX) and 1 (RX), and the handler
+    // that applies their commands to the DDS.  Each command is
+    // answered on the channel it came from.
+    //
+    // The processors, analyzer and sequencer are static since their
+    // buffers are too big for the stack.
+    //
+    AdcCapture adc(ADC_INPUT);
+    static NetworkAnalyzer analyzer(dds, adc);
+
+    // The UART channel is static for its receive ring.
+    //
+    StdioChannel usb_channel;
+    static UartChannel uart_channel(uart0, UART_TX, UART_RX, UART_BAUD);
+
+    static CommandProcessor command_processor(usb_channel);
+    static CommandProcessor uart_processor(uart_channel);
+
+    // The sequencer, with any sequence saved in flash.  One saved to
+    // run at power-up starts now.
     //
-    CommandProcessor command_processor;
+    static Sequencer sequencer(dds, trigger);
+    sequencer.restore();
+
+    // Frequency table store, static for its size.
+    //
+    static FrequencyTable table(dds);
+    Dither dither(dds);
+
+    // Tuning encoder, decoded from a PIO state machine next to the
+    // commit trigger's.
+    //
+    QuadratureEncoder encoder(pio0, ENCODER_A);
+
+    // Lock time measurement, timing the DUT's lock input from FQ_UD on
+    // a third state machine.  Static for its results.
+    //
+    static LockTimer lock_timer(dds, pio0, LOCK_INPUT, FQ_UD);
+
+    // Pulsed output, keying the DDS from the other PIO block, which
+    // takes the DDS pins while it runs.  Static for its DMA ring.
+    //
+    static PulsedOutput pulsed_output(dds, pio1, W_CLK, FQ_UD, DATA, PULSE_GATE);
+
+    CommandHandler command_handler(dds, trigger, analyzer, sequencer, table, dither, encoder, lock_timer,
+        pulsed_output);
+    command_handler.attach(command_processor);
+    command_handler.attach(uart_processor);
+
+    // Periodic timer for the state pushes of subscribed channels.
+    //
+    add_alarm_in_us(CommandHandler::PUSH_TICK_US, alarm_callback, &command_handler, false);
+
+    command_handler.autorun();
 
     // Enter the processing loop.
     //
     while (true)
     {
-        // Process any available commands.
+        // Process any available commands, otherwise sleep until
+        // something arrives.
         //
+        // The channels take turns, a command each per pass.
+        //
+        telemetry.count_loop();
         command_processor.loop();
+        uart_processor.loop();
+        command_handler.loop();
+
+        bool idle = true;
         if (command_processor.command_is_available())
         {
-            command_t command = command_processor.get_command();
-
-            // See if there was an error.  If so, send out
-            // json containing the error message and continue
-            // back to the top of the loop.
-            //
-            if (command.error.has_value())
-            {
-                show_error(command);
-                continue;
-            }
-
-            // No error.  Process the command contents.
-            //
-            if (command.frequency_hz.has_value())
-            {
-                dds.set_frequency(command.frequency_hz.value());
-            }
-
-            if (command.phase_deg.has_value())
-            {
-                dds.set_phase(command.phase_deg.value());
-            }
-
-            if (command.enable_out.has_value())
-            {
-                dds.enable_out(command.enable_out.value());
-            }
-
-            dds.commit();
-
-            // Acknowledge the command.
-            //
-            ack_command(command.command_number, dds);
+            command_handler.process(command_processor);
+            idle = false;
+        }
+        if (uart_processor.command_is_available())
+        {
+            command_handler.process(uart_processor);
+            idle = false;
+        }
+        if (idle && uart_processor.is_idle())
+        {
+            command_processor.wait_for_input();
         }
     }
 
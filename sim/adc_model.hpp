@@ -0,0 +1,72 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Detector model for the network analyzer.  The DDS drives a band-pass
+// filter whose output feeds a log detector on the ADC input, so readings
+// trace the filter's response as the DDS frequency changes.
+//
+namespace
+{
+    class AdcModel
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  center_hz  Filter center frequency, in Hz.
+         * @param  q          Filter Q.
+         */
+        AdcModel(double center_hz, double q)
+            : center_hz_(center_hz)
+            , q_(q)
+        {
+        }
+
+        /**
+         * @brief  Return the filter response, in dB.
+         * @param  frequency_hz  Input frequency, in Hz.
+         */
+        auto response_db(double frequency_hz) -> double
+        {
+            if (frequency_hz <= 0.0)
+                return -FLOOR_DB;
+
+            double detune = frequency_hz / center_hz_ - center_hz_ / frequency_hz;
+            return -10.0 * log10(1.0 + q_ * q_ * detune * detune);
+        }
+
+        /**
+         * @brief  Return one 12-bit ADC reading.
+         * @param  frequency_hz  DDS output frequency, in Hz.
+         * @param  enabled       DDS output enabled.
+         * @note   The detector gives 25 mV/dB above a floor, read against
+         *         the 3.3 V reference with a few LSB of noise.
+         */
+        auto sample(double frequency_hz, bool enabled) -> uint16_t
+        {
+            double db = enabled ? response_db(frequency_hz) : -FLOOR_DB;
+            if (db < -FLOOR_DB)
+                db = -FLOOR_DB;
+
+            double volts = TOP_VOLTS + VOLTS_PER_DB * db;
+            double code = volts / REF_VOLTS * 4095.0 + (rand() % (2 * NOISE_LSB + 1)) - NOISE_LSB;
+            if (code < 0.0)
+                code = 0.0;
+            if (code > 4095.0)
+                code = 4095.0;
+            return static_cast<uint16_t>(code);
+        }
+
+    private:
+        static constexpr double FLOOR_DB = 70.0;
+        static constexpr double TOP_VOLTS = 2.0;
+        static constexpr double VOLTS_PER_DB = 0.025;
+        static constexpr double REF_VOLTS = 3.3;
+        static const int NOISE_LSB = 3;
+
+        double center_hz_;              // See constructor for these value definitions.
+        double q_;
+    };
+}
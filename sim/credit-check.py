@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+
+# Flow control credit check.
+#
+# Holds the virtual signal generator's command processor with a short
+# dither run and sends more commands behind it than the fifo holds.  The
+# queued commands must be acked with command credits counting down to 0,
+# and the ones past the fifo answered "Busy".  Exits non-zero if not.
+#
+import argparse
+import json
+import sys
+import time
+import serial
+
+
+# Fifo length of a channel (MAX_QUEUED_COMMANDS).
+#
+FIFO_LEN = 8
+
+
+def send(ser, command: dict):
+    ser.write(json.dumps(command, separators=(',', ':')).encode('utf-8') + b'\r\n')
+
+
+def read_responses(ser, seconds: float) -> list:
+    '''
+    Return the JSON responses read in the given time, skipping echoes
+    and anything that doesn't parse.
+    '''
+    pending = b''
+    deadline = time.perf_counter() + seconds
+    while time.perf_counter() < deadline:
+        pending += ser.read(ser.in_waiting or 1)
+    responses = []
+    for raw in pending.split(b'\n'):
+        try:
+            response = json.loads(raw.decode('utf-8', 'replace').strip().lstrip('$ '))
+        except ValueError:
+            continue
+        if "command_number" in response and "ack" not in response:
+            responses.append(response)
+    return responses
+
+
+# Main method.
+#
+if __name__ == '__main__':
+
+    parser = argparse.ArgumentParser(prog="credit-check",
+        description="Check the command credits count down to 0 as the fifo fills.")
+    parser.add_argument('--port', default='/tmp/siggen',
+        help='Simulator pty')
+    parser.add_argument('--extra', type=int, default=4,
+        help='Commands sent past the fifo length')
+    args = parser.parse_args()
+
+    ser = serial.Serial(args.port, 115200, timeout=0.05)
+    send(ser, {"command_number": 1, "ack": "minimal"})
+    read_responses(ser, 0.2)
+
+    # The dither run holds the command processor while the rest arrive.
+    #
+    send(ser, {"command_number": 2, "dither": {"deviation": 1000, "rate": 1000, "duration_ms": 300}})
+    time.sleep(0.05)
+    numbers = range(3, 3 + FIFO_LEN + args.extra)
+    for number in numbers:
+        send(ser, {"command_number": number, "frequency": 1000000 + number})
+    responses = read_responses(ser, 1.0)
+    ser.close()
+
+    credits = {}
+    busy = set()
+    for response in responses:
+        number = response["command_number"]
+        if response.get("error") == "Busy":
+            busy.add(number)
+        elif "credit_commands" in response:
+            credits[number] = response["credit_commands"]
+
+    queued = list(numbers)[:FIFO_LEN]
+    expected = {number: FIFO_LEN - 1 - index for index, number in enumerate(queued)}
+    failures = 0
+    for number in numbers:
+        if number in expected:
+            ok = credits.get(number) == expected[number]
+            got = credits.get(number, "none")
+            want = expected[number]
+        else:
+            ok = number in busy
+            got = "Busy" if number in busy else credits.get(number, "none")
+            want = "Busy"
+        print("{:4d} {:>6} {:>6}  {}".format(number, got, want, "ok" if ok else "FAIL"))
+        if not ok:
+            failures += 1
+
+    print("FAILED" if failures else "passed")
+    sys.exit(1 if failures else 0)
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Behavioural model of the AD9850 serial interface.  It watches the
+// W_CLK, FQ_UD, DATA and RESET lines and decodes the 40-bit words the
+// driver clocks in, so the simulator can report what the real chip
+// would be generating.
+//
+namespace
+{
+    class DdsModel
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  osc_hz  Reference clock frequency, in Hz.
+         * @param  w_clk   GPIO wired to W_CLK.
+         * @param  fq_ud   GPIO wired to FQ_UD.
+         * @param  data    GPIO wired to D7 (serial data).
+         * @param  reset   GPIO wired to RESET.
+         * @param  log     Stream updates are reported on, or null.
+         */
+        DdsModel(uint32_t osc_hz, uint w_clk, uint fq_ud, uint data, uint reset, FILE* log)
+            : osc_hz_(osc_hz)
+            , w_clk_(w_clk)
+            , fq_ud_(fq_ud)
+            , data_(data)
+            , reset_(reset)
+            , log_(log)
+        {
+        }
+
+        /**
+         * @brief  Update the level of one of the GPIO lines.
+         * @param  gpio   GPIO number.
+         * @param  level  New level.
+         */
+        auto set_pin(uint gpio, bool level) -> void
+        {
+            if (gpio < NUM_PINS)
+                set_pins(1u << gpio, level);
+        }
+
+        /**
+         * @brief  Update several GPIO lines in one write, as a write to
+         *         the SIO set or clear register does.
+         * @param  mask   GPIOs to update.
+         * @param  level  New level.
+         */
+        auto set_pins(uint32_t mask, bool level) -> void
+        {
+            uint32_t rising = 0;
+            for (uint gpio = 0; gpio < NUM_PINS; ++gpio)
+            {
+                if (mask & (1u << gpio))
+                {
+                    if (level && !pins_[gpio])
+                        rising |= 1u << gpio;
+                    pins_[gpio] = level;
+                }
+            }
+
+            on_rising(rising);
+        }
+
+        /**
+         * @brief  Invert several GPIO lines in one write, as a write to
+         *         the SIO xor register does.
+         * @param  mask  GPIOs to invert.
+         */
+        auto toggle_pins(uint32_t mask) -> void
+        {
+            uint32_t rising = 0;
+            for (uint gpio = 0; gpio < NUM_PINS; ++gpio)
+            {
+                if (mask & (1u << gpio))
+                {
+                    if (!pins_[gpio])
+                        rising |= 1u << gpio;
+                    pins_[gpio] = !pins_[gpio];
+                }
+            }
+
+            on_rising(rising);
+        }
+
+        /**
+         * @brief  Watch a marker output.  Updates that the marker rises
+         *         with are flagged in the log.
+         * @param  marker  Marker GPIO.
+         */
+        auto attach_marker(uint marker) -> void
+        {
+            marker_ = marker;
+        }
+
+        /**
+         * @brief  Return the current level of a GPIO line.
+         */
+        auto get_pin(uint gpio) -> bool
+        {
+            return (gpio < NUM_PINS) ? pins_[gpio] : false;
+        }
+
+        /**
+         * @brief  Return the 40-bit word currently driving the output.
+         */
+        auto get_word() -> uint64_t
+        {
+            return word_;
+        }
+
+        /**
+         * @brief  Return the output frequency, in Hz.
+         */
+        auto get_frequency() -> double
+        {
+            uint32_t tuning_word = static_cast<uint32_t>(word_);
+            return static_cast<double>(tuning_word) * osc_hz_ / 4294967296.0;
+        }
+
+        /**
+         * @brief  Return the output phase, in deg.
+         */
+        auto get_phase() -> double
+        {
+            return ((word_ >> 35) & 0x1f) * 11.25;
+        }
+
+        /**
+         * @brief  Return true if the output is powered up.
+         */
+        auto get_enabled() -> bool
+        {
+            return ((word_ >> 34) & 0x01) == 0;
+        }
+
+        /**
+         * @brief  Return the number of words latched by FQ_UD.
+         */
+        auto get_update_count() -> uint64_t
+        {
+            return updates_;
+        }
+
+    private:
+
+        static const uint NUM_PINS = 30;
+        static const uint WORD_BITS = 40;
+
+        /**
+         * @brief  Act on the rising edges of a pin update.  All the
+         *         levels are updated first, so DATA is already stable
+         *         when W_CLK rises in the same write.
+         * @param  rising  GPIOs that went high.
+         */
+        auto on_rising(uint32_t rising) -> void
+        {
+            if (rising & (1u << reset_))
+                on_reset();
+            if (rising & (1u << w_clk_))
+                on_word_clock();
+            if (rising & (1u << fq_ud_))
+                on_frequency_update();
+        }
+
+        /**
+         * @brief  Master reset.  Clears the registers and drops back
+         *         into parallel load mode.
+         */
+        auto on_reset() -> void
+        {
+            shift_ = 0;
+            bit_count_ = 0;
+            word_ = 0;
+            serial_mode_ = false;
+        }
+
+        /**
+         * @brief  W_CLK rising edge.  Shift the data line into the input
+         *         register.  Words go in LSB first, so after 40 clocks the
+         *         first bit has reached bit 0 and only the last 40 bits
+         *         clocked in are kept.
+         */
+        auto on_word_clock() -> void
+        {
+            shift_ >>= 1;
+            if (pins_[data_])
+                shift_ |= static_cast<uint64_t>(1) << (WORD_BITS - 1);
+            if (bit_count_ < WORD_BITS)
+                ++bit_count_;
+        }
+
+        /**
+         * @brief  FQ_UD rising edge.  Transfer the input register to
+         *         the output, or enter serial mode after a reset.
+         */
+        auto on_frequency_update() -> void
+        {
+            if (!serial_mode_)
+            {
+                // The modules hard-wire D0..D2 for serial mode, so the first
+                // W_CLK/FQ_UD pair after reset just switches the load mode.
+                //
+                serial_mode_ = true;
+                report("serial mode enabled");
+            }
+            else if (bit_count_ != WORD_BITS)
+            {
+                char message[64];
+                snprintf(message, sizeof(message), "partial word ignored (%u bits)", bit_count_);
+                report(message);
+            }
+            else
+            {
+                word_ = shift_;
+                ++updates_;
+                if (log_)
+                {
+                    bool marked = (marker_ < NUM_PINS) && pins_[marker_];
+                    fprintf(log_,
+                        "dds: word=0x%010llx frequency=%.3f Hz phase=%.2f deg output=%s%s\n",
+                        static_cast<unsigned long long>(word_),
+                        get_frequency(), get_phase(), get_enabled() ? "on" : "off",
+                        marked ? " marker" : "");
+                }
+            }
+
+            shift_ = 0;
+            bit_count_ = 0;
+        }
+
+        /**
+         * @brief  Write a message to the log, if there is one.
+         */
+        auto report(const char* message) -> void
+        {
+            if (log_)
+                fprintf(log_, "dds: %s\n", message);
+        }
+
+        uint32_t osc_hz_;               // See constructor for these value definitions.
+        uint w_clk_;
+        uint fq_ud_;
+        uint data_;
+        uint reset_;
+        FILE* log_;
+        uint marker_ = NUM_PINS;        // Marker GPIO, if one is attached.
+
+        bool pins_[NUM_PINS] { };       // Last level written to each line.
+
+        uint64_t shift_ = 0;            // Input register and number of bits loaded.
+        uint bit_count_ = 0;
+        uint64_t word_ = 0;             // Word driving the output.
+        uint64_t updates_ = 0;
+        bool serial_mode_ = false;
+    };
+}
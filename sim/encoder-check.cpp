@@ -0,0 +1,194 @@
+// Quadrature encoder check.
+//
+// Feeds made-up edge sequences through the encoder's Gray code decoder
+// and acceleration: clean turns both ways, contact bounce on every edge,
+// states lost when the FIFO overflows, half-cycle and full-cycle detents,
+// turns at different speeds, and backlogs drained by one poll.  Exits
+// non-zero if any sequence gives the wrong detents or frequency change.
+//
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pico/stdlib.h"
+
+#include "quadrature_encoder.hpp"
+
+// The encoder only configures its inputs.
+//
+void gpio_init(uint gpio) { }
+void gpio_set_dir(uint gpio, bool out) { }
+void gpio_put(uint gpio, bool value) { }
+bool gpio_get(uint gpio) { return false; }
+void gpio_set_mask(uint32_t mask) { }
+void gpio_clr_mask(uint32_t mask) { }
+void gpio_xor_mask(uint32_t mask) { }
+
+namespace
+{
+    // One detent of a full-cycle encoder, forward, from rest at 00.
+    //
+    const std::vector<uint32_t> FORWARD = { 1, 3, 2, 0 };
+    const std::vector<uint32_t> BACK = { 2, 3, 1, 0 };
+
+    int failures = 0;
+
+    auto check(const char* name, int64_t got, int64_t expected) -> void
+    {
+        bool ok = (got == expected);
+        printf("%-44s %10lld %10lld  %s\n", name, static_cast<long long>(got),
+            static_cast<long long>(expected), ok ? "ok" : "FAIL");
+        if (!ok)
+            ++failures;
+    }
+
+    /**
+     * @brief  Return the sequence of states for turns of a full-cycle
+     *         encoder, from rest at `start`.
+     * @param  detents  Detents to turn; negative turns back.
+     */
+    auto turn(int detents, uint32_t start = 0) -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> states;
+        const std::vector<uint32_t>& cycle = (detents >= 0) ? FORWARD : BACK;
+        for (int i = 0; i < (detents >= 0 ? detents : -detents); ++i)
+        {
+            for (uint32_t state : cycle)
+                states.push_back(state ^ start);
+        }
+        return states;
+    }
+
+    /**
+     * @brief  Run states through a decoder and return the net detents.
+     *         The rest state is given first.
+     */
+    auto decode(const std::vector<uint32_t>& states, uint32_t edges_per_detent = 4,
+                uint32_t start = 0) -> int
+    {
+        QuadratureDecoder decoder(edges_per_detent);
+        decoder.update(start);
+        int detents = 0;
+        for (uint32_t state : states)
+            detents += decoder.update(state);
+        return detents;
+    }
+
+    /**
+     * @brief  Repeat each edge with a bounce back to the state before.
+     */
+    auto bounce(const std::vector<uint32_t>& states, uint32_t start = 0) -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> bounced;
+        uint32_t previous = start;
+        for (uint32_t state : states)
+        {
+            bounced.insert(bounced.end(), { state, previous, state, previous, state });
+            previous = state;
+        }
+        return bounced;
+    }
+
+    /**
+     * @brief  Drop every nth state, as when the FIFO overflows.
+     */
+    auto drop(const std::vector<uint32_t>& states, size_t n, size_t first) -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> kept;
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            if ((i % n) != first)
+                kept.push_back(states[i]);
+        }
+        return kept;
+    }
+
+    /**
+     * @brief  Turn an encoder a detent at a time, a fixed time apart,
+     *         and return the total frequency change.
+     */
+    auto spin(QuadratureEncoder& encoder, int detents, uint64_t interval_us, uint64_t& now_us) -> int64_t
+    {
+        int64_t change = 0;
+        for (int i = 0; i < (detents >= 0 ? detents : -detents); ++i)
+        {
+            now_us += interval_us;
+            for (uint32_t state : (detents >= 0) ? FORWARD : BACK)
+                change += encoder.update(state, now_us);
+        }
+        return change;
+    }
+
+    /**
+     * @brief  Feed in detents left waiting in the FIFO, all drained by
+     *         one poll at the same time, the way poll() takes them.
+     */
+    auto backlog(QuadratureEncoder& encoder, int detents, uint64_t now_us) -> int64_t
+    {
+        int64_t change = 0;
+        bool timed = true;
+        for (uint32_t state : turn(detents))
+        {
+            int32_t step = encoder.update(state, now_us, timed);
+            if (step != 0)
+                timed = false;
+            change += step;
+        }
+        return change;
+    }
+}
+
+/**
+ * @brief  Main method
+ */
+int main()
+{
+    printf("%-44s %10s %10s\n", "sequence", "got", "expected");
+
+    check("forward 10", decode(turn(10)), 10);
+    check("back 10", decode(turn(-10)), -10);
+    check("forward 7, back 3", decode([] {
+        std::vector<uint32_t> states = turn(7);
+        std::vector<uint32_t> back = turn(-3);
+        states.insert(states.end(), back.begin(), back.end());
+        return states;
+    }()), 4);
+    check("rest at 11, forward 5", decode(turn(5, 3), 4, 3), 5);
+    check("bounce on every edge, forward 10", decode(bounce(turn(10))), 10);
+    check("bounce on every edge, back 10", decode(bounce(turn(-10))), -10);
+    check("quarter turn and back", decode({ 1, 0, 1, 0 }), 0);
+    check("half turn and back", decode({ 1, 3, 1, 0 }), 0);
+    check("second state of each detent lost", decode(drop(turn(10), 4, 1)), 10);
+    check("third state of each detent lost", decode(drop(turn(-10), 4, 2)), -10);
+    check("both inputs change at rest", decode({ 3, 0, 3, 0 }), 0);
+    check("half-cycle detents, forward 5 cycles", decode(turn(5), 2), 10);
+    check("half-cycle detents, back 5 cycles", decode(turn(-5), 2), -10);
+    check("every edge a detent, forward 5 cycles", decode(turn(5), 1), 20);
+    check("every edge a detent, bounce", decode(bounce(turn(2)), 1), 8);
+
+    // Acceleration.  The first detent of a turn moves one step, and so
+    // does the first after turning back.
+    //
+    QuadratureEncoder encoder(pio0, 16);
+    encoder.set_step(100);
+    uint64_t now_us = 1000000;
+    encoder.update(0, now_us);
+
+    check("slow, 5 detents", spin(encoder, 5, 100000, now_us), 500);
+    check("medium, 5 detents", spin(encoder, 5, 30000, now_us), 5 * 200);
+    check("fast, 5 detents", spin(encoder, 5, 15000, now_us), 5 * 1000);
+    check("spinning, 5 detents", spin(encoder, 5, 2000, now_us), 5 * 10000);
+    check("spinning back, 5 detents", spin(encoder, -5, 2000, now_us), -100 - 4 * 10000);
+    now_us += 100000;
+    check("backlog of 5 detents in one poll", backlog(encoder, 5, now_us), 500);
+    now_us += 2000;
+    check("spinning, then a backlog of 5", backlog(encoder, 5, now_us), 10000 + 4 * 100);
+    encoder.set_acceleration(false);
+    check("spinning, no acceleration", spin(encoder, 5, 2000, now_us), 500);
+    encoder.set_step(0);
+    check("step 0", spin(encoder, 5, 100000, now_us), 0);
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// Host stand-in for hardware/adc.h.  Setup calls are accepted and
+// ignored; samples come from the simulator's detector model, delivered by
+// the DMA stand-in when a channel reads the FIFO.
+//
+#include "pico/stdlib.h"
+
+typedef struct {
+    volatile uint32_t cs;
+    volatile uint32_t result;
+    volatile uint32_t fcs;
+    volatile uint32_t fifo;
+    volatile uint32_t div;
+} adc_hw_t;
+
+static adc_hw_t sim_adc;
+#define adc_hw (&sim_adc)
+
+static inline void adc_init(void) { }
+static inline void adc_gpio_init(uint gpio) { }
+static inline void adc_select_input(uint input) { }
+static inline void adc_set_clkdiv(float clkdiv) { }
+static inline void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) { }
+static inline void adc_fifo_drain(void) { }
+
+void adc_run(bool run);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pico/stdlib.h"
+
+// Host stand-in for hardware/clocks.h.  The simulated system clock runs
+// at the SDK default of 125 MHz.
+//
+enum clock_index {
+    clk_gpout0 = 0,
+    clk_gpout1,
+    clk_gpout2,
+    clk_gpout3,
+    clk_ref,
+    clk_sys,
+    clk_peri,
+    clk_usb,
+    clk_adc,
+    clk_rtc,
+    CLK_COUNT
+};
+
+static inline uint32_t clock_get_hz(enum clock_index clk_index) { return 125000000; }
@@ -0,0 +1,48 @@
+#pragma once
+
+// Host stand-in for hardware/dma.h.  Only the ADC capture is modelled:
+// a channel paced by the ADC fills its buffer from the detector model at
+// the ADC sample rate.  Other channels go nowhere: started with a count
+// they finish at once, and re-armed they stay busy, as with a state
+// machine that never asks for data.
+//
+#include "pico/stdlib.h"
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8  = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+#define DREQ_ADC  36
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+typedef struct {
+    uint32_t read_addr;
+    uint32_t write_addr;
+    uint32_t transfer_count;
+    uint32_t ctrl_trig;
+} dma_channel_hw_t;
+
+static dma_channel_hw_t sim_dma_channels[12] = { };
+static inline dma_channel_hw_t* dma_channel_hw_addr(uint channel) { return &sim_dma_channels[channel]; }
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel) { dma_channel_config c = { }; return c; }
+static inline void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size) { }
+static inline void channel_config_set_read_increment(dma_channel_config* c, bool incr) { }
+static inline void channel_config_set_write_increment(dma_channel_config* c, bool incr) { }
+static inline void channel_config_set_dreq(dma_channel_config* c, uint dreq) { }
+static inline void channel_config_set_ring(dma_channel_config* c, bool write, uint size_bits) { }
+static inline void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    sim_dma_channels[channel].transfer_count = trans_count;
+}
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+    const volatile void* read_addr, uint transfer_count, bool trigger);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_abort(uint channel);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host stand-in for hardware/flash.h.  Flash is an array in the
+// simulator, mapped at XIP_BASE, and optionally kept in a file between
+// runs.
+//
+#define FLASH_PAGE_SIZE         (1u << 8)
+#define FLASH_SECTOR_SIZE       (1u << 12)
+#define PICO_FLASH_SIZE_BYTES   (64u * 1024u)
+
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+#define XIP_BASE                ((uintptr_t)sim_flash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count);
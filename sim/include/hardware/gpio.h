@@ -0,0 +1,37 @@
+#pragma once
+
+// Host stand-in for hardware/gpio.h.  Pin functions, overrides and edge
+// interrupts are accepted and ignored; the simulator only models the
+// SIO outputs that drive the AD9850.
+//
+#include "pico/stdlib.h"
+
+enum gpio_function {
+    GPIO_FUNC_SIO  = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7,
+    GPIO_FUNC_NULL = 0x1f,
+};
+
+enum gpio_override {
+    GPIO_OVERRIDE_NORMAL = 0,
+    GPIO_OVERRIDE_INVERT = 1,
+    GPIO_OVERRIDE_LOW    = 2,
+    GPIO_OVERRIDE_HIGH   = 3,
+};
+
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW  = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL  = 0x4u,
+    GPIO_IRQ_EDGE_RISE  = 0x8u,
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+static inline void gpio_set_function(uint gpio, enum gpio_function fn) { }
+static inline void gpio_set_inover(uint gpio, uint value) { }
+static inline void gpio_pull_up(uint gpio) { }
+static inline void gpio_pull_down(uint gpio) { }
+static inline void gpio_set_irq_enabled_with_callback(
+    uint gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback) { }
@@ -0,0 +1,73 @@
+#pragma once
+
+// Host stand-in for hardware/pio.h.  Programs load and state machines
+// accept configuration, but nothing executes: the FIFOs stay empty and
+// no pins are driven.  Every state machine reads as stalled on its
+// empty TX FIFO.
+//
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+#define PIO_FDEBUG_TXSTALL_LSB  24
+
+typedef struct sim_pio_s {
+    uint index;
+    uint32_t fdebug;
+    uint32_t txf[4];
+} sim_pio_t;
+typedef sim_pio_t* PIO;
+
+static sim_pio_t sim_pio_blocks[2] = { { 0, 0x0f000000, { } }, { 1, 0x0f000000, { } } };
+#define pio0 (&sim_pio_blocks[0])
+#define pio1 (&sim_pio_blocks[1])
+
+typedef struct pio_program {
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2,
+};
+
+typedef struct {
+    uint32_t clkdiv;
+    uint32_t execctrl;
+    uint32_t shiftctrl;
+    uint32_t pinctrl;
+} pio_sm_config;
+
+static inline pio_sm_config pio_get_default_sm_config(void) { pio_sm_config c = { }; return c; }
+static inline void sm_config_set_wrap(pio_sm_config* c, uint wrap_target, uint wrap) { }
+static inline void sm_config_set_set_pins(pio_sm_config* c, uint base, uint count) { }
+static inline void sm_config_set_out_pins(pio_sm_config* c, uint base, uint count) { }
+static inline void sm_config_set_in_pins(pio_sm_config* c, uint base) { }
+static inline void sm_config_set_sideset_pins(pio_sm_config* c, uint base) { }
+static inline void sm_config_set_jmp_pin(pio_sm_config* c, uint pin) { }
+static inline void sm_config_set_sideset(pio_sm_config* c, uint bits, bool optional, bool pindirs) { }
+static inline void sm_config_set_clkdiv(pio_sm_config* c, float div) { }
+static inline void sm_config_set_out_shift(pio_sm_config* c, bool right, bool autopull, uint threshold) { }
+static inline void sm_config_set_in_shift(pio_sm_config* c, bool right, bool autopush, uint threshold) { }
+static inline void sm_config_set_fifo_join(pio_sm_config* c, enum pio_fifo_join join) { }
+
+static inline int pio_claim_unused_sm(PIO pio, bool required) { static int next = 0; return next++ & 3; }
+static inline uint pio_add_program(PIO pio, const pio_program_t* program) { return 0; }
+static inline void pio_gpio_init(PIO pio, uint pin) { }
+static inline void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config* config) { }
+static inline void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) { }
+static inline void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t values, uint32_t mask) { }
+static inline void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t dirs, uint32_t mask) { }
+static inline void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint base, uint count, bool out) { }
+static inline void pio_sm_put(PIO pio, uint sm, uint32_t data) { }
+static inline void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) { }
+static inline uint32_t pio_sm_get(PIO pio, uint sm) { return 0; }
+static inline bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) { return true; }
+static inline bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) { return false; }
+static inline bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) { return true; }
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) { return (pio->index << 3) + (is_tx ? 0 : 4) + sm; }
+static inline void pio_sm_clear_fifos(PIO pio, uint sm) { }
+static inline void pio_sm_restart(PIO pio, uint sm) { }
+static inline void pio_sm_exec(PIO pio, uint sm, uint instr) { }
@@ -0,0 +1,49 @@
+#pragma once
+
+// Host stand-in for hardware/pio_instructions.h.  The encodings match
+// the SDK so programs built at run time are the same on both.
+//
+#include "pico/stdlib.h"
+
+enum pio_src_dest {
+    pio_pins = 0u,
+    pio_x = 1u,
+    pio_y = 2u,
+    pio_null = 3u,
+    pio_pindirs = 4u,
+    pio_exec_mov = 4u,
+    pio_status = 5u,
+    pio_pc = 5u,
+    pio_isr = 6u,
+    pio_osr = 7u,
+    pio_exec_out = 7u,
+};
+
+static inline uint pio_encode_instr_and_args(uint instr, uint arg1, uint arg2)
+{
+    return instr | (arg1 << 5u) | (arg2 & 0x1fu);
+}
+
+static inline uint pio_encode_delay(uint cycles) { return cycles << 8u; }
+static inline uint pio_encode_sideset(uint sideset_bit_count, uint value) { return value << (13u - sideset_bit_count); }
+static inline uint pio_encode_sideset_opt(uint sideset_bit_count, uint value) { return 0x1000u | value << (12u - sideset_bit_count); }
+static inline uint pio_encode_jmp(uint addr) { return pio_encode_instr_and_args(0x0000u, 0, addr); }
+static inline uint pio_encode_jmp_not_x(uint addr) { return pio_encode_instr_and_args(0x0000u, 1, addr); }
+static inline uint pio_encode_jmp_x_dec(uint addr) { return pio_encode_instr_and_args(0x0000u, 2, addr); }
+static inline uint pio_encode_jmp_not_y(uint addr) { return pio_encode_instr_and_args(0x0000u, 3, addr); }
+static inline uint pio_encode_jmp_y_dec(uint addr) { return pio_encode_instr_and_args(0x0000u, 4, addr); }
+static inline uint pio_encode_jmp_x_ne_y(uint addr) { return pio_encode_instr_and_args(0x0000u, 5, addr); }
+static inline uint pio_encode_jmp_pin(uint addr) { return pio_encode_instr_and_args(0x0000u, 6, addr); }
+static inline uint pio_encode_wait_gpio(bool polarity, uint gpio) { return pio_encode_instr_and_args(0x2000u, 0u | (polarity ? 4u : 0u), gpio); }
+static inline uint pio_encode_wait_pin(bool polarity, uint pin) { return pio_encode_instr_and_args(0x2000u, 1u | (polarity ? 4u : 0u), pin); }
+static inline uint pio_encode_wait_irq(bool polarity, bool relative, uint irq) { return pio_encode_instr_and_args(0x2000u, 2u | (polarity ? 4u : 0u), irq | (relative ? 0x10u : 0u)); }
+static inline uint pio_encode_in(enum pio_src_dest src, uint count) { return pio_encode_instr_and_args(0x4000u, src & 7u, count); }
+static inline uint pio_encode_out(enum pio_src_dest dest, uint count) { return pio_encode_instr_and_args(0x6000u, dest & 7u, count); }
+static inline uint pio_encode_push(bool if_full, bool block) { return pio_encode_instr_and_args(0x8000u, (if_full ? 2u : 0u) | (block ? 1u : 0u), 0); }
+static inline uint pio_encode_pull(bool if_empty, bool block) { return pio_encode_instr_and_args(0x8000u, 4u | (if_empty ? 2u : 0u) | (block ? 1u : 0u), 0); }
+static inline uint pio_encode_mov(enum pio_src_dest dest, enum pio_src_dest src) { return pio_encode_instr_and_args(0xa000u, dest & 7u, src & 7u); }
+static inline uint pio_encode_irq_set(bool relative, uint irq) { return pio_encode_instr_and_args(0xc000u, 0, irq | (relative ? 0x10u : 0u)); }
+static inline uint pio_encode_irq_wait(bool relative, uint irq) { return pio_encode_instr_and_args(0xc000u, 1, irq | (relative ? 0x10u : 0u)); }
+static inline uint pio_encode_irq_clear(bool relative, uint irq) { return pio_encode_instr_and_args(0xc000u, 2, irq | (relative ? 0x10u : 0u)); }
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value) { return pio_encode_instr_and_args(0xe000u, dest & 7u, value); }
+static inline uint pio_encode_nop(void) { return pio_encode_mov(pio_y, pio_y); }
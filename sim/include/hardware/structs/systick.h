@@ -0,0 +1,31 @@
+#pragma once
+
+// Host stand-in for hardware/structs/systick.h.  The current value
+// register counts down at 125 MHz, derived from the host clock, so cycle
+// timings come out in simulated system clocks.
+//
+#include <stdint.h>
+#include <time.h>
+
+struct sim_systick_cvr_t
+{
+    operator uint32_t() const
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+        return ~static_cast<uint32_t>(ns / 8) & 0x00ffffff;
+    }
+
+    sim_systick_cvr_t& operator=(uint32_t value) { return *this; }
+};
+
+typedef struct {
+    uint32_t csr;
+    uint32_t rvr;
+    sim_systick_cvr_t cvr;
+    uint32_t calib;
+} systick_hw_t;
+
+static systick_hw_t sim_systick;
+#define systick_hw (&sim_systick)
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for hardware/sync.h.  The simulator implements the event
+// register with a condition variable; __wfe also returns periodically,
+// as the real core does on the next timer interrupt.  Disabling
+// interrupts takes a lock that the simulated interrupts also run under.
+//
+void __wfe(void);
+void __wfi(void);
+void __sev(void);
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host stand-in for pico/stdio_usb.h.  The pseudo-terminal doesn't
+// translate line endings, so the driver is only a handle.
+//
+#include "pico/stdlib.h"
+
+extern stdio_driver_t stdio_usb;
@@ -0,0 +1,44 @@
+#pragma once
+
+// Host stand-in for the parts of the Pico SDK used by the firmware
+// headers.  The functions are implemented by the simulator, which routes
+// GPIO writes into the AD9850 model and stdio onto the pseudo-terminal.
+//
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define PICO_ERROR_TIMEOUT  -1
+
+// Code placement and inlining.  Everything runs from RAM on the host.
+//
+#define __not_in_flash_func(func_name) func_name
+#define __force_inline inline __attribute__((always_inline))
+
+#define GPIO_IN   false
+#define GPIO_OUT  true
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_set_mask(uint32_t mask);
+void gpio_clr_mask(uint32_t mask);
+void gpio_xor_mask(uint32_t mask);
+
+typedef struct stdio_driver stdio_driver_t;
+
+bool stdio_init_all(void);
+void stdio_set_translate_crlf(stdio_driver_t* driver, bool translate);
+int stdio_getchar_timeout_us(uint32_t timeout_us);
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param);
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void* user_data);
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past);
@@ -0,0 +1,192 @@
+// JSON parser benchmark.
+//
+// Times tiny-json on the command shapes the firmware receives and on
+// larger documents, with the integer cache off (the original behaviour)
+// and on.  Each case parses
+// a fresh copy of the text, since parsing modifies it, then reads the
+// fields the way the command processor does.
+//
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "tiny-json.h"
+
+namespace
+{
+    // Fields looked up for every command, in CommandProcessor order.
+    //
+    const char* const COMMAND_FIELDS[] = {
+        "command_number", "enable_out", "frequency", "phase", "arm",
+        "trigger_edge", "stats", "reset_stats", "trace", "marker",
+        "marker_n", "sweep_start",
+    };
+
+    const char* const COMMANDS[] = {
+        R"({"command_number": 1, "frequency": 1000000})",
+        R"({"command_number": 2, "frequency": 1000000, "phase": 9000, "enable_out": true})",
+        R"({"command_number": 3})",
+        R"({"command_number": 4, "frequency": 250000, "arm": true, "marker": "nth", "marker_n": 10, "sweep_start": true})",
+    };
+
+    // Parser configuration under test.
+    //
+    using options_t = struct {
+        const char* name;
+        bool cache_integers;
+    };
+
+    const options_t OPTIONS[] = {
+        { "baseline", false },
+        { "cached",   true  },
+    };
+
+    const size_t POOL_LEN = 4096;
+
+    json_t pool_mem[POOL_LEN];
+
+    volatile int64_t sink;              // Keeps results from being optimized away.
+
+    /**
+     * @brief  Parse a copy of a document with the given options.
+     */
+    auto parse(std::vector<char>& buffer, const std::string& text, const options_t& options) -> json_t const*
+    {
+        memcpy(buffer.data(), text.c_str(), text.size() + 1);
+
+        jsonStaticPool_t spool;
+        jsonPool_t* pool = json_initStaticPool(&spool, pool_mem, POOL_LEN);
+        pool->cacheIntegers = options.cache_integers;
+        return json_createWithPool(buffer.data(), pool);
+    }
+
+    /**
+     * @brief  Read a parsed command as the command processor does.
+     */
+    auto read_command(json_t const* json) -> int64_t
+    {
+        int64_t total = 0;
+        for (const char* field : COMMAND_FIELDS)
+        {
+            json_t const* property = json_getProperty(json, field);
+            if (property && json_getType(property) == JSON_INTEGER)
+                total += json_getInteger(property);
+        }
+        return total;
+    }
+
+    /**
+     * @brief  Sum the integers of a parsed array.
+     */
+    auto read_array(json_t const* json) -> int64_t
+    {
+        int64_t total = 0;
+        for (json_t const* item = json_getChild(json); item; item = json_getSibling(item))
+            total += json_getInteger(item);
+        return total;
+    }
+
+    /**
+     * @brief  Look up every key of a parsed object with numbered keys.
+     */
+    auto read_object(json_t const* json, size_t keys) -> int64_t
+    {
+        int64_t total = 0;
+        char name[24];                  // "k" and the digits of any size_t.
+        for (size_t key = 0; key < keys; ++key)
+        {
+            snprintf(name, sizeof(name), "k%zu", key);
+            json_t const* property = json_getProperty(json, name);
+            if (property)
+                total += json_getInteger(property);
+        }
+        return total;
+    }
+
+    /**
+     * @brief  Time a workload and print the time per iteration.
+     * @param  label       Case name.
+     * @param  iterations  Number of times to run the workload.
+     * @param  work        Workload; returns a value fed to the sink.
+     */
+    template<typename Work>
+    auto run(const char* label, const options_t& options, size_t iterations, Work work) -> void
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            sink = work();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+        printf("%-22s %-10s %12.1f ns\n", label, options.name, ns);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t iterations = 200000;
+    size_t array_len = 1000;
+    size_t object_keys = 64;
+
+    static const struct option long_options[] = {
+        { "iterations",  required_argument, nullptr, 'n' },
+        { "array-len",   required_argument, nullptr, 'a' },
+        { "object-keys", required_argument, nullptr, 'k' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "n:a:k:", long_options, nullptr)) != -1)
+    {
+        switch (option)
+        {
+            case 'n': iterations = strtoul(optarg, nullptr, 0); break;
+            case 'a': array_len = strtoul(optarg, nullptr, 0); break;
+            case 'k': object_keys = strtoul(optarg, nullptr, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [--iterations N] [--array-len N] [--object-keys N]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if ((array_len >= POOL_LEN) || (object_keys >= POOL_LEN))
+    {
+        fprintf(stderr, "json-bench: documents are limited to %zu values\n", POOL_LEN - 1);
+        return 1;
+    }
+
+    std::string array = "[";
+    for (size_t i = 0; i < array_len; ++i)
+        array += (i ? "," : "") + std::to_string(i * 7919 + 1000000);
+    array += "]";
+
+    std::string object = "{";
+    for (size_t i = 0; i < object_keys; ++i)
+        object += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":" + std::to_string(i * 31);
+    object += "}";
+
+    std::vector<char> buffer(std::max(array.size(), object.size()) + 1024);
+
+    for (const options_t& options : OPTIONS)
+    {
+        char label[32];
+        for (size_t c = 0; c < sizeof(COMMANDS) / sizeof(*COMMANDS); ++c)
+        {
+            std::string text = COMMANDS[c];
+            snprintf(label, sizeof(label), "command %zu", c + 1);
+            run(label, options, iterations, [&] { return read_command(parse(buffer, text, options)); });
+        }
+
+        size_t large_iterations = std::max<size_t>(1, iterations / 100);
+        snprintf(label, sizeof(label), "array of %zu", array_len);
+        run(label, options, large_iterations, [&] { return read_array(parse(buffer, array, options)); });
+        snprintf(label, sizeof(label), "object of %zu", object_keys);
+        run(label, options, large_iterations, [&] { return read_object(parse(buffer, object, options), object_keys); });
+    }
+
+    return 0;
+}
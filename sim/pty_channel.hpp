@@ -0,0 +1,110 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <iostream>
+#include <streambuf>
+
+#include "command_channel.hpp"
+#include "pty_link.hpp"
+
+// Command channel on a second pseudo-terminal.  Stands in for the UART
+// channel, whose FIFO interrupt isn't simulated: the link's interrupt
+// thread runs the characters-available callback instead, and loses bytes
+// past the UART's receive ring.
+//
+namespace
+{
+    class PtyChannel : public CommandChannel, private std::streambuf
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  link  Link to use.  Opened but not started.
+         */
+        PtyChannel(PtyLink& link)
+            : link_(link)
+            , out_(this)
+        {
+            setp(buffer_, buffer_ + sizeof(buffer_));
+        }
+
+        /**
+         * @brief  Start the link.
+         * @return true if successful.
+         */
+        auto start() -> bool
+        {
+            output_ = link_.start_channel();
+            return output_ >= 0;
+        }
+
+        auto set_chars_available_callback(void (*fn)(void*), void* param) -> void override
+        {
+            link_.set_chars_available_callback(fn, param);
+        }
+
+        auto read_char() -> int override
+        {
+            return link_.getchar(0);
+        }
+
+        auto take_overrun(uint32_t& position) -> uint32_t override
+        {
+            return link_.take_overrun(position);
+        }
+
+        auto out() -> std::ostream& override
+        {
+            return out_;
+        }
+
+        auto begin_binary_block() -> void override
+        {
+            out_ << std::flush;
+        }
+
+        auto end_binary_block() -> void override
+        {
+            out_ << std::flush;
+        }
+
+    private:
+        /**
+         * @brief  streambuf output.  Writes the buffer out and takes the
+         *         character that didn't fit.
+         */
+        auto overflow(int character) -> int override
+        {
+            sync();
+            if (character != traits_type::eof())
+            {
+                *pptr() = static_cast<char>(character);
+                pbump(1);
+            }
+            return traits_type::not_eof(character);
+        }
+
+        /**
+         * @brief  streambuf flush.
+         */
+        auto sync() -> int override
+        {
+            for (char* next = pbase(); next < pptr(); )
+            {
+                ssize_t written = write(output_, next, pptr() - next);
+                if (written <= 0)
+                    break;
+                next += written;
+            }
+            setp(buffer_, buffer_ + sizeof(buffer_));
+            return 0;
+        }
+
+        PtyLink& link_;                 // See constructor for these value definitions.
+        int output_ = -1;
+        char buffer_[512];
+
+        std::ostream out_;
+    };
+}
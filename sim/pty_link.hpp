@@ -0,0 +1,421 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Pseudo-terminal standing in for the USB CDC port, or for the UART
+// command channel.  Clients open the slave side exactly as they would
+// open /dev/ttyACM0.  Each direction can
+// optionally be limited in throughput and delayed by a fixed latency so
+// client pipelining can be measured against something close to the real
+// link.  A link standing in for the UART can also hold only so many
+// delivered bytes unread, losing the rest as the UART's ring does.
+//
+namespace
+{
+    // Link limits.  Zero means unlimited.
+    //
+    using link_limits_t = struct {
+        uint64_t bytes_per_sec = 0;
+        uint64_t latency_us = 0;
+        size_t rx_capacity = 0;         // Delivered bytes held unread, past which they are lost.
+    };
+
+    /**
+     * @brief  Return microseconds since the first call.
+     */
+    auto sim_now_us() -> uint64_t
+    {
+        static const auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    }
+
+    // Bytes in flight in one direction, each stamped with the time at
+    // which the emulated link delivers it.
+    //
+    class LinkQueue
+    {
+    public:
+        LinkQueue(link_limits_t limits) : limits_(limits) { }
+
+        /**
+         * @brief  Queue bytes that entered the link at the given time.
+         */
+        auto push(const char* data, size_t length, uint64_t now_us) -> void
+        {
+            for (size_t i = 0; i < length; ++i)
+            {
+                double ready_us = static_cast<double>(now_us + limits_.latency_us);
+                if (ready_us < next_free_us_)
+                    ready_us = next_free_us_;
+                if (limits_.bytes_per_sec > 0)
+                    next_free_us_ = ready_us + 1.0e6 / limits_.bytes_per_sec;
+                bytes_.push_back({ static_cast<uint64_t>(ready_us), data[i] });
+            }
+        }
+
+        /**
+         * @brief  Return true if the byte at the head has been delivered.
+         */
+        auto ready(uint64_t now_us) -> bool
+        {
+            return !bytes_.empty() && (bytes_.front().ready_us <= now_us);
+        }
+
+        /**
+         * @brief  Return the delivery time of the byte at the head.
+         */
+        auto next_ready_us() -> uint64_t
+        {
+            return bytes_.empty() ? UINT64_MAX : bytes_.front().ready_us;
+        }
+
+        /**
+         * @brief  Lose the delivered bytes past the first `keep`.
+         * @return The number of bytes lost.
+         */
+        auto drop_ready(uint64_t now_us, size_t keep) -> size_t
+        {
+            size_t ready = 0;
+            while ((ready < bytes_.size()) && (bytes_[ready].ready_us <= now_us))
+                ++ready;
+            if (ready <= keep)
+                return 0;
+
+            bytes_.erase(bytes_.begin() + keep, bytes_.begin() + ready);
+            return ready - keep;
+        }
+
+        /**
+         * @brief  Remove and return the byte at the head.
+         */
+        auto pop() -> char
+        {
+            char byte = bytes_.front().byte;
+            bytes_.pop_front();
+            return byte;
+        }
+
+    private:
+        struct entry_t { uint64_t ready_us; char byte; };
+
+        link_limits_t limits_;
+        std::deque<entry_t> bytes_;
+        double next_free_us_ = 0.0;     // Earliest time the link is free for the next byte.
+    };
+
+    class PtyLink
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  limits  Throughput and latency applied to both directions.
+         */
+        PtyLink(link_limits_t limits)
+            : rx_(limits)
+            , tx_(limits)
+            , rx_capacity_(limits.rx_capacity)
+        {
+        }
+
+        ~PtyLink()
+        {
+            if (!link_path_.empty())
+                unlink(link_path_.c_str());
+        }
+
+        /**
+         * @brief  Create the pseudo-terminal.
+         * @param  link_path  Optional symlink to create to the slave device.
+         * @return true if successful.
+         */
+        auto open(const std::string& link_path) -> bool
+        {
+            master_ = posix_openpt(O_RDWR | O_NOCTTY);
+            if ((master_ < 0) || (grantpt(master_) != 0) || (unlockpt(master_) != 0))
+                return false;
+            slave_name_ = ptsname(master_);
+
+            // Keep a slave descriptor open for the life of the simulator so
+            // the master doesn't see a hangup between client sessions, and
+            // put it in raw mode so nothing is echoed or translated before a
+            // client configures the port.
+            //
+            slave_ = ::open(slave_name_.c_str(), O_RDWR | O_NOCTTY);
+            if (slave_ < 0)
+                return false;
+            struct termios tio;
+            tcgetattr(slave_, &tio);
+            cfmakeraw(&tio);
+            tcsetattr(slave_, TCSANOW, &tio);
+
+            if (!link_path.empty())
+            {
+                unlink(link_path.c_str());
+                if (symlink(slave_name_.c_str(), link_path.c_str()) != 0)
+                    return false;
+                link_path_ = link_path;
+            }
+            return true;
+        }
+
+        /**
+         * @brief  Return the path of the slave device.
+         */
+        auto slave_name() -> const std::string&
+        {
+            return slave_name_;
+        }
+
+        /**
+         * @brief  Route stdout through the link and start the pump threads.
+         */
+        auto start() -> bool
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+                return false;
+            fflush(stdout);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[1]);
+            start_threads(fds[0]);
+            return true;
+        }
+
+        /**
+         * @brief  Start the pump threads for a link other than stdout.
+         * @return A descriptor whose output goes out through the link, or
+         *         -1 on failure.
+         */
+        auto start_channel() -> int
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+                return -1;
+            start_threads(fds[0]);
+            return fds[1];
+        }
+
+        /**
+         * @brief  Equivalent of stdio_getchar_timeout_us.
+         * @param  timeout_us  Time to wait for a character, in us.
+         * @return The character, or -1 on timeout.
+         */
+        auto getchar(uint32_t timeout_us) -> int
+        {
+            std::unique_lock<std::mutex> lock(rx_mutex_);
+            uint64_t deadline_us = sim_now_us() + timeout_us;
+
+            for (;;)
+            {
+                uint64_t now_us = sim_now_us();
+                if (rx_.ready(now_us))
+                {
+                    ++rx_bytes_;
+                    return static_cast<unsigned char>(rx_.pop());
+                }
+                if (now_us >= deadline_us)
+                    return -1;
+
+                uint64_t wake_us = std::min(deadline_us, rx_.next_ready_us());
+                rx_ready_.wait_for(lock, std::chrono::microseconds(wake_us - now_us));
+            }
+        }
+
+        /**
+         * @brief  Equivalent of stdio_set_chars_available_callback.  The
+         *         callback is run from the link's interrupt thread.
+         */
+        auto set_chars_available_callback(void (*fn)(void*), void* param) -> void
+        {
+            std::lock_guard<std::mutex> lock(rx_mutex_);
+            callback_ = fn;
+            callback_param_ = param;
+        }
+
+        /**
+         * @brief  Return the bytes lost to the receive capacity since the
+         *         last call.
+         * @param  position  Set to the bytes delivered before the first.
+         */
+        auto take_overrun(uint32_t& position) -> uint32_t
+        {
+            std::lock_guard<std::mutex> lock(rx_mutex_);
+            uint32_t lost = overruns_;
+            position = overrun_position_;
+            overruns_ = 0;
+            return lost;
+        }
+
+        /**
+         * @brief  Return the number of bytes delivered to the firmware.
+         */
+        auto rx_bytes() -> uint64_t
+        {
+            return rx_bytes_;
+        }
+
+        /**
+         * @brief  Return the number of bytes delivered to the client.
+         */
+        auto tx_bytes() -> uint64_t
+        {
+            return tx_bytes_;
+        }
+
+    private:
+
+        static constexpr uint64_t IRQ_RETRY_US = 1000;
+        static const size_t CHUNK_LEN = 512;
+
+        /**
+         * @brief  Start the pump threads.
+         * @param  output  Read end of the pipe carrying the firmware output.
+         */
+        auto start_threads(int output) -> void
+        {
+            stdout_ = output;
+            std::thread(&PtyLink::receive_thread, this).detach();
+            std::thread(&PtyLink::transmit_thread, this).detach();
+            std::thread(&PtyLink::irq_thread, this).detach();
+        }
+
+        /**
+         * @brief  Move bytes written by the client into the receive queue.
+         */
+        auto receive_thread() -> void
+        {
+            char buffer[CHUNK_LEN];
+            for (;;)
+            {
+                ssize_t length = read(master_, buffer, sizeof(buffer));
+                if (length <= 0)
+                {
+                    usleep(1000);
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> lock(rx_mutex_);
+                rx_.push(buffer, length, sim_now_us());
+                rx_ready_.notify_all();
+            }
+        }
+
+        /**
+         * @brief  Stands in for the USB interrupt.  Runs the characters-
+         *         available callback whenever received bytes are due, and
+         *         again every millisecond while any are left unread, as the
+         *         SDK's background USB task does.  Delivered bytes past the
+         *         receive capacity are lost first.
+         */
+        auto irq_thread() -> void
+        {
+            std::unique_lock<std::mutex> lock(rx_mutex_);
+            for (;;)
+            {
+                uint64_t now_us = sim_now_us();
+                size_t lost = (rx_capacity_ > 0) ? rx_.drop_ready(now_us, rx_capacity_) : 0;
+                if (lost > 0)
+                {
+                    if (overruns_ == 0)
+                        overrun_position_ = static_cast<uint32_t>(rx_bytes_ + rx_capacity_);
+                    overruns_ += lost;
+                }
+                if (callback_ && rx_.ready(now_us))
+                {
+                    auto callback = callback_;
+                    auto param = callback_param_;
+                    lock.unlock();
+                    uint32_t status = save_and_disable_interrupts();
+                    callback(param);
+                    restore_interrupts(status);
+                    lock.lock();
+
+                    if (rx_.ready(sim_now_us()))
+                        rx_ready_.wait_for(lock, std::chrono::microseconds(IRQ_RETRY_US));
+                    continue;
+                }
+
+                uint64_t wake_us = now_us + IRQ_RETRY_US;
+                if (callback_)
+                    wake_us = std::min(wake_us, rx_.next_ready_us());
+                rx_ready_.wait_for(lock, std::chrono::microseconds(wake_us - now_us));
+            }
+        }
+
+        /**
+         * @brief  Move bytes the firmware writes to stdout out to the client,
+         *         honoring the link limits.
+         */
+        auto transmit_thread() -> void
+        {
+            char buffer[CHUNK_LEN];
+            for (;;)
+            {
+                uint64_t now_us = sim_now_us();
+                uint64_t next_us = tx_.next_ready_us();
+                int timeout_ms = -1;
+                if (next_us != UINT64_MAX)
+                    timeout_ms = (next_us > now_us) ? static_cast<int>((next_us - now_us + 999) / 1000) : 0;
+
+                struct pollfd fd = { stdout_, POLLIN, 0 };
+                if (poll(&fd, 1, timeout_ms) > 0)
+                {
+                    ssize_t length = read(stdout_, buffer, sizeof(buffer));
+                    if (length > 0)
+                        tx_.push(buffer, length, sim_now_us());
+                }
+
+                // Send everything that is due in one write.
+                //
+                size_t length = 0;
+                now_us = sim_now_us();
+                while ((length < sizeof(buffer)) && tx_.ready(now_us))
+                    buffer[length++] = tx_.pop();
+                for (size_t sent = 0; sent < length; )
+                {
+                    ssize_t written = write(master_, buffer + sent, length - sent);
+                    if (written <= 0)
+                        break;
+                    sent += written;
+                    tx_bytes_ += written;
+                }
+            }
+        }
+
+        int master_ = -1;
+        int slave_ = -1;
+        int stdout_ = -1;
+        std::string slave_name_;
+        std::string link_path_;
+
+        std::mutex rx_mutex_;
+        std::condition_variable rx_ready_;
+        LinkQueue rx_;
+        LinkQueue tx_;
+        size_t rx_capacity_ = 0;
+        uint32_t overruns_ = 0;
+        uint32_t overrun_position_ = 0;
+        void (*callback_)(void*) = nullptr;
+        void* callback_param_ = nullptr;
+
+        std::atomic<uint64_t> rx_bytes_ { 0 };
+        std::atomic<uint64_t> tx_bytes_ { 0 };
+    };
+}
@@ -0,0 +1,91 @@
+// SCPI parser check.
+//
+// Runs parameters through the SCPI tokenizer's number decoder: plain
+// integers, fractions, exponents, unit suffixes, rounding to the fixed
+// point, including values that would round twice if each dropped digit
+// were rounded on its own, and text that isn't a number.  Exits non-zero
+// if any of them decodes wrongly.
+//
+#include <stdio.h>
+#include <string.h>
+
+#include "scpi_parser.hpp"
+
+namespace
+{
+    // A parameter, the decimals to decode it to, and the expected result:
+    // the value and suffix, or not a number.
+    //
+    using case_t = struct {
+        const char* parameter;
+        int decimals;
+        bool number;
+        uint64_t value;
+        const char* suffix;
+    };
+
+    const case_t CASES[] = {
+        { "1000000",        0, true,  1000000,    "" },
+        { "+42",            0, true,  42,         "" },
+        { "22.5",           2, true,  2250,       "" },
+        { "1.5MHZ",         6, true,  1500000,    "MHZ" },
+        { "2.5 kHz",        3, true,  2500,       "kHz" },
+        { "1e6",            0, true,  1000000,    "" },
+        { "1.25E+3",        0, true,  1250,       "" },
+        { "125e-2",         0, true,  1,          "" },
+        { "0.5",            0, true,  1,          "" },
+        { "0.49",           0, true,  0,          "" },
+        { "1.49999",        0, true,  1,          "" },
+        { "1.5",            0, true,  2,          "" },
+        { "0.0149",         2, true,  1,          "" },
+        { "0.0150",         2, true,  2,          "" },
+        { "2.4449",         2, true,  244,        "" },
+        { "0.004999999999", 2, true,  0,          "" },
+        { "1e-1000",        0, true,  0,          "" },
+        { "5e9",            0, true,  5000000000, "" },
+        { "1e20",           0, true,  UINT64_MAX, "" },
+        { "",               0, false, 0,          "" },
+        { "abc",            0, false, 0,          "abc" },
+        { "1.2.3",          0, false, 0,          "" },
+        { "1e+",            0, false, 0,          "" },
+        { "-5",             0, false, 0,          "" },
+    };
+
+    int failures = 0;
+}
+
+/**
+ * @brief  Main method
+ */
+int main()
+{
+    printf("%-20s %3s %22s %22s\n", "parameter", "dp", "got", "expected");
+
+    for (const case_t& entry : CASES)
+    {
+        scpi_token_t parameter = { entry.parameter, strlen(entry.parameter) };
+        scpi_token_t suffix = { nullptr, 0 };
+        uint64_t value = 0;
+        bool number = ScpiTokenizer::parse_decimal(parameter, entry.decimals, value, suffix);
+
+        bool ok = (number == entry.number);
+        if (ok && number)
+        {
+            ok = (value == entry.value) && (suffix.length == strlen(entry.suffix)) &&
+                 (strncmp(suffix.text, entry.suffix, suffix.length) == 0);
+        }
+
+        char got[32] = "not a number";
+        char expected[32] = "not a number";
+        if (number)
+            snprintf(got, sizeof(got), "%llu", static_cast<unsigned long long>(value));
+        if (entry.number)
+            snprintf(expected, sizeof(expected), "%llu", static_cast<unsigned long long>(entry.value));
+        printf("%-20s %3d %22s %22s  %s\n", entry.parameter, entry.decimals, got, expected, ok ? "ok" : "FAIL");
+        if (!ok)
+            ++failures;
+    }
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
+}
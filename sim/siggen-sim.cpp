@@ -0,0 +1,449 @@
+// Virtual signal generator.
+//
+// Runs the firmware's CommandProcessor and AD9850 driver on Linux.  The
+// GPIO layer is simulated by an AD9850 model that decodes the words the
+// driver clocks out, and the command channels are exposed on pseudo-
+// terminals that clients open in place of /dev/ttyACM0 and the UART.
+//
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "adc_model.hpp"
+#include "dds_model.hpp"
+#include "pty_channel.hpp"
+#include "pty_link.hpp"
+
+#include "AD9850.hpp"
+#include "adc_capture.hpp"
+#include "command_channel.hpp"
+#include "command_processor.hpp"
+#include "command_handler.hpp"
+#include "dither.hpp"
+#include "frequency_table.hpp"
+#include "lock_timer.hpp"
+#include "pulsed_output.hpp"
+#include "network_analyzer.hpp"
+#include "quadrature_encoder.hpp"
+#include "sequencer.hpp"
+#include "telemetry.hpp"
+
+const uint W_CLK   = 10;
+const uint FQ_UD   = 11;
+const uint DATA    = 12;
+const uint RESET   = 13;
+const uint TRIGGER = 14;
+const uint MARKER  = 15;
+const uint ENCODER_A = 16;     // Tuning encoder, B on GPIO 17.
+const uint LOCK_INPUT = 18;     // Lock or ready output of the device under test.
+const uint PULSE_GATE = 19;     // External gate for the pulsed output.
+const uint ADC_INPUT = 0;
+const size_t UART_RX_RING_LEN = 1024;  // The UART channel's receive ring.
+
+static DdsModel* dds_model = nullptr;
+static PtyLink* pty_link = nullptr;
+static AdcModel* adc_model = nullptr;
+static volatile sig_atomic_t running = 1;
+
+// Simulated SDK functions.
+//
+void gpio_init(uint gpio) { dds_model->set_pin(gpio, false); }
+void gpio_set_dir(uint gpio, bool out) { }
+void gpio_put(uint gpio, bool value) { dds_model->set_pin(gpio, value); }
+bool gpio_get(uint gpio) { return dds_model->get_pin(gpio); }
+void gpio_set_mask(uint32_t mask) { dds_model->set_pins(mask, true); }
+void gpio_clr_mask(uint32_t mask) { dds_model->set_pins(mask, false); }
+void gpio_xor_mask(uint32_t mask) { dds_model->toggle_pins(mask); }
+
+struct stdio_driver { };
+stdio_driver_t stdio_usb;
+
+bool stdio_init_all(void) { return true; }
+void stdio_set_translate_crlf(stdio_driver_t* driver, bool translate) { }
+int stdio_getchar_timeout_us(uint32_t timeout_us) { return pty_link->getchar(timeout_us); }
+void stdio_set_chars_available_callback(void (*fn)(void*), void* param)
+{
+    pty_link->set_chars_available_callback(fn, param);
+}
+
+uint64_t time_us_64(void) { return sim_now_us(); }
+uint32_t time_us_32(void) { return static_cast<uint32_t>(sim_now_us()); }
+void sleep_us(uint64_t us) { usleep(us); }
+void sleep_ms(uint32_t ms) { usleep(ms * 1000); }
+
+// ADC and DMA.  A channel reading the ADC FIFO is filled from the
+// detector model straight away but stays busy for as long as the real
+// ADC would take to convert the samples.  Other channels finish at once.
+//
+static const uint64_t ADC_SAMPLE_US = 2;
+static const uint NO_CHANNEL = ~0u;
+static uint adc_channel = NO_CHANNEL;
+static uint64_t dma_done_us = 0;
+
+void adc_run(bool run) { }
+int dma_claim_unused_channel(bool required) { static int next = 0; return next++; }
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+    const volatile void* read_addr, uint transfer_count, bool trigger)
+{
+    sim_dma_channels[channel].transfer_count = 0;
+    if (!trigger || (read_addr != &adc_hw->fifo))
+        return;
+
+    volatile uint16_t* samples = static_cast<volatile uint16_t*>(write_addr);
+    for (uint i = 0; i < transfer_count; ++i)
+        samples[i] = adc_model->sample(dds_model->get_frequency(), dds_model->get_enabled());
+    adc_channel = channel;
+    dma_done_us = sim_now_us() + transfer_count * ADC_SAMPLE_US;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    if (channel == adc_channel)
+        return sim_now_us() < dma_done_us;
+    return sim_dma_channels[channel].transfer_count != 0;
+}
+
+void dma_channel_abort(uint channel)
+{
+    if (channel == adc_channel)
+        dma_done_us = 0;
+    sim_dma_channels[channel].transfer_count = 0;
+}
+
+// Flash.  Erased flash reads as 0xff.  With --flash the contents are
+// loaded from a file at start-up and written back after every change.
+//
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+static std::string flash_path;
+
+static void save_flash()
+{
+    if (flash_path.empty())
+        return;
+    FILE* file = fopen(flash_path.c_str(), "wb");
+    if (!file)
+        return;
+    fwrite(sim_flash, 1, sizeof(sim_flash), file);
+    fclose(file);
+}
+
+static void load_flash()
+{
+    memset(sim_flash, 0xff, sizeof(sim_flash));
+    FILE* file = flash_path.empty() ? nullptr : fopen(flash_path.c_str(), "rb");
+    if (!file)
+        return;
+    size_t length = fread(sim_flash, 1, sizeof(sim_flash), file);
+    (void)length;
+    fclose(file);
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    memset(sim_flash + flash_offs, 0xff, count);
+    save_flash();
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        sim_flash[flash_offs + i] &= data[i];
+    save_flash();
+}
+
+// Interrupt mask.  Simulated interrupts run holding the same lock.
+//
+static std::recursive_mutex interrupt_mutex;
+
+uint32_t save_and_disable_interrupts(void)
+{
+    interrupt_mutex.lock();
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) { interrupt_mutex.unlock(); }
+
+// Event register used by __sev/__wfe.
+//
+static std::mutex event_mutex;
+static std::condition_variable event_signal;
+static bool event_flag = false;
+
+void __sev(void)
+{
+    std::lock_guard<std::mutex> lock(event_mutex);
+    event_flag = true;
+    event_signal.notify_all();
+}
+
+void __wfe(void)
+{
+    std::unique_lock<std::mutex> lock(event_mutex);
+    event_signal.wait_for(lock, std::chrono::milliseconds(10), [] { return event_flag; });
+    event_flag = false;
+}
+
+void __wfi(void)
+{
+    __wfe();
+}
+
+// Alarms.  Each runs on a thread of its own, and calls back holding the
+// interrupt lock like the other simulated interrupts.  The callback's
+// return value reschedules it as in the SDK: negative from when it was
+// due, positive from when it returned, 0 not at all.
+//
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void* user_data, bool fire_if_past)
+{
+    static alarm_id_t next_id = 1;
+    alarm_id_t id = next_id++;
+    std::thread([=] {
+        uint64_t due_us = sim_now_us() + us;
+        while (running)
+        {
+            uint64_t now_us = sim_now_us();
+            if (due_us > now_us)
+                usleep(due_us - now_us);
+
+            int64_t next;
+            {
+                std::lock_guard<std::recursive_mutex> lock(interrupt_mutex);
+                next = callback(id, user_data);
+            }
+            if (next == 0)
+                break;
+            due_us = (next < 0) ? due_us - next : sim_now_us() + next;
+        }
+    }).detach();
+    return id;
+}
+
+/**
+ * @brief  Alarm callback, as in pico-siggen.cpp.
+ */
+static int64_t alarm_callback(alarm_id_t id, void* user_data)
+{
+    CommandHandler::push_tick(user_data);
+    return -static_cast<int64_t>(CommandHandler::PUSH_TICK_US);
+}
+
+using DDS = AD9850Fixed<W_CLK, FQ_UD, DATA, RESET>;
+
+/**
+ * @brief  Word writer, as in pico-siggen.cpp.
+ */
+static void write_dds_word(uint64_t word, uint32_t marker_mask)
+{
+    DDS::write_word(word, marker_mask);
+}
+
+/**
+ * @brief  Signal handler used to leave the main loop.
+ */
+static void stop(int signal)
+{
+    running = 0;
+}
+
+/**
+ * @brief  Print the command line options.
+ */
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -l, --link PATH         create a symlink to the pty at PATH\n"
+        "  -U, --uart-link PATH    create a symlink to the UART channel pty at PATH\n"
+        "  -o, --osc-hz HZ         DDS reference clock (default %u)\n"
+        "  -r, --rate BYTES        limit each direction to BYTES per second\n"
+        "  -t, --latency-us US     delay each direction by US microseconds\n"
+        "  -u, --usb-cdc           emulate USB CDC limits (1 MB/s, 1 ms)\n"
+        "  -F, --flash PATH        keep the simulated flash in a file\n"
+        "  -f, --dut-hz HZ         network analyzer filter center (default 10.7 MHz)\n"
+        "  -Q, --dut-q Q           network analyzer filter Q (default 5)\n"
+        "  -q, --quiet             don't report DDS updates\n",
+        name, AD9850::OSC_HZ);
+}
+
+/**
+ * @brief  Main method
+ */
+int main(int argc, char* argv[])
+{
+    static const struct option options[] = {
+        { "link",       required_argument, nullptr, 'l' },
+        { "uart-link",  required_argument, nullptr, 'U' },
+        { "osc-hz",     required_argument, nullptr, 'o' },
+        { "rate",       required_argument, nullptr, 'r' },
+        { "latency-us", required_argument, nullptr, 't' },
+        { "usb-cdc",    no_argument,       nullptr, 'u' },
+        { "flash",      required_argument, nullptr, 'F' },
+        { "dut-hz",     required_argument, nullptr, 'f' },
+        { "dut-q",      required_argument, nullptr, 'Q' },
+        { "quiet",      no_argument,       nullptr, 'q' },
+        { "help",       no_argument,       nullptr, 'h' },
+        { nullptr,      0,                 nullptr, 0   },
+    };
+
+    std::string link_path;
+    std::string uart_link_path;
+    uint32_t osc_hz = AD9850::OSC_HZ;
+    link_limits_t limits;
+    bool quiet = false;
+    double dut_hz = 10.7e6;
+    double dut_q = 5.0;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "l:U:o:r:t:uF:f:Q:qh", options, nullptr)) != -1)
+    {
+        switch (option)
+        {
+            case 'l': link_path = optarg; break;
+            case 'U': uart_link_path = optarg; break;
+            case 'o': osc_hz = strtoul(optarg, nullptr, 10); break;
+            case 'r': limits.bytes_per_sec = strtoull(optarg, nullptr, 10); break;
+            case 't': limits.latency_us = strtoull(optarg, nullptr, 10); break;
+            case 'u':
+                limits.bytes_per_sec = 1000000;
+                limits.latency_us = 1000;
+                break;
+            case 'F': flash_path = optarg; break;
+            case 'f': dut_hz = strtod(optarg, nullptr); break;
+            case 'Q': dut_q = strtod(optarg, nullptr); break;
+            case 'q': quiet = true; break;
+            default:
+                usage(argv[0]);
+                return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    // Bring up the simulated hardware.  Everything the firmware prints
+    // goes to the pty from here on, so diagnostics go to stderr.
+    //
+    load_flash();
+
+    DdsModel model(osc_hz, W_CLK, FQ_UD, DATA, RESET, quiet ? nullptr : stderr);
+    model.attach_marker(MARKER);
+    dds_model = &model;
+
+    AdcModel detector(dut_hz, dut_q);
+    adc_model = &detector;
+
+    PtyLink link(limits);
+    if (!link.open(link_path))
+    {
+        perror("siggen-sim: unable to create pty");
+        return 1;
+    }
+    pty_link = &link;
+    fprintf(stderr, "siggen-sim: listening on %s\n",
+        link_path.empty() ? link.slave_name().c_str() : link_path.c_str());
+
+    // The UART channel gets a pty of its own.  The link limits apply
+    // to the USB channel only; the UART link holds what its receive
+    // ring would.
+    //
+    PtyLink uart_link(link_limits_t { 0, 0, UART_RX_RING_LEN });
+    if (!uart_link.open(uart_link_path))
+    {
+        perror("siggen-sim: unable to create UART pty");
+        return 1;
+    }
+    fprintf(stderr, "siggen-sim: UART channel on %s\n",
+        uart_link_path.empty() ? uart_link.slave_name().c_str() : uart_link_path.c_str());
+
+    if (!link.start())
+    {
+        perror("siggen-sim: unable to redirect stdout");
+        return 1;
+    }
+
+    PtyChannel uart_channel(uart_link);
+    if (!uart_channel.start())
+    {
+        perror("siggen-sim: unable to start UART channel");
+        return 1;
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    // From here on this mirrors main() in pico-siggen.cpp.
+    //
+    stdio_init_all();
+    Telemetry::start_cycle_counter();
+    telemetry.reset();
+
+    DDS dds(osc_hz, write_dds_word);
+    dds.attach_marker(MARKER);
+    dds.set_frequency(1000);
+    dds.commit();
+
+    CommitTrigger trigger(pio0, TRIGGER, FQ_UD, MARKER);
+
+    AdcCapture adc(ADC_INPUT);
+    NetworkAnalyzer analyzer(dds, adc);
+
+    StdioChannel usb_channel;
+
+    CommandProcessor command_processor(usb_channel);
+    CommandProcessor uart_processor(uart_channel);
+    Sequencer sequencer(dds, trigger);
+    sequencer.restore();
+    FrequencyTable table(dds);
+    Dither dither(dds);
+    QuadratureEncoder encoder(pio0, ENCODER_A);
+    LockTimer lock_timer(dds, pio0, LOCK_INPUT, FQ_UD);
+    PulsedOutput pulsed_output(dds, pio1, W_CLK, FQ_UD, DATA, PULSE_GATE);
+
+    CommandHandler command_handler(dds, trigger, analyzer, sequencer, table, dither, encoder, lock_timer,
+        pulsed_output);
+    command_handler.attach(command_processor);
+    command_handler.attach(uart_processor);
+    add_alarm_in_us(CommandHandler::PUSH_TICK_US, alarm_callback, &command_handler, false);
+    command_handler.autorun();
+
+    while (running)
+    {
+        telemetry.count_loop();
+        command_processor.loop();
+        uart_processor.loop();
+        command_handler.loop();
+
+        bool idle = true;
+        if (command_processor.command_is_available())
+        {
+            command_handler.process(command_processor);
+            idle = false;
+        }
+        if (uart_processor.command_is_available())
+        {
+            command_handler.process(uart_processor);
+            idle = false;
+        }
+        if (idle && uart_processor.is_idle())
+        {
+            command_processor.wait_for_input();
+        }
+    }
+
+    fprintf(stderr, "siggen-sim: %llu bytes in, %llu bytes out, %llu DDS updates\n",
+        static_cast<unsigned long long>(link.rx_bytes() + uart_link.rx_bytes()),
+        static_cast<unsigned long long>(link.tx_bytes() + uart_link.tx_bytes()),
+        static_cast<unsigned long long>(model.get_update_count()));
+    return 0;
+}
@@ -0,0 +1,458 @@
+// Frequency table benchmark.
+//
+// Builds tables of tuning words the way python/siggen-table does, checks
+// that FrequencyTable decodes them back exactly, streaming and from
+// random seeks, and times decoding alone and decoding into the AD9850
+// update path with the GPIO writes going nowhere.  A table and its words
+// written by siggen-table can be checked the same way.
+//
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "pico/stdlib.h"
+
+#include "AD9850.hpp"
+#include "frequency_table.hpp"
+
+// The AD9850 driver's GPIO writes are counted and dropped.
+//
+static uint64_t gpio_writes = 0;
+
+void gpio_init(uint gpio) { }
+void gpio_set_dir(uint gpio, bool out) { }
+void gpio_put(uint gpio, bool value) { ++gpio_writes; }
+bool gpio_get(uint gpio) { return false; }
+void gpio_set_mask(uint32_t mask) { ++gpio_writes; }
+void gpio_clr_mask(uint32_t mask) { ++gpio_writes; }
+void gpio_xor_mask(uint32_t mask) { ++gpio_writes; }
+
+uint64_t time_us_64(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+uint32_t time_us_32(void) { return static_cast<uint32_t>(time_us_64()); }
+void sleep_us(uint64_t us) { }
+void sleep_ms(uint32_t ms) { }
+
+// Nothing interrupts the bench.
+//
+uint32_t save_and_disable_interrupts(void) { return 0; }
+void restore_interrupts(uint32_t status) { }
+
+namespace
+{
+    const uint32_t OSC_HZ = 125000000;
+    const size_t MAX_HOPS = 25000;
+    const char* const BASE64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    volatile uint64_t sink;             // Keeps results from being optimized away.
+
+    auto tuning_word(double frequency_hz) -> uint32_t
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(frequency_hz * 4294967296.0 / OSC_HZ));
+    }
+
+    /**
+     * @brief  Return the tuning word of point i of an n point linear
+     *         chirp, exactly.
+     */
+    auto chirp_word(uint64_t start_hz, uint64_t stop_hz, size_t i, size_t n) -> uint32_t
+    {
+        unsigned __int128 numerator = start_hz * (n - 1) + (stop_hz - start_hz) * i;
+        return static_cast<uint32_t>((numerator << 32) / (static_cast<unsigned __int128>(OSC_HZ) * (n - 1)));
+    }
+
+    template <typename T>
+    auto put(std::vector<uint8_t>& bytes, T value) -> void
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), data, data + sizeof(value));
+    }
+
+    /**
+     * @brief  Return the residuals of a block's words after a step with
+     *         a fraction, as the decoder works them out.
+     */
+    auto residuals(const uint32_t* block, size_t length, uint32_t step, uint32_t fraction, uint32_t start)
+        -> std::vector<int32_t>
+    {
+        std::vector<int32_t> left;
+        uint32_t carry = start;
+        for (size_t k = 1; k < length; ++k)
+        {
+            carry += fraction;
+            left.push_back(static_cast<int32_t>(block[k] - block[k - 1] - step - (carry >> 16)));
+            carry &= 0xffff;
+        }
+        return left;
+    }
+
+    auto width(const std::vector<int32_t>& left) -> uint32_t
+    {
+        int32_t low = left.empty() ? 0 : *std::min_element(left.begin(), left.end());
+        int32_t high = left.empty() ? 0 : *std::max_element(left.begin(), left.end());
+        if ((low == 0) && (high == 0))
+            return 0;
+        if ((low >= INT8_MIN) && (high <= INT8_MAX))
+            return 1;
+        if ((low >= INT16_MIN) && (high <= INT16_MAX))
+            return 2;
+        return 4;
+    }
+
+    /**
+     * @brief  Find a fraction start that puts every word of a block on a
+     *         line with a slope in 1/65536ths.
+     * @return false if there is none.
+     */
+    auto fit_line(const uint32_t* block, size_t length, int64_t slope, uint32_t& start) -> bool
+    {
+        int64_t step = slope >> 16;
+        int64_t fraction = slope & 0xffff;
+        int64_t low = 0;
+        int64_t high = 0x10000;
+        for (size_t k = 1; k < length; ++k)
+        {
+            int64_t whole = static_cast<int32_t>(block[k] - block[0]) - static_cast<int64_t>(k) * step;
+            low = std::max<int64_t>(low, whole * 0x10000 - static_cast<int64_t>(k) * fraction);
+            high = std::min<int64_t>(high, (whole + 1) * 0x10000 - static_cast<int64_t>(k) * fraction);
+            if (low >= high)
+                return false;
+        }
+        start = static_cast<uint32_t>(low);
+        return true;
+    }
+
+    /**
+     * @brief  Encode tuning words as a table, as python/siggen-table does:
+     *         a line through each block if one fits, otherwise the
+     *         median step and deltas.
+     */
+    auto encode(const std::vector<uint32_t>& words, uint32_t block_points) -> std::vector<uint8_t>
+    {
+        const int64_t SLOPE_SEARCH = 64;
+        uint32_t blocks = (words.size() + block_points - 1) / block_points;
+        std::vector<uint8_t> index;
+        std::vector<uint8_t> deltas;
+        uint32_t offset = 16 + blocks * 16;
+        for (uint32_t block = 0; block < blocks; ++block)
+        {
+            const uint32_t* first = &words[block * block_points];
+            size_t length = std::min<size_t>(block_points, words.size() - block * block_points);
+
+            uint32_t step = 0;
+            uint32_t fraction = 0;
+            uint32_t start = 0;
+            bool fitted = false;
+            if (length > 2)
+            {
+                double mean_k = (length - 1) / 2.0;
+                double mean_offset = 0;
+                for (size_t k = 0; k < length; ++k)
+                    mean_offset += static_cast<int32_t>(first[k] - first[0]);
+                mean_offset /= length;
+                double covariance = 0;
+                double variance = 0;
+                for (size_t k = 0; k < length; ++k)
+                {
+                    covariance += (k - mean_k) * (static_cast<int32_t>(first[k] - first[0]) - mean_offset);
+                    variance += (k - mean_k) * (k - mean_k);
+                }
+                int64_t slope = llround(65536.0 * covariance / variance);
+                for (int64_t distance = 0; !fitted && (distance <= SLOPE_SEARCH); ++distance)
+                {
+                    for (int64_t guess : { slope - distance, slope + distance })
+                    {
+                        if (!fitted && fit_line(first, length, guess, start))
+                        {
+                            step = static_cast<uint32_t>(guess >> 16);
+                            fraction = static_cast<uint32_t>(guess & 0xffff);
+                            fitted = true;
+                        }
+                    }
+                }
+            }
+
+            std::vector<int32_t> left;
+            if (fitted)
+            {
+                left.assign(length - 1, 0);
+            }
+            else
+            {
+                std::vector<int32_t> sorted;
+                for (size_t k = 1; k < length; ++k)
+                    sorted.push_back(static_cast<int32_t>(first[k] - first[k - 1]));
+                std::sort(sorted.begin(), sorted.end());
+                step = sorted.empty() ? 0 : static_cast<uint32_t>(sorted[sorted.size() / 2]);
+                left = residuals(first, length, step, 0, 0);
+            }
+            uint32_t delta_width = width(left);
+
+            while ((offset + deltas.size()) % 4)
+                deltas.push_back(0);
+            put<uint32_t>(index, first[0]);
+            put<uint32_t>(index, step);
+            put<uint16_t>(index, static_cast<uint16_t>(fraction));
+            put<uint16_t>(index, static_cast<uint16_t>(start));
+            put<uint32_t>(index, (offset + deltas.size()) | (delta_width << 24));
+            for (int32_t residual : left)
+            {
+                if (delta_width == 1)
+                    put<int8_t>(deltas, static_cast<int8_t>(residual));
+                else if (delta_width == 2)
+                    put<int16_t>(deltas, static_cast<int16_t>(residual));
+                else if (delta_width == 4)
+                    put<int32_t>(deltas, residual);
+            }
+        }
+
+        std::vector<uint8_t> table;
+        table.insert(table.end(), { 'S', 'G', 'F', 'T' });
+        put<uint16_t>(table, 1);
+        put<uint16_t>(table, static_cast<uint16_t>(block_points));
+        put<uint32_t>(table, static_cast<uint32_t>(words.size()));
+        put<uint32_t>(table, static_cast<uint32_t>(offset + deltas.size()));
+        table.insert(table.end(), index.begin(), index.end());
+        table.insert(table.end(), deltas.begin(), deltas.end());
+        return table;
+    }
+
+    auto base64(const std::vector<uint8_t>& bytes) -> std::string
+    {
+        std::string text;
+        for (size_t i = 0; i < bytes.size(); i += 3)
+        {
+            uint32_t group = bytes[i] << 16;
+            if (i + 1 < bytes.size())
+                group |= bytes[i + 1] << 8;
+            if (i + 2 < bytes.size())
+                group |= bytes[i + 2];
+            text += BASE64[(group >> 18) & 63];
+            text += BASE64[(group >> 12) & 63];
+            text += (i + 1 < bytes.size()) ? BASE64[(group >> 6) & 63] : '=';
+            text += (i + 2 < bytes.size()) ? BASE64[group & 63] : '=';
+        }
+        return text;
+    }
+
+    /**
+     * @brief  Load a table the way the command handler does, in
+     *         base64 pieces.
+     * @return An error message, or null.
+     */
+    auto load(FrequencyTable& table, const std::vector<uint8_t>& bytes) -> const char*
+    {
+        const size_t CHUNK_CHARS = 896;
+        std::string text = base64(bytes);
+        const char* error = nullptr;
+        for (size_t start = 0; !error && (start < text.size()); start += CHUNK_CHARS)
+            error = table.load(text.substr(start, CHUNK_CHARS).c_str(), start > 0);
+        return error;
+    }
+
+    /**
+     * @brief  Check that a table decodes to its words, streaming from the
+     *         start and from random points.
+     * @return The number of mismatches.
+     */
+    auto check(FrequencyTable& table, const std::vector<uint32_t>& words) -> size_t
+    {
+        size_t errors = 0;
+        table.seek(0);
+        for (size_t i = 0; i < words.size(); ++i)
+            errors += (table.next() != words[i]);
+
+        std::mt19937 random(1);
+        for (int seeks = 0; seeks < 1000; ++seeks)
+        {
+            uint32_t point = random() % words.size();
+            table.seek(point);
+            for (uint32_t i = 0; i < 300; ++i)
+                errors += (table.next() != words[(point + i) % words.size()]);
+        }
+        return errors;
+    }
+
+    /**
+     * @brief  Time a workload and return the time per point, in ns.
+     */
+    template<typename Work>
+    auto time_points(size_t points, Work work) -> double
+    {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(elapsed).count() / points;
+    }
+
+    /**
+     * @brief  Check and time one table.
+     * @return false if it doesn't round trip.
+     */
+    auto run(const char* label, FrequencyTable& table, AD9850& dds, const std::vector<uint8_t>& bytes,
+             const std::vector<uint32_t>& words, size_t passes) -> bool
+    {
+        const char* error = load(table, bytes);
+        if (error)
+        {
+            printf("%-14s load failed: %s\n", label, error);
+            return false;
+        }
+
+        size_t errors = check(table, words);
+        size_t points = words.size() * passes;
+        double decode_ns = time_points(points, [&] {
+            uint32_t total = 0;
+            table.seek(0);
+            for (size_t i = 0; i < points; ++i)
+                total += table.next();
+            sink = total;
+        });
+        double update_ns = time_points(points, [&] {
+            table.seek(0);
+            for (size_t i = 0; i < points; ++i)
+            {
+                dds.set_registers(table.next(), 0, true);
+                dds.commit();
+            }
+        });
+
+        printf("%-14s %8zu points %7zu bytes %6.3f B/pt  %s  decode %6.2f ns/pt  update %7.2f ns/pt\n",
+               label, words.size(), bytes.size(), static_cast<double>(bytes.size()) / words.size(),
+               errors ? "MISMATCH" : "ok", decode_ns, update_ns);
+        return errors == 0;
+    }
+
+    auto read_file(const char* path, std::vector<uint8_t>& bytes) -> bool
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file)
+            return false;
+        uint8_t buffer[4096];
+        size_t length;
+        while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            bytes.insert(bytes.end(), buffer, buffer + length);
+        fclose(file);
+        return true;
+    }
+
+    auto read_words(const char* path, std::vector<uint32_t>& words) -> bool
+    {
+        FILE* file = fopen(path, "r");
+        if (!file)
+            return false;
+        unsigned long word;
+        while (fscanf(file, "%lu", &word) == 1)
+            words.push_back(static_cast<uint32_t>(word));
+        fclose(file);
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t points = 100000;
+    size_t passes = 20;
+    uint32_t block_points = FrequencyTable::MAX_BLOCK_POINTS;
+    const char* table_path = nullptr;
+    const char* words_path = nullptr;
+
+    static const struct option long_options[] = {
+        { "points",       required_argument, nullptr, 'n' },
+        { "passes",       required_argument, nullptr, 'p' },
+        { "block-points", required_argument, nullptr, 'b' },
+        { "table",        required_argument, nullptr, 't' },
+        { "words",        required_argument, nullptr, 'w' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "n:p:b:t:w:", long_options, nullptr)) != -1)
+    {
+        switch (option)
+        {
+            case 'n': points = strtoul(optarg, nullptr, 0); break;
+            case 'p': passes = strtoul(optarg, nullptr, 0); break;
+            case 'b': block_points = strtoul(optarg, nullptr, 0); break;
+            case 't': table_path = optarg; break;
+            case 'w': words_path = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [--points N] [--passes N] [--block-points N] "
+                                "[--table FILE --words FILE]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if ((points < 2) || (block_points == 0) || (block_points > FrequencyTable::MAX_BLOCK_POINTS))
+    {
+        fprintf(stderr, "table-bench: need 2 or more points and 1 to %u points per block\n",
+                FrequencyTable::MAX_BLOCK_POINTS);
+        return 1;
+    }
+
+    AD9850Fixed<10, 11, 12, 13> dds(OSC_HZ);
+    FrequencyTable table_store(dds);
+    bool ok = true;
+
+    // A table from siggen-table, checked against the words it was made
+    // from.
+    //
+    if (table_path || words_path)
+    {
+        std::vector<uint8_t> bytes;
+        std::vector<uint32_t> words;
+        if (!table_path || !words_path || !read_file(table_path, bytes) || !read_words(words_path, words))
+        {
+            fprintf(stderr, "table-bench: can't read the table and words files\n");
+            return 1;
+        }
+        ok = run("file", table_store, dds, bytes, words, passes);
+        return ok ? 0 : 1;
+    }
+
+    // Synthetic tables: a linear chirp, a logarithmic chirp, and random
+    // hops, which don't compress, so fewer of them.
+    //
+    std::vector<uint32_t> linear(points);
+    std::vector<uint32_t> logarithmic(points);
+    std::vector<uint32_t> hops(std::min<size_t>(points, MAX_HOPS));
+    for (size_t i = 0; i < points; ++i)
+    {
+        double position = static_cast<double>(i) / (points - 1);
+        linear[i] = chirp_word(1000000, 10000000, i, points);
+        logarithmic[i] = tuning_word(1e3 * pow(1e4, position));
+    }
+    std::mt19937 random(2);
+    for (uint32_t& hop : hops)
+        hop = tuning_word(1e6 + (random() % 30000000));
+
+    const struct { const char* label; std::vector<uint32_t>& words; } cases[] = {
+        { "linear chirp", linear },
+        { "log chirp",    logarithmic },
+        { "random hops",  hops },
+    };
+    for (auto const& test : cases)
+    {
+        std::vector<uint8_t> bytes = encode(test.words, block_points);
+        if (bytes.size() > FrequencyTable::MAX_BYTES)
+        {
+            printf("%-14s %zu bytes is over the %zu byte store, skipped\n",
+                   test.label, bytes.size(), FrequencyTable::MAX_BYTES);
+            continue;
+        }
+        ok = run(test.label, table_store, dds, bytes, test.words, passes) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -2,14 +2,31 @@
 
 #include <pico/stdlib.h>
 #include <stdio.h>
+#include <hardware/sync.h>
 #include <map>
 #include <string>
+#include <utility>
+
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 // For information on the Raspberry Pi Pico GPIOs, see
 // https://raspberrypi.github.io/pico-sdk-doxygen/group__hardware__gpio.html
 //
+// Everything between a commit and its FQ_UD edge runs from RAM, so a
+// flash cache miss can't stretch the word as it is shifted in.
+//
 namespace
 {
+    // Marker output patterns.
+    //
+    enum class marker_mode_t {
+        off,                            // Never raise the marker.
+        every,                          // Every update.
+        start,                          // First update after restart_marker().
+        nth,                            // Every Nth update after restart_marker().
+    };
+
     class AD9850
     {
     public:
@@ -25,6 +42,24 @@ namespace
          * @param  reset   Master reset function.  Active hi.
          */
         AD9850(uint32_t osc_hz, uint w_clk, uint fq_ud, uint data, uint reset)
+            : AD9850(osc_hz, w_clk, fq_ud, data, reset, nullptr)
+        {
+        }
+
+    protected:
+
+        // Function that shifts a 40-bit word into the DDS, LSB first,
+        // leaving FQ_UD alone and dropping the marker first.
+        //
+        using word_writer_t = void (*)(uint64_t word, uint32_t marker_mask);
+
+        /**
+         * @brief  Constructor for drivers with their own word writer.
+         * @param  writer  Word writer, or null to bit-bang through the
+         *                 runtime pin numbers.
+         * @note   See the public constructor for the other parameters.
+         */
+        AD9850(uint32_t osc_hz, uint w_clk, uint fq_ud, uint data, uint reset, word_writer_t writer)
             : osc_hz_(osc_hz)
             , w_clk_(w_clk)
             , fq_ud_(fq_ud)
@@ -38,6 +73,7 @@ namespace
             , enable_out_t_(enable_out_)            
             , frequency_register_(0x00)
             , phase_register_(0x00)
+            , word_writer_(writer)
         {
             // Initialize the GPIO to communicate with the chip.
             //
@@ -58,6 +94,8 @@ namespace
             program_dds(frequency_register_, phase_register_, enable_out_);
         }
 
+    public:
+
         /**
          * @brief  Set the sig gen frequency.
          * @param  frequency  Signal generator frequency, in Hz.
@@ -66,6 +104,7 @@ namespace
         auto set_frequency(uint32_t frequency) -> void
         {
             frequency_hz_t_ = frequency;            
+            frequency_staged_ = false;
         }
 
         /**
@@ -79,6 +118,97 @@ namespace
         auto set_phase(uint32_t phase) -> void
         {
             phase_deg_t_ = phase;
+            phase_staged_ = false;
+        }
+
+        /**
+         * @brief  Move the sig gen frequency by an offset.  The result is
+         *         held between 0 and half the reference clock.
+         * @param  offset  Offset from the pending frequency, in Hz.
+         * @note   Does not take effect until the commit method is called.
+         */
+        auto offset_frequency(int32_t offset) -> void
+        {
+            int64_t frequency = static_cast<int64_t>(frequency_hz_t_) + offset;
+            int64_t highest = osc_hz_ / 2;
+            set_frequency(static_cast<uint32_t>((frequency < 0) ? 0 : (frequency > highest) ? highest : frequency));
+        }
+
+        /**
+         * @brief  Move the sig gen phase by an offset, wrapping at 360 deg.
+         * @param  offset  Offset from the pending phase, in .01 deg
+         *                 increments.  The pending phase keeps the
+         *                 requested value, so small offsets add up even
+         *                 though the DDS rounds each one to 11.25 deg.
+         * @note   Does not take effect until the commit method is called.
+         */
+        auto offset_phase(int32_t offset) -> void
+        {
+            int64_t phase = (static_cast<int64_t>(phase_deg_t_) + offset) % PHASE_FULL;
+            set_phase(static_cast<uint32_t>((phase < 0) ? phase + PHASE_FULL : phase));
+        }
+
+        /**
+         * @brief  Set the pending state from register values worked out
+         *         in advance with tuning_word() and phase_word(), so the
+         *         commit doesn't have to calculate them.
+         * @param  frequency_register  Frequency tuning word.
+         * @param  phase_register      Phase register, 0-31.
+         * @param  enable              Enable output if true.
+         * @note   Does not take effect until the commit method is called.
+         */
+        auto set_registers(uint32_t frequency_register, uint32_t phase_register, bool enable) -> void
+        {
+            staged_frequency_register_ = frequency_register;
+            staged_phase_register_ = phase_register;
+            frequency_staged_ = true;
+            phase_staged_ = true;
+
+            frequency_hz_t_ = register_frequency(frequency_register);
+            phase_deg_t_ = phase_register * PHASE_INC;
+            enable_out_t_ = enable;
+        }
+
+        /**
+         * @brief  Return the frequency tuning word for a frequency.
+         * @param  frequency  Frequency, in Hz.
+         */
+        auto tuning_word(uint32_t frequency) -> uint32_t
+        {
+            return calculate_frequency_register(osc_hz_, frequency);
+        }
+
+        /**
+         * @brief  Return the frequency a tuning word gives, to the
+         *         nearest Hz.
+         */
+        auto register_frequency(uint32_t frequency_register) -> uint32_t
+        {
+            return static_cast<uint32_t>(
+                (static_cast<uint64_t>(frequency_register) * osc_hz_ + (1ull << 31)) >> 32);
+        }
+
+        /**
+         * @brief  Return the phase register value for a phase.
+         * @param  phase  Phase, in .01 deg increments.
+         */
+        auto phase_word(uint32_t phase) -> uint32_t
+        {
+            return calculate_phase_register(phase);
+        }
+
+        /**
+         * @brief  Return the 40-bit word that loads a state, as shifted
+         *         in LSB first.
+         * @param  frequency_register  Frequency portion of the word.
+         * @param  phase_register      Phase portion of the word.
+         * @param  enable_out          Output powered up if true.
+         */
+        static __force_inline auto data_word(uint32_t frequency_register, uint32_t phase_register, bool enable_out) -> uint64_t
+        {
+            return frequency_register |
+                (static_cast<uint64_t>(enable_out ? POWER_UP : POWER_DOWN) << 34) |
+                (static_cast<uint64_t>(phase_register & (PHASE_MAX - 1)) << 35);
         }
 
         /**
@@ -115,24 +245,232 @@ namespace
             return enable_out_;
         }
 
+        /**
+         * @brief  Return the frequency tuning word in use.
+         */
+        auto get_frequency_register() -> uint32_t
+        {
+            return frequency_register_;
+        }
+
+        /**
+         * @brief  Return the phase register value in use.
+         */
+        auto get_phase_register() -> uint32_t
+        {
+            return phase_register_;
+        }
+
         /**
          * @brief  Program the DDS with the current state values.
          */
-        auto commit() -> void
+        auto __not_in_flash_func(commit)() -> void
         {
             // The DDS only does phase in increments of 22.5 deg. so the
             // actual phase may not correspond to the requested phase.  This
             // is taken into account when calculating the phase register.
             // 
-            frequency_register_ = calculate_frequency_register(osc_hz_, frequency_hz_t_);
+            frequency_register_ = frequency_staged_ ? staged_frequency_register_
+                : calculate_frequency_register(osc_hz_, frequency_hz_t_);
             frequency_hz_ = frequency_hz_t_;
 
-            phase_register_ = calculate_phase_register(phase_deg_t_);
+            phase_register_ = phase_staged_ ? staged_phase_register_
+                : calculate_phase_register(phase_deg_t_);
             phase_deg_ = phase_register_ * PHASE_INC;
 
             enable_out_ = enable_out_t_;
 
-            program_dds(frequency_register_, phase_register_, enable_out_);
+            program_dds(frequency_register_, phase_register_, enable_out_, next_update_marked());
+            telemetry.count_commit();
+        }
+
+        /**
+         * @brief  Power the output down straight away, keeping the
+         *         committed frequency and phase.
+         * @note   Pending changes other than the enable are kept, but the
+         *         output stays off until it is enabled again.
+         */
+        auto power_down() -> void
+        {
+            enable_out_ = false;
+            enable_out_t_ = false;
+            program_dds(frequency_register_, phase_register_, false);
+        }
+
+        /**
+         * @brief  Attach a marker output.  The marker rises in the same
+         *         GPIO write as FQ_UD on the updates selected by the
+         *         marker mode, and falls when the next word starts
+         *         shifting in.
+         * @param  marker  Marker GPIO.
+         */
+        auto attach_marker(uint marker) -> void
+        {
+            gpio_init(marker);
+            gpio_set_dir(marker, GPIO_OUT);
+            gpio_put(marker, GPIO_LO);
+            marker_mask_ = 1u << marker;
+        }
+
+        /**
+         * @brief  Select which updates raise the marker.
+         * @param  mode  Marker pattern.
+         * @param  n     Step interval for marker_mode_t::nth.
+         */
+        auto set_marker_mode(marker_mode_t mode, uint32_t n = 1) -> void
+        {
+            marker_mode_ = mode;
+            marker_n_ = (n > 0) ? n : 1;
+            marker_step_ = 0;
+        }
+
+        /**
+         * @brief  Return the marker pattern.
+         */
+        auto get_marker_mode() -> marker_mode_t
+        {
+            return marker_mode_;
+        }
+
+        /**
+         * @brief  Return the marker step interval.
+         */
+        auto get_marker_n() -> uint32_t
+        {
+            return marker_n_;
+        }
+
+        /**
+         * @brief  Mark the start of a sweep.  The next update is step
+         *         zero of the marker pattern.
+         */
+        auto restart_marker() -> void
+        {
+            marker_step_ = 0;
+        }
+
+        /**
+         * @brief  Shift the pending state into the DDS input register
+         *         without updating the output.
+         * @note   The output changes on the next FQ_UD edge, from fire()
+         *         or generated by the caller, who then calls
+         *         apply_preload().
+         */
+        auto preload() -> void
+        {
+            uint32_t frequency_register = frequency_staged_ ? staged_frequency_register_
+                : calculate_frequency_register(osc_hz_, frequency_hz_t_);
+            uint32_t phase_register = phase_staged_ ? staged_phase_register_
+                : calculate_phase_register(phase_deg_t_);
+
+            preload_word(frequency_register, frequency_hz_t_, phase_register, enable_out_t_);
+        }
+
+        /**
+         * @brief  Shift a state into the DDS input register without
+         *         updating the output or the pending state, so the next
+         *         state can be loaded ahead of time and put out by fire().
+         * @param  frequency_register  Frequency tuning word.
+         * @param  phase_register      Phase register, 0-31.
+         * @param  enable              Enable output if true.
+         * @note   A commit() or power_down() before the fire() overwrites
+         *         the input register, and the preload is dropped.
+         */
+        auto preload(uint32_t frequency_register, uint32_t phase_register, bool enable) -> void
+        {
+            preload_word(frequency_register, register_frequency(frequency_register), phase_register, enable);
+        }
+
+        /**
+         * @brief  Put the preloaded state out with a single FQ_UD pulse.
+         *         The word is already in the input register, so the
+         *         update follows the call by only a couple of SIO writes.
+         * @return false, and nothing is done, if nothing is preloaded.
+         */
+        auto __not_in_flash_func(fire)() -> bool
+        {
+            if (!preloaded_)
+                return false;
+
+            uint32_t fq_ud_mask = 1u << fq_ud_;
+            gpio_set_mask(fq_ud_mask | (preload_marked() ? marker_mask_ : 0));
+            gpio_clr_mask(fq_ud_mask);
+            TRACE_EVENT(fire, preload_frequency_register_);
+            apply_preload();
+            telemetry.count_commit();
+            return true;
+        }
+
+        /**
+         * @brief  Return true if a state is waiting in the input register.
+         */
+        auto is_preloaded() -> bool
+        {
+            return preloaded_;
+        }
+
+        /**
+         * @brief  Return the frequency waiting in the input register, in
+         *         Hz.  Only meaningful while is_preloaded().
+         */
+        auto get_preloaded_frequency() -> uint32_t
+        {
+            return preload_frequency_hz_;
+        }
+
+        /**
+         * @brief  Return true if the marker should rise with the
+         *         preloaded word.
+         */
+        auto preload_marked() -> bool
+        {
+            return preload_marked_ && (marker_mask_ != 0);
+        }
+
+        /**
+         * @brief  Record that an FQ_UD edge has moved the preloaded word
+         *         to the output.  The pending state follows, as it does
+         *         after a commit, and the marker pattern advances.
+         */
+        auto apply_preload() -> void
+        {
+            frequency_register_ = preload_frequency_register_;
+            frequency_hz_ = preload_frequency_hz_;
+
+            phase_register_ = preload_phase_register_;
+            phase_deg_ = phase_register_ * PHASE_INC;
+
+            enable_out_ = preload_enable_out_;
+            preloaded_ = false;
+            ++marker_step_;
+
+            staged_frequency_register_ = frequency_register_;
+            staged_phase_register_ = phase_register_;
+            frequency_staged_ = true;
+            phase_staged_ = true;
+            frequency_hz_t_ = frequency_hz_;
+            phase_deg_t_ = phase_deg_;
+            enable_out_t_ = enable_out_;
+        }
+
+        /**
+         * @brief  Turn the critical section around each commit on or off.
+         *         When on, interrupts are held off from the start of the
+         *         word to the FQ_UD pulse, so a USB or timer interrupt
+         *         can't land in the middle of it; they are taken late
+         *         instead, by at most one word.
+         */
+        auto set_critical_commit(bool critical) -> void
+        {
+            critical_commit_ = critical;
+        }
+
+        /**
+         * @brief  Return true if commits run with interrupts off.
+         */
+        auto get_critical_commit() -> bool
+        {
+            return critical_commit_;
         }
 
         static const uint32_t OSC_HZ = 125000000;
@@ -184,16 +522,113 @@ namespace
             return quotient % PHASE_MAX;
         }
 
+        /**
+         * @brief  Shift a word into the input register and record it as
+         *         preloaded.
+         */
+        auto preload_word(
+            uint32_t frequency_register,
+            uint32_t frequency_hz,
+            uint32_t phase_register,
+            bool enable_out) -> void
+        {
+            preload_frequency_register_ = frequency_register;
+            preload_frequency_hz_ = frequency_hz;
+            preload_phase_register_ = phase_register;
+            preload_enable_out_ = enable_out;
+            preload_marked_ = update_marked();
+
+            shift_word(frequency_register, phase_register, enable_out);
+            preloaded_ = true;
+            TRACE_EVENT(preload, frequency_register);
+        }
+
+        /**
+         * @brief  Decide whether the next update raises the marker,
+         *         without advancing the marker pattern.  A preload is
+         *         only counted once it is fired.
+         */
+        auto __not_in_flash_func(update_marked)() -> bool
+        {
+            switch (marker_mode_)
+            {
+                case marker_mode_t::every: return true;
+                case marker_mode_t::start: return marker_step_ == 0;
+                case marker_mode_t::nth:   return (marker_step_ % marker_n_) == 0;
+                default:                   return false;
+            }
+        }
+
+        /**
+         * @brief  Decide whether the next update raises the marker, and
+         *         advance the marker pattern.
+         */
+        auto __not_in_flash_func(next_update_marked)() -> bool
+        {
+            bool marked = update_marked();
+            ++marker_step_;
+            return marked;
+        }
+
         /**
          * @brief  Send the frequency, phase, and enabled values to the DDS.
          * @param  frequency_register  Frequency portion of the word to be sent to the DDS.
          * @param  phase_register      Phase portion of the word to be sent to the DDS.
+         * @param  marked              Raise the marker with this update.
          */
-        auto program_dds(
+        auto __not_in_flash_func(program_dds)(
+            uint32_t frequency_register,
+            uint32_t phase_register,
+            bool enable_out,
+            bool marked = false) -> void
+        {
+            TRACE_EVENT(program_begin, frequency_register);
+            uint32_t fq_ud_mask = 1u << fq_ud_;
+            uint32_t update_mask = fq_ud_mask | (marked ? marker_mask_ : 0);
+
+            // The timing runs from the first bit to the FQ_UD edge, which
+            // is the window the critical section covers.
+            //
+            uint32_t status = critical_commit_ ? save_and_disable_interrupts() : 0;
+            uint32_t start = Telemetry::cycles();
+            shift_word(frequency_register, phase_register, enable_out);
+
+            // Pulse the frequency update pin to load the frequency.  The
+            // marker rises in the same SIO write so there is no skew
+            // between the two.
+            //
+            gpio_set_mask(update_mask);
+            uint32_t cycles = Telemetry::cycles_since(start);
+            gpio_clr_mask(fq_ud_mask);
+            if (critical_commit_)
+                restore_interrupts(status);
+
+            preloaded_ = false;
+            TRACE_EVENT(fq_ud, frequency_register);
+            telemetry.count_program(cycles);
+        }
+
+        /**
+         * @brief  Shift the frequency, phase, and enabled values into the
+         *         DDS input register.
+         * @param  frequency_register  Frequency portion of the word to be sent to the DDS.
+         * @param  phase_register      Phase portion of the word to be sent to the DDS.
+         */
+        auto __not_in_flash_func(shift_word)(
             uint32_t frequency_register,
             uint32_t phase_register,
             bool enable_out) -> void
         {
+            if (word_writer_)
+            {
+                word_writer_(data_word(frequency_register, phase_register, enable_out), marker_mask_);
+                return;
+            }
+
+            // Drop the marker from the previous update.
+            //
+            gpio_clr_mask(marker_mask_);
+
             // First the frequency register.
             // Word is 32 bits, sent LSB first.
             //
@@ -231,17 +666,13 @@ namespace
                 write_data(data_, bit_value);
                 pulse(w_clk_);
             }
-
-            // Pulse the frequency update pin to load the frequency.
-            //
-            pulse(fq_ud_);
         }
         
         /**
          * @brief  Pulse the given pin.
          * @param  pin  GPIO to pulse
          */
-        auto pulse(uint pin) -> void
+        __force_inline auto pulse(uint pin) -> void
         {
             gpio_put(pin, GPIO_HI);
             gpio_put(pin, GPIO_LO);
@@ -252,7 +683,7 @@ namespace
          * @param  pin    Pin to where the data is to be written.
          * @param  level  Level to write to the pin.
          */
-        auto write_data(uint pin, uint level) -> void
+        __force_inline auto write_data(uint pin, uint level) -> void
         {
             gpio_put(pin, level);
         }
@@ -267,6 +698,7 @@ namespace
 
         static const uint PHASE_INC = 1125;
         static const uint PHASE_MAX = 32;
+        static const int64_t PHASE_FULL = 36000;    // 360 deg, in .01 deg.
 
         uint32_t osc_hz_;               // See constructor for these value definitions.
         uint w_clk_;
@@ -284,5 +716,94 @@ namespace
 
         uint32_t frequency_register_;
         uint32_t phase_register_;
+
+        uint32_t staged_frequency_register_ = 0;    // Registers from set_registers().
+        uint32_t staged_phase_register_ = 0;
+        bool frequency_staged_ = false;
+        bool phase_staged_ = false;
+
+        word_writer_t word_writer_;     // Word writer, or null to bit-bang.
+        bool critical_commit_ = false;  // Interrupts off for the shift and FQ_UD.
+
+        uint32_t preload_frequency_hz_ = 0;     // Word waiting in the input register.
+        uint32_t preload_frequency_register_ = 0;
+        uint32_t preload_phase_register_ = 0;
+        bool preload_enable_out_ = false;
+        bool preload_marked_ = false;
+        bool preloaded_ = false;        // Input register holds a word not yet live.
+
+        uint32_t marker_mask_ = 0;      // Marker GPIO, or zero if none.
+        marker_mode_t marker_mode_ = marker_mode_t::off;
+        uint32_t marker_n_ = 1;
+        uint32_t marker_step_ = 0;      // Updates since the marker pattern restarted.
+    };
+
+    // AD9850 with its pins fixed at compile time.  The pin masks are
+    // constants, so the 40-bit load is fully unrolled with two SIO writes
+    // per bit: one drops W_CLK and changes DATA together (by toggling
+    // only the pins that change), the next raises W_CLK.  DATA changes
+    // on the falling edge, which keeps it clear of the setup and hold
+    // times around the rising edge the AD9850 samples on.
+    //
+    // GCC ignores section attributes on members of class templates, so
+    // the writer can't be put in RAM here.  It is always inlined instead,
+    // and a plain function wrapping it can be marked __not_in_flash_func
+    // and passed to the constructor (see pico-siggen.cpp).
+    //
+    template <uint W_CLK, uint FQ_UD, uint DATA, uint RESET>
+    class AD9850Fixed : public AD9850
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  osc_hz  Oscillator frequency, in Hz.
+         * @param  writer  Word writer wrapping write_word(), or the
+         *                 default to call it as it is.
+         */
+        explicit AD9850Fixed(uint32_t osc_hz, word_writer_t writer = &write_word)
+            : AD9850(osc_hz, W_CLK, FQ_UD, DATA, RESET, writer)
+        {
+        }
+
+        /**
+         * @brief  Shift a word into the DDS input register.
+         * @param  word         40-bit word, sent LSB first.
+         * @param  marker_mask  Marker to drop, or zero.
+         */
+        static __force_inline auto write_word(uint64_t word, uint32_t marker_mask) -> void
+        {
+            // Start from W_CLK and DATA low.  Bit N of changes is set where
+            // bit N of the word differs from the bit before it.
+            //
+            gpio_clr_mask(marker_mask | W_CLK_MASK | DATA_MASK);
+            uint64_t changes = word ^ (word << 1);
+            write_bits(changes, std::make_index_sequence<WORD_BITS>{ });
+        }
+
+    private:
+        static constexpr uint32_t W_CLK_MASK = 1u << W_CLK;
+        static constexpr uint32_t DATA_MASK = 1u << DATA;
+        static constexpr size_t WORD_BITS = 40;
+
+        /**
+         * @brief  Clock out every bit.  Expands to one write_bit per bit.
+         */
+        template <size_t... BIT>
+        static __force_inline auto write_bits(uint64_t changes, std::index_sequence<BIT...>) -> void
+        {
+            (write_bit<BIT>(changes), ...);
+        }
+
+        /**
+         * @brief  Clock out one bit.
+         * @param  changes  See write_word().
+         */
+        template <size_t BIT>
+        static __force_inline auto write_bit(uint64_t changes) -> void
+        {
+            uint32_t data_mask = (0u - static_cast<uint32_t>((changes >> BIT) & 1)) & DATA_MASK;
+            gpio_xor_mask(((BIT > 0) ? W_CLK_MASK : 0) | data_mask);
+            gpio_set_mask(W_CLK_MASK);
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+
+// Block capture from one ADC input.  The ADC free-runs at its full 500
+// ksps into its FIFO and a DMA channel paced by the FIFO moves the
+// samples into memory, so the core is free while a block is taken.
+//
+namespace
+{
+    class AdcCapture
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  input  ADC input, 0-3 (GPIO 26-29).
+         */
+        AdcCapture(uint input)
+            : input_(input)
+        {
+            adc_init();
+            adc_gpio_init(FIRST_ADC_GPIO + input_);
+            adc_select_input(input_);
+
+            // FIFO on, a DMA request for every sample, no error bit and
+            // full 12-bit samples.  A zero divider runs the ADC back to
+            // back at 96 cycles of the 48 MHz ADC clock per sample.
+            //
+            adc_fifo_setup(true, true, 1, false, false);
+            adc_set_clkdiv(0);
+
+            dma_channel_ = dma_claim_unused_channel(true);
+            config_ = dma_channel_get_default_config(dma_channel_);
+            channel_config_set_transfer_data_size(&config_, DMA_SIZE_16);
+            channel_config_set_read_increment(&config_, false);
+            channel_config_set_write_increment(&config_, true);
+            channel_config_set_dreq(&config_, DREQ_ADC);
+        }
+
+        /**
+         * @brief  Start capturing a block of samples.
+         * @param  buffer  Where the samples go.
+         * @param  count   Number of samples.
+         * @note   The FIFO is emptied first so every sample in the block
+         *         is taken after this call.
+         */
+        auto start(uint16_t* buffer, size_t count) -> void
+        {
+            adc_run(false);
+            adc_fifo_drain();
+            dma_channel_configure(dma_channel_, &config_, buffer, &adc_hw->fifo, count, true);
+            adc_run(true);
+        }
+
+        /**
+         * @brief  Return true while a block is being captured.  Stops the
+         *         ADC once the block is complete.
+         */
+        auto is_busy() -> bool
+        {
+            if (dma_channel_is_busy(dma_channel_))
+                return true;
+
+            adc_run(false);
+            return false;
+        }
+
+        /**
+         * @brief  Abandon a capture.
+         */
+        auto stop() -> void
+        {
+            adc_run(false);
+            dma_channel_abort(dma_channel_);
+            adc_fifo_drain();
+        }
+
+    private:
+        static const uint FIRST_ADC_GPIO = 26;
+
+        uint input_;                    // See constructor for these value definitions.
+
+        uint dma_channel_ = 0;
+        dma_channel_config config_;
+    };
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <iostream>
+
+#include "pico/stdlib.h"
+#include "pico/stdio_usb.h"
+
+// Command channels.  A channel is a byte stream that commands arrive on
+// and their responses go back out on.  Each CommandProcessor reads one
+// channel, and the command handler answers on the channel a command came
+// from.
+//
+// Binary blocks are sent on a channel after a response line announcing
+// their size.  CR/LF translation is off while a block is written so the
+// bytes go out unchanged.
+//
+namespace
+{
+    class CommandChannel
+    {
+    public:
+        virtual ~CommandChannel() = default;
+
+        /**
+         * @brief  Set the function called, in interrupt context, when
+         *         characters are waiting.
+         * @param  fn     Function to call.
+         * @param  param  Passed to fn.
+         */
+        virtual auto set_chars_available_callback(void (*fn)(void*), void* param) -> void = 0;
+
+        /**
+         * @brief  Take a received character without waiting.
+         * @return The character, or PICO_ERROR_TIMEOUT if there is none.
+         */
+        virtual auto read_char() -> int = 0;
+
+        /**
+         * @brief  Return the bytes lost since the last call because they
+         *         arrived with nowhere to go, and start counting again.
+         *         Channels that hold the sender back never lose any.
+         * @param  position  Set, if any were lost, to the number of bytes
+         *                   received before the first of them.
+         */
+        virtual auto take_overrun(uint32_t& position) -> uint32_t
+        {
+            return 0;
+        }
+
+        /**
+         * @brief  Return the stream responses are written to.
+         */
+        virtual auto out() -> std::ostream& = 0;
+
+        /**
+         * @brief  Start a binary block.  Flushes any pending text first.
+         */
+        virtual auto begin_binary_block() -> void = 0;
+
+        /**
+         * @brief  Finish a binary block and go back to text.
+         */
+        virtual auto end_binary_block() -> void = 0;
+
+        /**
+         * @brief  Write part of a binary block.
+         * @param  data    Bytes to write.
+         * @param  length  Number of bytes.
+         */
+        auto write_binary(const void* data, size_t length) -> void
+        {
+            out().write(static_cast<const char*>(data), length);
+        }
+    };
+
+    // The stdio channel, which is USB CDC.
+    //
+    class StdioChannel : public CommandChannel
+    {
+    public:
+        auto set_chars_available_callback(void (*fn)(void*), void* param) -> void override
+        {
+            stdio_set_chars_available_callback(fn, param);
+        }
+
+        auto read_char() -> int override
+        {
+            return stdio_getchar_timeout_us(0);
+        }
+
+        auto out() -> std::ostream& override
+        {
+            return std::cout;
+        }
+
+        auto begin_binary_block() -> void override
+        {
+            std::cout << std::flush;
+            stdio_set_translate_crlf(&stdio_usb, false);
+        }
+
+        auto end_binary_block() -> void override
+        {
+            std::cout << std::flush;
+            stdio_set_translate_crlf(&stdio_usb, true);
+        }
+    };
+}
@@ -0,0 +1,1225 @@
+#pragma once
+
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "AD9850.hpp"
+#include "commit_trigger.hpp"
+#include "command_processor.hpp"
+#include "dither.hpp"
+#include "lock_timer.hpp"
+#include "pulsed_output.hpp"
+#include "frequency_table.hpp"
+#include "network_analyzer.hpp"
+#include "quadrature_encoder.hpp"
+#include "sequencer.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+
+// Command handling shared by the firmware and the host simulator.  Keeping
+// it in one place means both speak exactly the same protocol.  Commands
+// from any number of command processors are applied to the one DDS, and
+// each is answered on the channel it came in on.
+//
+namespace
+{
+    class CommandHandler
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  dds      DDS the commands are applied to.
+         * @param  trigger  Hardware commit trigger for the DDS.
+         * @param  analyzer Network analyzer sweeping the DDS.
+         * @param  sequencer Sequencer driving the DDS.
+         * @param  table    Frequency table played on the DDS.
+         * @param  dither   Frequency dither for the DDS.
+         * @param  encoder  Quadrature encoder tuning the DDS.
+         * @param  lock_timer  Lock time measurement stepping the DDS.
+         * @param  pulsed_output  Pulsed output keying the DDS.
+         */
+        CommandHandler(AD9850& dds, CommitTrigger& trigger, NetworkAnalyzer& analyzer, Sequencer& sequencer,
+                       FrequencyTable& table, Dither& dither, QuadratureEncoder& encoder,
+                       LockTimer& lock_timer, PulsedOutput& pulsed_output)
+            : dds_(dds)
+            , trigger_(trigger)
+            , analyzer_(analyzer)
+            , sequencer_(sequencer)
+            , table_(table)
+            , dither_(dither)
+            , encoder_(encoder)
+            , lock_timer_(lock_timer)
+            , pulsed_output_(pulsed_output)
+        {
+        }
+
+        /**
+         * @brief  Take the priority output-off commands of a command
+         *         processor, and watch it during sweeps.  Its commands
+         *         are acked in full until it asks otherwise.
+         * @param  source  Command processor to serve.
+         */
+        auto attach(CommandProcessor& source) -> void
+        {
+            source.set_output_off_callback(output_off, this);
+            source.set_busy_callback(busy, this);
+            ack_session_t session;
+            session.source = &source;
+            sessions_.push_back(session);
+        }
+
+        /**
+         * @brief  Run the loaded sequence if it is marked to run at
+         *         power-up.  Call once everything is attached.
+         */
+        auto autorun() -> void
+        {
+            if (sequencer_.get_autorun() && !sequencer_.check())
+            {
+                trigger_.disarm();
+                begin_run(engine_t::sequence, 0);
+                sequencer_.run(poll_input, this);
+                end_run();
+            }
+        }
+
+        /**
+         * @brief  Method to execute background work.  Call from the
+         *         main loop.
+         */
+        auto loop() -> void
+        {
+            trigger_.poll(dds_);
+
+            // A turn of the encoder commits straight away, like a
+            // frequency command, and cancels a pending trigger.
+            //
+            int32_t change = encoder_.poll(time_us_64());
+            if (change != 0)
+            {
+                trigger_.disarm();
+                dds_.offset_frequency(change);
+                dds_.commit();
+            }
+
+            // Send aggregated acks that have been held long enough.  The
+            // main loop wakes at least every millisecond to service USB,
+            // so that's the resolution.
+            //
+            uint64_t now_us = time_us_64();
+            for (ack_session_t& session : sessions_)
+            {
+                if ((session.pending > 0) && (session.interval_us > 0) &&
+                    (now_us - session.first_pending_us >= session.interval_us))
+                    flush_acks(session);
+            }
+
+            if (push_due_)
+            {
+                push_due_ = false;
+                push_state(now_us);
+            }
+        }
+
+        /**
+         * @brief  Push timer tick.  Call from the periodic alarm; it only
+         *         flags that pushes are due and wakes the main loop.
+         * @param  param  The command handler.
+         */
+        static auto push_tick(void* param) -> void
+        {
+            static_cast<CommandHandler*>(param)->push_due_ = true;
+            __sev();
+        }
+
+        /**
+         * @brief  Apply the next command from a command processor to the
+         *         DDS and acknowledge it.
+         * @param  source  Command processor the command came from.
+         */
+        auto process(CommandProcessor& source) -> void
+        {
+            command_t command = source.get_command();
+            CommandChannel& channel = source.channel();
+            ack_session_t& session = session_for(source);
+
+            // See if there was an error.  If so, send out
+            // json containing the error message and leave.
+            //
+            if (command.error.has_value())
+            {
+                if (command.scpi)
+                    queue_scpi_error(session, command.error.value());
+                else if (session.policy == ack_policy_t::aggregate)
+                {
+                    session.credits = source.get_credits(command);
+                    hold_ack(session, command.command_number, command.error);
+                }
+                else
+                    show_error(command, channel);
+                return;
+            }
+
+            bool set_policy = command.ack.has_value() || command.ack_every.has_value() ||
+                              command.ack_interval_ms.has_value();
+            if (set_policy)
+            {
+                set_ack_policy(command, session);
+            }
+
+            if (command.subscribe.has_value())
+            {
+                session.push_interval_us = command.subscribe.value().interval_ms * 1000ull;
+                session.push_on_change = command.subscribe.value().on_change;
+                session.pushed = push_state_t { };
+                session.last_push_us = 0;
+            }
+
+            // No error.  Process the command contents.  A sweep is a
+            // command of its own, answered with the results.
+            //
+            if (command.sweep.has_value())
+            {
+                flush_acks(session);
+                run_sweep(command, source);
+                TRACE_EVENT(ack, command.command_number);
+                return;
+            }
+
+            if (command.lock_time.has_value())
+            {
+                flush_acks(session);
+                run_lock_time(command, channel);
+                TRACE_EVENT(ack, command.command_number);
+                return;
+            }
+
+            if (command.sequence.has_value() || command.sequence_run.has_value() ||
+                command.sequence_save.has_value())
+            {
+                flush_acks(session);
+                handle_sequence(command, channel);
+                TRACE_EVENT(ack, command.command_number);
+                return;
+            }
+
+            if (command.table.has_value() || command.table_run.has_value())
+            {
+                flush_acks(session);
+                handle_table(command, channel);
+                TRACE_EVENT(ack, command.command_number);
+                return;
+            }
+
+            if (command.dither.has_value())
+            {
+                flush_acks(session);
+                run_dither(command, channel);
+                TRACE_EVENT(ack, command.command_number);
+                return;
+            }
+
+            if (command.pulse.has_value())
+            {
+                flush_acks(session);
+                run_pulse(command, channel);
+                TRACE_EVENT(ack, command.command_number);
+                return;
+            }
+
+            if (command.trigger_falling.has_value())
+            {
+                trigger_.set_falling_edge(command.trigger_falling.value());
+            }
+
+            if (command.marker.has_value() || command.marker_n.has_value())
+            {
+                dds_.set_marker_mode(
+                    command.marker.value_or(dds_.get_marker_mode()),
+                    command.marker_n.value_or(dds_.get_marker_n()));
+            }
+
+            if (command.sweep_start.value_or(false))
+            {
+                dds_.restart_marker();
+            }
+
+            if (command.encoder_step_hz.has_value())
+            {
+                encoder_.set_step(command.encoder_step_hz.value());
+            }
+
+            if (command.encoder_accel.has_value())
+            {
+                encoder_.set_acceleration(command.encoder_accel.value());
+            }
+
+            if (command.critical_commit.has_value())
+            {
+                dds_.set_critical_commit(command.critical_commit.value());
+            }
+
+            if (command.commit_budget_cycles.has_value())
+            {
+                telemetry.set_program_budget(command.commit_budget_cycles.value());
+            }
+
+            bool changes = false;
+            if (command.frequency_hz.has_value())
+            {
+                dds_.set_frequency(command.frequency_hz.value());
+                changes = true;
+            }
+
+            if (command.phase_deg.has_value())
+            {
+                dds_.set_phase(command.phase_deg.value());
+                changes = true;
+            }
+
+            if (command.delta_hz.has_value())
+            {
+                dds_.offset_frequency(command.delta_hz.value());
+                changes = true;
+            }
+
+            if (command.delta_phase.has_value())
+            {
+                dds_.offset_phase(command.delta_phase.value());
+                changes = true;
+            }
+
+            if (command.enable_out.has_value())
+            {
+                dds_.enable_out(command.enable_out.value());
+                changes = true;
+            }
+
+            // An armed command is preloaded and goes live on the trigger.
+            // Anything else that changes the state cancels a pending
+            // trigger and commits straight away.  Queries leave both the
+            // output and an armed word alone.
+            //
+            if (command.arm.value_or(false))
+            {
+                trigger_.arm(dds_);
+            }
+            else if (changes || command.arm.has_value())
+            {
+                trigger_.disarm();
+                if (changes)
+                    dds_.commit();
+            }
+
+            if (!changes)
+            {
+                telemetry.count_skipped_commit();
+            }
+
+            // Acknowledge the command.  A stats request is answered with
+            // the counters and a trace request with the trace block,
+            // instead of the DDS state.  Commands that only set the state
+            // are acked as the channel's policy says; anything asking for
+            // an answer, including a policy change, gets one in full.
+            //
+            bool sets_state = changes || command.arm.has_value() ||
+                              command.trigger_falling.has_value() || command.marker.has_value() ||
+                              command.marker_n.has_value() || command.sweep_start.has_value() ||
+                              command.encoder_step_hz.has_value() || command.encoder_accel.has_value() ||
+                              command.critical_commit.has_value() || command.commit_budget_cycles.has_value();
+            bool wants_answer = command.stats.value_or(false) || command.trace.value_or(false) ||
+                                command.credits.value_or(false) || set_policy || !sets_state;
+            if (command.scpi)
+            {
+                answer_scpi(command, session, channel);
+            }
+            else if (!wants_answer && (session.policy != ack_policy_t::full))
+            {
+                acknowledge(command, session);
+            }
+            else
+            {
+                flush_acks(session);
+                if (command.stats.value_or(false))
+                    show_stats(command.command_number, source);
+                else if (command.trace.value_or(false))
+                    show_trace(command.command_number, channel);
+                else if (command.credits.value_or(false))
+                    show_credits(command, source);
+                else
+                    ack_command(command, source);
+            }
+
+            if (command.reset_stats.value_or(false))
+            {
+                telemetry.reset();
+                source.reset_rx_stats();
+            }
+
+            TRACE_EVENT(ack, command.command_number);
+        }
+
+        static const uint32_t PUSH_TICK_US = 10000;     // Alarm period for pushes.
+
+    private:
+        static const uint32_t DEFAULT_ACK_EVERY = 16;
+        static const uint64_t DEFAULT_ACK_INTERVAL_US = 100000;
+        static const size_t MAX_ACK_ERRORS = 16;
+        static const size_t MAX_SCPI_ERRORS = 16;
+
+        // An error held for an aggregated ack.
+        //
+        using ack_error_t = struct {
+            int command_number;
+            std::string error;
+        };
+
+        // Engine holding the command processor, if any.
+        //
+        enum class engine_t : uint8_t {
+            idle,
+            sweep,
+            sequence,
+            table,
+            dither,
+            lock,
+            pulse,
+        };
+
+        // The state a push reports changes in.
+        //
+        using push_state_t = struct {
+            uint32_t frequency = 0;
+            uint32_t phase = 0;
+            bool enabled = false;
+            bool armed = false;
+            engine_t engine = engine_t::idle;
+            bool valid = false;         // False until the first push.
+        };
+
+        // A command processor, its ack policy, what it is holding for the
+        // next aggregated ack, and its push subscription.
+        //
+        using ack_session_t = struct {
+            CommandProcessor* source = nullptr;
+            ack_policy_t policy = ack_policy_t::full;
+            uint32_t every = DEFAULT_ACK_EVERY;             // Commands per aggregated ack.
+            uint64_t interval_us = DEFAULT_ACK_INTERVAL_US; // Longest an ack is held, or 0.
+            uint32_t pending = 0;                           // Commands held.
+            int last_command_number = 0;
+            credits_t credits { };                          // Credits after the last command.
+            uint64_t first_pending_us = 0;
+            std::vector<ack_error_t> errors { };
+            uint32_t errors_dropped = 0;                    // Errors past MAX_ACK_ERRORS.
+            uint64_t push_interval_us = 0;                  // Periodic push, or 0.
+            bool push_on_change = false;                    // Push when the state changes.
+            uint32_t pushes = 0;                            // Pushes sent, numbering them.
+            uint64_t last_push_us = 0;
+            push_state_t pushed { };                        // State last pushed.
+            std::deque<std::string> scpi_errors { };        // For SYST:ERR?, oldest first.
+        };
+
+        /**
+         * @brief  Return the session of an attached command processor.
+         */
+        auto session_for(CommandProcessor& source) -> ack_session_t&
+        {
+            for (ack_session_t& session : sessions_)
+            {
+                if (session.source == &source)
+                    return session;
+            }
+            attach(source);
+            return sessions_.back();
+        }
+
+        /**
+         * @brief  Change a channel's ack policy.  Held acks are sent
+         *         first, so they aren't mixed up with the new policy's.
+         *         The echo and prompt are only kept for full acks.
+         * @param  command  Command holding the ack fields.
+         * @param  session  Session to change.
+         */
+        auto set_ack_policy(const command_t& command, ack_session_t& session) -> void
+        {
+            flush_acks(session);
+            session.policy = command.ack.value_or(session.policy);
+            session.every = command.ack_every.value_or(session.every);
+            if (command.ack_interval_ms.has_value())
+                session.interval_us = command.ack_interval_ms.value() * 1000ull;
+            session.source->set_echo(session.policy == ack_policy_t::full);
+        }
+
+        /**
+         * @brief  Ack a command that only set the state, by the channel's
+         *         policy.
+         * @param  command  Command being acked.
+         * @param  session  Session of the channel it came from.
+         */
+        auto acknowledge(const command_t& command, ack_session_t& session) -> void
+        {
+            credits_t credits = session.source->get_credits(command);
+            switch (session.policy)
+            {
+                case ack_policy_t::minimal:
+                    session.source->channel().out() <<
+                        R"({)" <<
+                        R"(  "command_number":)"  << command.command_number << ","
+                        R"(  "credit_commands":)" << credits.commands << ","
+                        R"(  "credit_bytes":)"    << credits.bytes <<
+                        R"(})" << std::endl;
+                    break;
+                case ack_policy_t::aggregate:
+                    session.credits = credits;
+                    hold_ack(session, command.command_number, std::nullopt);
+                    break;
+                case ack_policy_t::full:
+                case ack_policy_t::errors:
+                    break;
+            }
+        }
+
+        /**
+         * @brief  Count a command towards the next aggregated ack, and
+         *         send it if it is due.
+         * @param  session         Session of the channel it came from.
+         * @param  command_number  Identifier for the command.
+         * @param  error           The command's error, if it failed.
+         */
+        auto hold_ack(ack_session_t& session, int command_number, const std::optional<std::string>& error) -> void
+        {
+            if (session.pending == 0)
+                session.first_pending_us = time_us_64();
+            session.pending += 1;
+            session.last_command_number = command_number;
+
+            if (error.has_value())
+            {
+                if (session.errors.size() < MAX_ACK_ERRORS)
+                    session.errors.push_back({ command_number, error.value() });
+                else
+                    session.errors_dropped += 1;
+            }
+
+            if (session.pending >= session.every)
+                flush_acks(session);
+        }
+
+        /**
+         * @brief  Send the aggregated ack for the commands held, if any:
+         *         the last command number, how many commands it covers,
+         *         and their errors.
+         * @param  session  Session to send for.
+         */
+        auto flush_acks(ack_session_t& session) -> void
+        {
+            if (session.pending == 0)
+                return;
+
+            std::ostream& out = session.source->channel().out();
+            out <<
+                R"({)" <<
+                R"(  "last_command_number":)" << session.last_command_number << ","
+                R"(  "commands":)"            << session.pending << ","
+                R"(  "errors":[)";
+            const char* separator = "";
+            for (const ack_error_t& error : session.errors)
+            {
+                out << separator <<
+                    R"({"command_number":)" << error.command_number <<
+                    R"(,"error":")"         << error.error << R"("})";
+                separator = ",";
+            }
+            out << "],"
+                R"(  "errors_dropped":)"  << session.errors_dropped << ","
+                R"(  "credit_commands":)" << session.credits.commands << ","
+                R"(  "credit_bytes":)"    << session.credits.bytes <<
+                R"(})" << std::endl;
+
+            session.pending = 0;
+            session.errors.clear();
+            session.errors_dropped = 0;
+        }
+
+        /**
+         * @brief  Priority output-off.  Called by the command processor as
+         *         soon as an output-off or abort command is complete, ahead
+         *         of anything queued.  Cancels a pending trigger, since it
+         *         would otherwise take FQ_UD, and powers the DDS down.
+         *         A pulse run hands the DDS pins back as it stops, so the
+         *         power-down goes out here and not when the run unwinds.
+         * @param  param  The command handler.
+         */
+        static auto output_off(void* param) -> void
+        {
+            CommandHandler* self = static_cast<CommandHandler*>(param);
+            self->analyzer_.stop();
+            self->sequencer_.stop();
+            self->table_.stop();
+            self->dither_.stop();
+            self->lock_timer_.stop();
+            self->pulsed_output_.stop();
+            self->trigger_.disarm();
+            self->dds_.power_down();
+        }
+
+        /**
+         * @brief  Turn away a command that arrived with the command fifo
+         *         full.  It's answered straight away, ahead of the
+         *         commands queued before it, whatever the ack policy.
+         * @param  param    The command handler.
+         * @param  source   Command processor it came from.
+         * @param  command  The command, with its busy error.
+         */
+        static auto busy(void* param, CommandProcessor& source, const command_t& command) -> void
+        {
+            CommandHandler* self = static_cast<CommandHandler*>(param);
+            if (command.scpi)
+                self->queue_scpi_error(self->session_for(source), command.error.value());
+            else
+                self->show_error(command, source.channel());
+            TRACE_EVENT(ack, command.command_number);
+        }
+
+        /**
+         * @brief  Run a network analyzer sweep and send the results.  The
+         *         response line gives the number of points measured and
+         *         the size of the binary block that follows it.
+         * @param  command  Command holding the sweep.
+         * @param  source   Command processor the command came from.  Every
+         *                  attached processor is watched for priority
+         *                  commands during the sweep.
+         */
+        auto run_sweep(const command_t& command, CommandProcessor& source) -> void
+        {
+            CommandChannel& channel = source.channel();
+            const sweep_config_t& config = command.sweep.value();
+            const char* error = NetworkAnalyzer::check(config);
+            if (error)
+            {
+                command_t failed = command;
+                failed.error = error;
+                show_error(failed, channel);
+                return;
+            }
+
+            trigger_.disarm();
+            begin_run(engine_t::sweep, config.points);
+            uint32_t points = analyzer_.run(config, poll_input, this);
+            end_run();
+
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)" << command.command_number << ","
+                R"(  "sweep_points":)"   << points << ","
+                R"(  "stopped":)"        << ((points < config.points) ? "true" : "false") << ","
+                R"(  "sweep_bytes":)"    << analyzer_.results_size() <<
+                R"(})" << std::endl;
+            analyzer_.write_results(channel);
+        }
+
+        /**
+         * @brief  Time the DUT's lock after each step and send the
+         *         results.  The response line gives the number of pairs
+         *         measured, the steps that timed out, and the size of the
+         *         binary block that follows it.
+         * @param  command  Command holding the measurement.
+         * @param  channel  Channel to answer on.
+         */
+        auto run_lock_time(const command_t& command, CommandChannel& channel) -> void
+        {
+            const lock_config_t& config = command.lock_time.value();
+            const char* error = LockTimer::check(config);
+            if (error)
+            {
+                command_t failed = command;
+                failed.error = error;
+                show_error(failed, channel);
+                return;
+            }
+
+            trigger_.disarm();
+            begin_run(engine_t::lock, config.steps.size());
+            lock_result_t result = lock_timer_.run(config, poll_input, this);
+            end_run();
+
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)" << command.command_number << ","
+                R"(  "lock_steps":)"     << result.steps << ","
+                R"(  "lock_timeouts":)"  << result.timeouts << ","
+                R"(  "stopped":)"        << (result.stopped ? "true" : "false") << ","
+                R"(  "lock_bytes":)"     << lock_timer_.results_size() <<
+                R"(})" << std::endl;
+            lock_timer_.write_results(channel);
+        }
+
+        /**
+         * @brief  Load, save and run sequences, in that order, and report
+         *         the sequence.  A run is answered once it is over.
+         * @param  command  Command holding the sequence fields.
+         * @param  channel  Channel to answer on.
+         */
+        auto handle_sequence(const command_t& command, CommandChannel& channel) -> void
+        {
+            const char* error = nullptr;
+            if (command.sequence.has_value())
+                error = sequencer_.load(command.sequence.value().c_str(), command.sequence_append);
+
+            bool save = command.sequence_save.value_or(false);
+            bool run = command.sequence_run.value_or(false);
+            if (!error && (save || run))
+                error = sequencer_.check();
+            if (error)
+            {
+                command_t failed = command;
+                failed.error = error;
+                show_error(failed, channel);
+                return;
+            }
+
+            if (save)
+                sequencer_.save(command.sequence_autorun.value_or(false));
+
+            sequence_result_t result = { 0, false };
+            if (run)
+            {
+                trigger_.disarm();
+                begin_run(engine_t::sequence, 0);
+                result = sequencer_.run(poll_input, this);
+                end_run();
+            }
+
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)"  << command.command_number << ","
+                R"(  "sequence_length":)" << sequencer_.get_length() << ","
+                R"(  "autorun":)"         << (sequencer_.get_autorun() ? "true" : "false");
+            if (run)
+            {
+                channel.out() << ","
+                    R"(  "sequence_steps":)" << result.steps << ","
+                    R"(  "stopped":)"        << (result.stopped ? "true" : "false");
+            }
+            channel.out() << R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Load and play frequency tables, and report the table.
+         *         A run is answered once it is over.
+         * @param  command  Command holding the table fields.
+         * @param  channel  Channel to answer on.
+         */
+        auto handle_table(const command_t& command, CommandChannel& channel) -> void
+        {
+            const char* error = nullptr;
+            if (command.table.has_value())
+                error = table_.load(command.table.value().c_str(), command.table_append);
+
+            bool run = command.table_run.value_or(false);
+            uint32_t points = table_.get_points();
+            uint32_t start = command.table_start.value_or(0);
+            if (!error && run && (points == 0))
+                error = "Table not loaded";
+            if (!error && run && (start >= points))
+                error = "Table start out of range";
+            if (error)
+            {
+                command_t failed = command;
+                failed.error = error;
+                show_error(failed, channel);
+                return;
+            }
+
+            table_result_t result = { 0, false };
+            if (run)
+            {
+                trigger_.disarm();
+                uint32_t count = command.table_count.value_or(points - start);
+                begin_run(engine_t::table, count);
+                result = table_.run(start, count, command.table_interval_us.value_or(0), poll_input, this);
+                end_run();
+            }
+
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)" << command.command_number << ","
+                R"(  "table_bytes":)"    << table_.get_bytes() << ","
+                R"(  "table_points":)"   << points;
+            if (run)
+            {
+                channel.out() << ","
+                    R"(  "table_played":)" << result.points << ","
+                    R"(  "stopped":)"      << (result.stopped ? "true" : "false");
+            }
+            channel.out() << R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Dither the live frequency and report what was put out.
+         *         Answered once the run is over.
+         * @param  command  Command holding the dither.
+         * @param  channel  Channel to answer on.
+         */
+        auto run_dither(const command_t& command, CommandChannel& channel) -> void
+        {
+            const dither_config_t& config = command.dither.value();
+            const char* error = dither_.check(config);
+            if (error)
+            {
+                command_t failed = command;
+                failed.error = error;
+                show_error(failed, channel);
+                return;
+            }
+
+            trigger_.disarm();
+            begin_run(engine_t::dither, 0);
+            dither_result_t result = dither_.run(config, poll_input, this);
+            end_run();
+
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)"  << command.command_number << ","
+                R"(  "dither_updates":)"  << result.updates << ","
+                R"(  "dither_rate_hz":)"  << result.rate_hz << ","
+                R"(  "dither_low_hz":)"   << result.low_hz << ","
+                R"(  "dither_high_hz":)"  << result.high_hz << ","
+                R"(  "stopped":)"         << (result.stopped ? "true" : "false") <<
+                R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Pulse the live frequency and report the width and
+         *         interval put out.  Answered once the run is over; the
+         *         output is left off.
+         * @param  command  Command holding the pulse.
+         * @param  channel  Channel to answer on.
+         */
+        auto run_pulse(const command_t& command, CommandChannel& channel) -> void
+        {
+            const pulse_config_t& config = command.pulse.value();
+            const char* error = PulsedOutput::check(config);
+            if (error)
+            {
+                command_t failed = command;
+                failed.error = error;
+                show_error(failed, channel);
+                return;
+            }
+
+            trigger_.disarm();
+            begin_run(engine_t::pulse, config.count);
+            pulse_result_t result = pulsed_output_.run(config, poll_input, this);
+            end_run();
+
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)"     << command.command_number << ","
+                R"(  "pulse_width_ns":)"     << result.width_ns << ","
+                R"(  "pulse_interval_ns":)"  << result.interval_ns << ","
+                R"(  "pulse_count":)"        << config.count << ","
+                R"(  "stopped":)"            << (result.stopped ? "true" : "false") <<
+                R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Mark an engine as holding the command processor, for
+         *         pushes.  Called just before the run starts.
+         * @param  engine  The engine.
+         * @param  total   How far the run will go in the engine's own
+         *                 units, or 0 if it isn't known.
+         */
+        auto begin_run(engine_t engine, uint32_t total) -> void
+        {
+            engine_ = engine;
+            engine_total_ = total;
+        }
+
+        /**
+         * @brief  Mark the engine run as over.
+         */
+        auto end_run() -> void
+        {
+            engine_ = engine_t::idle;
+            engine_total_ = 0;
+        }
+
+        /**
+         * @brief  Return how far the running engine has got, in its own
+         *         units: sweep points, sequence steps, table points,
+         *         dither updates, lock pairs or pulses.
+         */
+        auto engine_progress() -> uint32_t
+        {
+            switch (engine_)
+            {
+                case engine_t::sweep:
+                    return analyzer_.get_progress();
+                case engine_t::sequence:
+                    return sequencer_.get_progress();
+                case engine_t::table:
+                    return table_.get_progress();
+                case engine_t::dither:
+                    return dither_.get_progress();
+                case engine_t::lock:
+                    return lock_timer_.get_progress();
+                case engine_t::pulse:
+                    return pulsed_output_.get_progress();
+                default:
+                    return 0;
+            }
+        }
+
+        /**
+         * @brief  Send the pushes that are due.  Nothing is pushed while a
+         *         command is waiting on any channel, so pushes never hold
+         *         up command processing, and a channel gets at most one
+         *         push every MIN_PUSH_INTERVAL_MS.  While an engine runs
+         *         waiting commands can't be taken anyway, so they don't
+         *         hold pushes back.
+         * @param  now_us  Time now.
+         */
+        auto push_state(uint64_t now_us) -> void
+        {
+            for (ack_session_t& session : sessions_)
+            {
+                if ((engine_ == engine_t::idle) && session.source->command_is_available())
+                    return;
+            }
+
+            push_state_t state;
+            state.frequency = dds_.get_frequency();
+            state.phase = dds_.get_phase();
+            state.enabled = dds_.get_enabled();
+            state.armed = trigger_.is_armed();
+            state.engine = engine_;
+            state.valid = true;
+
+            for (ack_session_t& session : sessions_)
+            {
+                if (((session.push_interval_us == 0) && !session.push_on_change) ||
+                    (now_us - session.last_push_us < CommandProcessor::MIN_PUSH_INTERVAL_MS * 1000ull))
+                    continue;
+
+                bool due = (session.push_interval_us > 0) &&
+                           (now_us - session.last_push_us >= session.push_interval_us);
+                bool changed = session.push_on_change &&
+                    (!session.pushed.valid || (state.frequency != session.pushed.frequency) ||
+                     (state.phase != session.pushed.phase) || (state.enabled != session.pushed.enabled) ||
+                     (state.armed != session.pushed.armed) || (state.engine != session.pushed.engine));
+                if (due || changed)
+                    push(session, state, now_us);
+            }
+        }
+
+        /**
+         * @brief  Push the state and counters to a subscribed channel, on
+         *         one line with short keys and no padding.
+         * @param  session  The channel's session.
+         * @param  state    State to push.
+         * @param  now_us   Time now.
+         */
+        auto push(ack_session_t& session, const push_state_t& state, uint64_t now_us) -> void
+        {
+            static const struct { char const* name; engine_t engine; } engines[] = {
+                { "idle",     engine_t::idle     },
+                { "sweep",    engine_t::sweep    },
+                { "sequence", engine_t::sequence },
+                { "table",    engine_t::table    },
+                { "dither",   engine_t::dither   },
+                { "lock",     engine_t::lock     },
+                { "pulse",    engine_t::pulse    },
+            };
+            char const* engine = "idle";
+            for (auto const& entry : engines)
+            {
+                if (entry.engine == state.engine)
+                    engine = entry.name;
+            }
+
+            uint32_t parse_errors = 0;
+            for (size_t type = 0; type < static_cast<size_t>(parse_error_t::count); ++type)
+                parse_errors += telemetry.get_parse_errors(static_cast<parse_error_t>(type));
+
+            session.pushes += 1;
+            std::ostream& out = session.source->channel().out();
+            out <<
+                R"({"push":)" << session.pushes <<
+                R"(,"t":)"    << now_us / 1000 <<
+                R"(,"f":)"    << state.frequency <<
+                R"(,"p":)"    << state.phase <<
+                R"(,"e":)"    << (state.enabled ? 1 : 0) <<
+                R"(,"a":)"    << (state.armed ? 1 : 0) <<
+                R"(,"c":)"    << telemetry.get_commits() <<
+                R"(,"tr":)"   << trigger_.get_trigger_count() <<
+                R"(,"mt":)"   << trigger_.get_missed_count() <<
+                R"(,"pe":)"   << parse_errors <<
+                R"(,"b":)"    << telemetry.get_busy() <<
+                R"(,"r":")"   << engine << R"(")" <<
+                R"(,"rp":)"   << engine_progress() <<
+                R"(,"rt":)"   << engine_total_;
+
+            // A dither run also gives the rate and deviation it is
+            // achieving.
+            //
+            if (state.engine == engine_t::dither)
+            {
+                out <<
+                    R"(,"dr":)" << dither_.get_rate_hz() <<
+                    R"(,"dd":)" << dither_.get_deviation_hz();
+            }
+            out << R"(})" << std::endl;
+
+            session.pushed = state;
+            session.last_push_us = now_us;
+        }
+
+        /**
+         * @brief  Watch for priority commands during an engine run, and
+         *         send the pushes that fall due.
+         * @param  param  The command handler.
+         */
+        static auto poll_input(void* param) -> void
+        {
+            CommandHandler* self = static_cast<CommandHandler*>(param);
+            for (ack_session_t& session : self->sessions_)
+                session.source->poll_priority();
+
+            if (self->push_due_)
+            {
+                self->push_due_ = false;
+                self->push_state(time_us_64());
+            }
+        }
+
+        /**
+         * @brief  Print the error in json format.
+         * @param  command  Structure containing the returned error.
+         * @param  channel  Channel to answer on.
+         */
+        auto show_error(command_t command, CommandChannel& channel) -> void
+        {
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)" << command.command_number << ","
+                R"(  "error":)"          << R"(")"  << command.error.value() << R"(")" <<
+                R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Acknowledges the given command by pringing the
+         *         current DDS state and the flow control credits.
+         * @param  command  Command being acked.
+         * @param  source   Command processor it came from.
+         */
+        auto ack_command(const command_t& command, CommandProcessor& source) -> void
+        {
+            credits_t credits = source.get_credits(command);
+            source.channel().out() <<
+                R"({)" <<
+                R"(  "command_number":)"  <<  command.command_number << ","
+                R"(  "frequency":)"       <<  dds_.get_frequency() << ","
+                R"(  "phase":)"           <<  dds_.get_phase() << ","
+                R"(  "enable_out":)"      << (dds_.get_enabled() ? "true" : "false") << ","
+                R"(  "armed":)"           << (trigger_.is_armed() ? "true" : "false") << ","
+                R"(  "triggers":)"        <<  trigger_.get_trigger_count() << ","
+                R"(  "missed_triggers":)" <<  trigger_.get_missed_count() << ","
+                R"(  "credit_commands":)" <<  credits.commands << ","
+                R"(  "credit_bytes":)"    <<  credits.bytes <<
+                R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Answer a credits query with the credits and how much
+         *         is waiting in the command fifo and receive buffer.
+         * @param  command  The query.
+         * @param  source   Command processor it came from.
+         */
+        auto show_credits(const command_t& command, CommandProcessor& source) -> void
+        {
+            credits_t credits = source.get_credits(command);
+            source.channel().out() <<
+                R"({)" <<
+                R"(  "command_number":)"  << command.command_number << ","
+                R"(  "credit_commands":)" << credits.commands << ","
+                R"(  "credit_bytes":)"    << credits.bytes << ","
+                R"(  "queued":)"          << source.number_of_commands() << ","
+                R"(  "rx_buffered":)"     << source.get_rx_buffered() <<
+                R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Queue an SCPI error for SYST:ERR?.  SCPI errors aren't
+         *         answered inline, as a driver only reads after a query.
+         *         A full queue's newest error becomes a queue overflow.
+         * @param  session  Session of the channel it came from.
+         * @param  error    The error, code and message.
+         */
+        auto queue_scpi_error(ack_session_t& session, const std::string& error) -> void
+        {
+            if (session.scpi_errors.size() < MAX_SCPI_ERRORS)
+                session.scpi_errors.push_back(error);
+            else
+                session.scpi_errors.back() = SCPI_QUEUE_OVERFLOW;
+        }
+
+        /**
+         * @brief  Answer the queries of an SCPI command, `;` separated on
+         *         one line.  As usual for SCPI, a command without queries
+         *         gets no answer.
+         * @param  command  The command.
+         * @param  session  Session of the channel it came from, holding
+         *                  its error queue.
+         * @param  channel  Channel to answer on.
+         */
+        auto answer_scpi(const command_t& command, ack_session_t& session, CommandChannel& channel) -> void
+        {
+            std::ostream& out = channel.out();
+            if (command.scpi_clear)
+                session.scpi_errors.clear();
+            if (command.queries.empty())
+                return;
+
+            const char* separator = "";
+            for (scpi_query_t query : command.queries)
+            {
+                out << separator;
+                separator = ";";
+                switch (query)
+                {
+                    case scpi_query_t::idn:
+                        out << SCPI_IDN;
+                        break;
+                    case scpi_query_t::opc:
+                        out << 1;
+                        break;
+                    case scpi_query_t::frequency:
+                        out << dds_.get_frequency();
+                        break;
+                    case scpi_query_t::phase:
+                    {
+                        uint32_t phase = dds_.get_phase();
+                        out << phase / 100 << '.' << (phase / 10) % 10 << phase % 10;
+                        break;
+                    }
+                    case scpi_query_t::output:
+                        out << (dds_.get_enabled() ? 1 : 0);
+                        break;
+                    case scpi_query_t::error:
+                        if (session.scpi_errors.empty())
+                        {
+                            out << SCPI_NO_ERROR;
+                            break;
+                        }
+                        out << session.scpi_errors.front();
+                        session.scpi_errors.pop_front();
+                        break;
+                }
+            }
+            out << std::endl;
+        }
+
+        /**
+         * @brief  Print the telemetry counters.
+         * @param  command_number   Identifier for command being acked.
+         * @param  source           Command processor the request came from.
+         */
+        auto show_stats(int command_number, CommandProcessor& source) -> void
+        {
+            rx_stats_t rx = source.get_rx_stats();
+            std::ostream& out = source.channel().out();
+            out <<
+                R"({)" <<
+                R"(  "command_number":)"  << command_number << ","
+                R"(  "elapsed_us":)"      << telemetry.get_elapsed_us() << ","
+                R"(  "rx_bytes":)"        << rx.bytes << ","
+                R"(  "rx_drains":)"       << rx.drains << ","
+                R"(  "rx_callbacks":)"    << rx.callbacks << ","
+                R"(  "wakeups":)"         << rx.wakeups << ","
+                R"(  "rx_overruns":)"     << rx.overruns << ","
+                R"(  "lines":)"           << telemetry.get_lines() << ","
+                R"(  "parse_errors":{)"   <<
+                    R"("json":)"           << telemetry.get_parse_errors(parse_error_t::json) << ","
+                    R"("command_number":)" << telemetry.get_parse_errors(parse_error_t::command_number) << ","
+                    R"("field":)"          << telemetry.get_parse_errors(parse_error_t::field) << ","
+                    R"("overflow":)"       << telemetry.get_parse_errors(parse_error_t::overflow) << "},"
+                R"(  "fifo_high_water":)" << telemetry.get_fifo_high_water() << ","
+                R"(  "commits":)"         << telemetry.get_commits() << ","
+                R"(  "commits_skipped":)" << telemetry.get_commits_skipped() << ","
+                R"(  "aborts":)"          << telemetry.get_aborts() << ","
+                R"(  "flushed":)"         << telemetry.get_flushed() << ","
+                R"(  "busy":)"            << telemetry.get_busy() << ","
+                R"(  "parse_cycles":)";
+            show_cycle_stats(telemetry.parse_cycles, out);
+            out << "," R"(  "program_cycles":)";
+            show_cycle_stats(telemetry.program_cycles, out);
+            out << ","
+                R"(  "program_jitter_cycles":)" << telemetry.program_cycles.get_jitter() << ","
+                R"(  "program_budget_cycles":)" << telemetry.get_program_budget() << ","
+                R"(  "program_overruns":)"      << telemetry.get_program_overruns() << ","
+                R"(  "critical_commit":)"       << (dds_.get_critical_commit() ? "true" : "false") << ","
+                R"(  "abort_cycles":)";
+            show_cycle_stats(telemetry.abort_cycles, out);
+            out << ","
+                R"(  "loop_rate_hz":)"    << telemetry.get_loop_rate() <<
+                R"(})" << std::endl;
+        }
+
+        /**
+         * @brief  Dump the event trace.  The response line gives the size
+         *         of the binary block that follows it.
+         * @param  command_number   Identifier for command being acked.
+         * @param  channel          Channel to answer on.
+         */
+        auto show_trace(int command_number, CommandChannel& channel) -> void
+        {
+#ifdef SIGGEN_TRACE
+            channel.out() <<
+                R"({)" <<
+                R"(  "command_number":)" << command_number << ","
+                R"(  "trace_bytes":)"    << trace.dump_size() <<
+                R"(})" << std::endl;
+            trace.dump(channel);
+#else
+            command_t command;
+            command.command_number = command_number;
+            command.error = "Tracing not enabled in this build";
+            show_error(command, channel);
+#endif
+        }
+
+        /**
+         * @brief  Print a min/avg/max cycle count as a json object.
+         */
+        auto show_cycle_stats(CycleStats& stats, std::ostream& out) -> void
+        {
+            out <<
+                R"({"min":)" << stats.get_min() <<
+                R"(,"avg":)" << stats.get_average() <<
+                R"(,"max":)" << stats.get_max() << "}";
+        }
+
+        static constexpr const char* SCPI_IDN = "pico-siggen,AD9850,0,0.1";
+        static constexpr const char* SCPI_NO_ERROR = "0,\"No error\"";
+        static constexpr const char* SCPI_QUEUE_OVERFLOW = "-350,\"Queue overflow\"";
+
+        AD9850& dds_;
+        CommitTrigger& trigger_;
+        NetworkAnalyzer& analyzer_;
+        Sequencer& sequencer_;
+        FrequencyTable& table_;
+        Dither& dither_;
+        QuadratureEncoder& encoder_;
+        LockTimer& lock_timer_;
+        PulsedOutput& pulsed_output_;
+
+        std::vector<ack_session_t> sessions_ { };      // Attached command processors.
+        volatile bool push_due_ = false;                // Set by the push alarm.
+        engine_t engine_ = engine_t::idle;              // Engine holding the command processor.
+        uint32_t engine_total_ = 0;                     // Its run length, or 0 if not known.
+    };
+}
@@ -5,20 +5,112 @@
 #include <optional>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "AD9850.hpp"
+#include "command_channel.hpp"
+#include "dither.hpp"
+#include "lock_timer.hpp"
+#include "pulsed_output.hpp"
+#include "network_analyzer.hpp"
+#include "quadrature_encoder.hpp"
+#include "ring_buffer.hpp"
+#include "scpi_parser.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 #include "tiny-json.h"
 
 namespace
 {
+    // How the commands of a channel are acknowledged.
+    //
+    enum class ack_policy_t : uint8_t {
+        full,                           // The DDS state, for every command.
+        minimal,                        // The command number only.
+        errors,                         // Errors only.
+        aggregate,                      // A summary every so many commands or ms.
+    };
+
+    // State push subscription.  Pushes go out every interval, when the
+    // state changes, or both.
+    //
+    using subscribe_t = struct {
+        uint32_t interval_ms = 0;       // Push period, or 0 for none.
+        bool on_change = false;         // Push when the state changes.
+    };
+
     // Define the structure used to contain a DDS command.
     //
     using command_t = struct {
         int command_number = 0x00;
         std::optional<uint32_t> frequency_hz = std::nullopt;
         std::optional<uint32_t> phase_deg = std::nullopt;
+        std::optional<int32_t> delta_hz = std::nullopt;
+        std::optional<int32_t> delta_phase = std::nullopt;
         std::optional<bool> enable_out = std::nullopt;
+        std::optional<bool> arm = std::nullopt;
+        std::optional<bool> trigger_falling = std::nullopt;
+        std::optional<marker_mode_t> marker = std::nullopt;
+        std::optional<uint32_t> marker_n = std::nullopt;
+        std::optional<bool> sweep_start = std::nullopt;
         std::optional<std::string> error = std::nullopt;
+        parse_error_t error_type = parse_error_t::field;
+        std::optional<bool> stats = std::nullopt;
+        std::optional<bool> reset_stats = std::nullopt;
+        std::optional<bool> trace = std::nullopt;
+        std::optional<bool> abort = std::nullopt;
+        std::optional<sweep_config_t> sweep = std::nullopt;
+        std::optional<dither_config_t> dither = std::nullopt;
+        std::optional<lock_config_t> lock_time = std::nullopt;
+        std::optional<pulse_config_t> pulse = std::nullopt;
+        std::optional<std::string> sequence = std::nullopt;
+        bool sequence_append = false;
+        std::optional<bool> sequence_run = std::nullopt;
+        std::optional<bool> sequence_save = std::nullopt;
+        std::optional<bool> sequence_autorun = std::nullopt;
+        std::optional<std::string> table = std::nullopt;
+        bool table_append = false;
+        std::optional<bool> table_run = std::nullopt;
+        std::optional<uint32_t> table_start = std::nullopt;
+        std::optional<uint32_t> table_count = std::nullopt;
+        std::optional<uint32_t> table_interval_us = std::nullopt;
+        std::optional<ack_policy_t> ack = std::nullopt;
+        std::optional<uint32_t> ack_every = std::nullopt;
+        std::optional<uint32_t> ack_interval_ms = std::nullopt;
+        std::optional<bool> credits = std::nullopt;
+        std::optional<uint32_t> encoder_step_hz = std::nullopt;
+        std::optional<bool> encoder_accel = std::nullopt;
+        std::optional<subscribe_t> subscribe = std::nullopt;
+        std::optional<bool> critical_commit = std::nullopt;
+        std::optional<uint32_t> commit_budget_cycles = std::nullopt;
+        uint32_t line_end = 0;          // Receive position after the line.
+        uint32_t fifo_depth = 0;        // Commands queued, itself included, as it was queued.
+        bool scpi = false;              // Came in as SCPI; answered as SCPI.
+        bool scpi_clear = false;        // *CLS: empty the SCPI error queue.
+        std::vector<scpi_query_t> queries { };
+    };
+
+    // Receive statistics.  Bytes per drain and wakeups show how well
+    // input is being batched and how often the core leaves sleep.
+    //
+    using rx_stats_t = struct {
+        uint32_t bytes = 0;             // Bytes taken from the receive buffer.
+        uint32_t drains = 0;            // Calls to loop() that found data.
+        uint32_t callbacks = 0;         // Characters-available callbacks.
+        uint32_t wakeups = 0;           // Returns from wait_for_input().
+        uint32_t overruns = 0;          // Bytes the channel lost.
+    };
+
+    // Flow control credits: how many more commands and bytes a host may
+    // send after a command's line.
+    //
+    using credits_t = struct {
+        uint32_t commands;
+        uint32_t bytes;
     };
 
     // Now the command receiver class.
@@ -26,10 +118,14 @@ namespace
     class CommandProcessor
     {
     public:
+        static const uint32_t MIN_PUSH_INTERVAL_MS = 20;   // Closest pushes to a channel.
+
         /**
          * @brief  Class constructor
+         * @param  channel  Channel commands arrive on and are answered on.
          */
-        CommandProcessor() :
+        CommandProcessor(CommandChannel& channel) :
+            channel_(channel),
             command_buffer_index_(0),
             show_prompt_(false),
             crlf_(false)
@@ -37,6 +133,23 @@ namespace
             // Zero out the command buffer.
             //
             reset_command_buffer();
+
+            // The fifo is bounded, so it's allocated once up front.
+            //
+            commands_.reserve(MAX_QUEUED_COMMANDS);
+
+            // Have the channel tell us when characters arrive rather
+            // than polling for them.
+            //
+            channel_.set_chars_available_callback(chars_available, this);
+        }
+
+        /**
+         * @brief  Return the channel commands are answered on.
+         */
+        auto channel() -> CommandChannel&
+        {
+            return channel_;
         }
 
         /**
@@ -66,37 +179,267 @@ namespace
             {
                 command = commands_[0];
                 commands_.erase(commands_.begin());
+                TRACE_EVENT(dequeue, command.command_number);
             }
 
             return command;
         }
 
+        /**
+         * @brief  Set the function that turns the output off for a
+         *         priority command.
+         * @param  fn     Function to call, straight from loop(), as soon
+         *                as an output-off or abort command is complete.
+         * @param  param  Passed to fn.
+         */
+        auto set_output_off_callback(void (*fn)(void*), void* param) -> void
+        {
+            output_off_callback_ = fn;
+            output_off_param_ = param;
+        }
+
+        /**
+         * @brief  Set the function that answers a command that arrived
+         *         with the fifo full.
+         * @param  fn     Function to call, straight from loop(), with the
+         *                command, which carries a busy error and isn't
+         *                queued.
+         * @param  param  Passed to fn.
+         */
+        auto set_busy_callback(void (*fn)(void*, CommandProcessor&, const command_t&), void* param) -> void
+        {
+            busy_callback_ = fn;
+            busy_param_ = param;
+        }
+
+        /**
+         * @brief  Return the credits left after a command: the commands
+         *         and bytes the host may have sent after its line without
+         *         overrunning the fifo or the receive buffer.
+         * @param  command  A command taken from the fifo.
+         * @note   Counting from the command's line, rather than giving
+         *         what's free now, means the host needn't know how much of
+         *         what it has sent since has arrived.  The command credit
+         *         is the fifo room left as the line was queued, so a host
+         *         running ahead of the commands being carried out is told
+         *         to slow down before it is turned away busy.
+         */
+        auto get_credits(const command_t& command) -> credits_t
+        {
+            credits_t credits;
+            credits.commands = MAX_QUEUED_COMMANDS - command.fifo_depth;
+            credits.bytes = rx_buffer_.read_position() + RX_BUFFER_LEN - command.line_end;
+            return credits;
+        }
+
+        /**
+         * @brief  Return the number of received bytes not yet taken.
+         */
+        auto get_rx_buffered() -> uint32_t
+        {
+            return rx_buffer_.size();
+        }
+
+        /**
+         * @brief  Check input for priority commands without taking any.
+         *         For long-running commands to call while they wait.
+         */
+        auto poll_priority() -> void
+        {
+            scan_for_priority();
+        }
+
         /**
          * @brief  Method to execute instructions that look for
          *         incoming commands.
+         * @note   Drains the receive buffer, every complete line in it,
+         *         so lines that arrived while a command was carried out
+         *         all reach the fifo together, and fill it if the host
+         *         has run ahead.
          */
         auto loop() -> void
         {
             if (show_prompt_)
             {
-                display_prompt();       // Displays the prompt.
+                if (echo_)
+                    display_prompt();   // Displays the prompt.
                 show_prompt(false);     // Resets the flag.
             }
 
-            // Get the character from stdio.  If it's a timeout 
-            // you can just leave the method.
+            // Pull the characters received by the callback.  If there
+            // are none you can just leave the method.
             //
-            int character = stdio_getchar_timeout_us(0);
-            if (character == PICO_ERROR_TIMEOUT)
+            // Lines are checked for priority commands before any of them
+            // is taken, and only checked characters are taken.
+            //
+            scan_for_priority();
+
+            // Bytes left with the channel when the receive buffer filled
+            // are fetched as it empties, as no callback may come for them.
+            //
+            if (rx_left_ && !rx_buffer_.full())
+            {
+                uint32_t status = save_and_disable_interrupts();
+                chars_available(this);
+                restore_interrupts(status);
+            }
+
+            uint32_t count = 0;
+            char character;
+            while ((rx_buffer_.read_position() != scan_position_) && rx_buffer_.pop(character))
+            {
+                process_character(static_cast<unsigned char>(character));
+                ++count;
+            }
+
+            if (count == 0)
+                return;
+
+            rx_stats_.bytes += count;
+            rx_stats_.drains += 1;
+            channel_.out() << std::flush;
+        }
+
+        /**
+         * @brief  Return true if there is nothing to process: no prompt
+         *         to show, input to take, or command to carry out.
+         */
+        auto is_idle() -> bool
+        {
+            return !show_prompt_ && rx_buffer_.empty() && !command_is_available();
+        }
+
+        /**
+         * @brief  Sleep until an interrupt or event if there is nothing
+         *         to process.
+         * @note   The receive callback signals an event, so a character
+         *         arriving between the check and the wait is not missed.
+         */
+        auto wait_for_input() -> void
+        {
+            if (!is_idle())
                 return;
 
+            __wfe();
+            rx_stats_.wakeups += 1;
+        }
+
+        /**
+         * @brief  Turn the echo and prompt on or off.  Clients that don't
+         *         want every command answered don't want it echoed either.
+         * @param  echo  true to echo input and show the prompt.
+         */
+        auto set_echo(bool echo) -> void
+        {
+            echo_ = echo;
+        }
+
+        /**
+         * @brief  Return the receive statistics.
+         */
+        auto get_rx_stats() -> rx_stats_t
+        {
+            return rx_stats_;
+        }
+
+        /**
+         * @brief  Zero the receive statistics.
+         */
+        auto reset_rx_stats() -> void
+        {
+            rx_stats_ = rx_stats_t { };
+        }
+
+    private:
+
+        static const int COMMAND_BUFFER_LEN = 1024;
+        static const int MAX_COMMAND_LEN = COMMAND_BUFFER_LEN - 1;
+        static const int MAX_JSON_DEPTH = 16;
+        static const size_t RX_BUFFER_LEN = 2048;
+        static const size_t MAX_QUEUED_COMMANDS = 8;
+        static const uint32_t SCPI_OUTPUT_OFF_MAX_LEN = 40;     // SOURce:OUTPut:STATe OFF and blanks.
+
+        // What a line holds, known from its first character after any
+        // leading blanks.
+        //
+        enum class line_type_t : uint8_t {
+            unknown,
+            json,
+            scpi,
+        };
+
+        // SCPI errors, with their standard codes.
+        //
+        static constexpr const char* SCPI_SYNTAX_ERROR = "-102,\"Syntax error\"";
+        static constexpr const char* SCPI_DATA_ERROR = "-104,\"Data type error\"";
+        static constexpr const char* SCPI_PARAMETER_NOT_ALLOWED = "-108,\"Parameter not allowed\"";
+        static constexpr const char* SCPI_MISSING_PARAMETER = "-109,\"Missing parameter\"";
+        static constexpr const char* SCPI_UNDEFINED_HEADER = "-113,\"Undefined header\"";
+        static constexpr const char* SCPI_SUFFIX_ERROR = "-131,\"Invalid suffix\"";
+        static constexpr const char* SCPI_OUT_OF_RANGE = "-222,\"Data out of range\"";
+        static constexpr const char* SCPI_TOO_MUCH_DATA = "-223,\"Too much data\"";
+        static constexpr const char* SCPI_INPUT_OVERRUN = "-363,\"Input buffer overrun\"";
+        static constexpr const char* SCPI_BUSY = "-300,\"Device-specific error;Busy\"";
+
+        /**
+         * @brief  Characters-available callback.  Runs in interrupt
+         *         context and moves everything the channel has into the
+         *         receive buffer.
+         * @param  param  The command processor.
+         * @note   Anything that doesn't fit is left with the channel and
+         *         picked up by loop() once there is room.
+         */
+        static auto chars_available(void* param) -> void
+        {
+            CommandProcessor* self = static_cast<CommandProcessor*>(param);
+            self->rx_stats_.callbacks += 1;
+            if (!self->rx_pending_)
+            {
+                self->rx_cycles_ = Telemetry::cycles();
+                self->rx_pending_ = true;
+            }
+
+            while (!self->rx_buffer_.full())
+            {
+                int character = self->channel_.read_char();
+                if (character == PICO_ERROR_TIMEOUT)
+                    break;
+                self->rx_buffer_.push(static_cast<char>(character));
+                TRACE_EVENT(rx_byte, character);
+            }
+
+            self->rx_left_ = self->rx_buffer_.full();
+
+            // Every byte the channel gives is put in the receive buffer,
+            // so the channel's count of bytes before a loss is a receive
+            // position, and the line that ends at or after it lost them.
+            //
+            uint32_t position;
+            uint32_t lost = self->channel_.take_overrun(position);
+            if (lost > 0)
+            {
+                self->rx_stats_.overruns += lost;
+                if (!self->overrun_pending_)
+                    self->overrun_position_ = position;
+                self->overrun_pending_ = true;
+            }
+            __sev();
+        }
+
+        /**
+         * @brief  Handle a single received character.
+         * @param  character  Character to be handled.
+         * @return true if the character was a line terminator.
+         */
+        auto process_character(int character) -> bool
+        {
             // If you get a LF right after a CR ignore it.  We
             // map CR to LF below and don't want two in a row.
             //
             if ((character == '\n') && (crlf_))
             {
                 crlf_ = false;
-                return;
+                return false;
             }
 
             // We're mapping CR and LF to 0x00 since they are 
@@ -117,43 +460,61 @@ namespace
                 // process the command.  Once you've processed the 
                 // command be sure to reset the buffer and command index.
                 //
+                // The line is echoed first, since a busy command is
+                // answered as it's added.
+                //
+                TRACE_EVENT(line_complete, command_buffer_index_);
+                bool scpi = (line_type_ == line_type_t::scpi);
+                if (!scpi)
+                    reflect(character);
                 if (command_buffer_index_ > 0)
                 {
                     add_command_to_fifo();
                     reset_command_buffer();
                 }
-                reflect(character);
-                show_prompt(true);
+                overflow_ = false;
+                line_type_ = line_type_t::unknown;
+                show_prompt(!scpi);
+                return true;
             }
             else if (command_buffer_index_ >= MAX_COMMAND_LEN)
             {
                 // There's no room in the command buffer so there's
                 // nothing to do.  Just ignore the incoming character.
+                //
+                overflow_ = true;
             }
             else if ((character >= 32) && (character <= 128))
             {
-                // Reflect the character back to provide feedback and
-                // put it in the buffer.
+                // The first character after any leading blanks says
+                // whether the line is JSON or SCPI.  JSON lines are
+                // reflected back to provide feedback, the blanks held
+                // until then included.  SCPI lines aren't, since an
+                // SCPI driver would read the echo as its answer.
                 //
-                reflect(character);
+                if ((line_type_ == line_type_t::unknown) && (character != ' ') && (character != '\t'))
+                {
+                    line_type_ = (character == '{') ? line_type_t::json : line_type_t::scpi;
+                    for (int i = 0; (line_type_ == line_type_t::json) && (i < command_buffer_index_); ++i)
+                        reflect(command_buffer_[i]);
+                }
+                if (line_type_ == line_type_t::json)
+                    reflect(character);
                 command_buffer_[command_buffer_index_++] = static_cast<char>(character);
             }
+            return false;
         }
 
-    private:
-
-        static const int COMMAND_BUFFER_LEN = 1024;
-        static const int MAX_COMMAND_LEN = COMMAND_BUFFER_LEN - 1;
-        static const int MAX_JSON_DEPTH = 8;
-
         /**
-         * @brief  Send a single character out the stdio.
+         * @brief  Send a single character out the channel.
          * @param  character  Character to be sent.
+         * @note   Output is flushed once per call to loop().
          */
         auto reflect(int character) -> void
         {
-            std::cout << ((character == 0x00) ? '\n' : static_cast<char>(character));
-            std::cout << std::flush;
+            if (!echo_)
+                return;
+            channel_.out() << ((character == 0x00) ? '\n' : static_cast<char>(character));
         }
 
         /**
@@ -172,7 +533,7 @@ namespace
          */
         auto display_prompt() -> void
         {
-            std::cout << "$ " << std::flush;
+            channel_.out() << "$ " << std::flush;
         }
 
         /**
@@ -180,8 +541,334 @@ namespace
          */
         auto add_command_to_fifo() -> void
         {
-            std::optional<command_t> command = parse_json_command_buffer();
+            // A line too long for the command buffer was cut short, so
+            // it isn't parsed but gets an error of its own.  The command
+            // number is fished out of the text if it got in.
+            //
+            // A line that lost bytes to a receive overrun is answered the
+            // same way.
+            //
+            std::optional<command_t> command;
+            telemetry.count_line();
+            uint32_t terminator = rx_buffer_.read_position() - 1;
+            bool overrun = overrun_pending_ && (static_cast<int32_t>(terminator - overrun_position_) >= 0);
+            if (overrun)
+                overrun_pending_ = false;
+
+            if (overflow_ || overrun)
+            {
+                command = command_t { };
+                command.value().scpi = (line_type_ != line_type_t::json);
+                command.value().command_number = command.value().scpi ? 0 : find_command_number();
+                if (overrun)
+                    command.value().error = std::make_optional(
+                        command.value().scpi ? SCPI_INPUT_OVERRUN : "Receive overrun");
+                else
+                    command.value().error = std::make_optional(
+                        command.value().scpi ? SCPI_TOO_MUCH_DATA : "Command too long");
+                command.value().error_type = parse_error_t::overflow;
+                telemetry.count_parse_error(parse_error_t::overflow);
+            }
+            else
+            {
+                uint32_t start = Telemetry::cycles();
+                TRACE_EVENT(parse_begin, command_buffer_index_);
+                command = (line_type_ == line_type_t::json)
+                    ? parse_json_command_buffer() : parse_scpi_command_buffer();
+                TRACE_EVENT(parse_end, command.value().command_number);
+                telemetry.parse_cycles.add(Telemetry::cycles_since(start));
+
+                if (command.value().error.has_value())
+                    telemetry.count_parse_error(command.value().error_type);
+            }
+
+            // Lines that were queued ahead of a priority command when it
+            // was spotted are acked but not carried out.
+            //
+            command.value().line_end = terminator + 1;
+            if (flush_pending_ && (static_cast<int32_t>(flush_until_ - terminator) > 0))
+            {
+                if (!command.value().error.has_value())
+                {
+                    command.value().error = std::make_optional("Flushed by output off");
+                    telemetry.count_flushed();
+                }
+            }
+            else
+            {
+                flush_pending_ = false;
+            }
+
+            // Past the credits the host was given the fifo is full, and
+            // the command is answered as busy instead of being queued.
+            //
+            if (commands_.size() >= MAX_QUEUED_COMMANDS)
+            {
+                command.value().error = std::make_optional(command.value().scpi ? SCPI_BUSY : "Busy");
+                telemetry.count_busy();
+                if (busy_callback_)
+                    busy_callback_(busy_param_, *this, command.value());
+                return;
+            }
+
+            command.value().fifo_depth = commands_.size() + 1;
             commands_.push_back(command.value());
+            telemetry.update_fifo_depth(commands_.size());
+        }
+
+        /**
+         * @brief  Find the command number in the command buffer without
+         *         parsing it, for a line cut short.
+         * @return The number, or 0 if it isn't there.
+         */
+        auto find_command_number() -> int
+        {
+            const char* field = strstr(command_buffer_, R"("command_number")");
+            if (!field)
+                return 0;
+
+            field += strlen(R"("command_number")");
+            while ((*field == ' ') || (*field == '\t'))
+                ++field;
+            if (*field != ':')
+                return 0;
+            return static_cast<int>(strtol(field + 1, nullptr, 10));
+        }
+
+        /**
+         * @brief  Look through newly received lines for priority commands.
+         * @note   A line with "abort": true skips the queue: the output
+         *         goes off as soon as its terminator is seen, and
+         *         everything received or queued ahead of it is flushed,
+         *         since carrying that out afterwards could turn the output
+         *         back on.  Flushed commands are still acked, in order,
+         *         with an error.  A plain output-off, a line with only a
+         *         command number and "enable_out": false, or an SCPI line
+         *         with only OUTPut[:STATe] OFF, turns the output off as
+         *         soon as it's seen too, but flushes nothing: what is
+         *         ahead of it is still carried out, in order, before it.
+         *         Any of these lines then goes through the parser as
+         *         normal.
+         * @note   Matching is on the raw text so it costs a few compares
+         *         per byte.  A malformed line that looks like an abort or
+         *         plain output-off still turns the output off.
+         */
+        auto scan_for_priority() -> void
+        {
+            // Take the receive time of the oldest unscanned bytes along
+            // with how far to scan, so the latency measured covers the
+            // time the terminator spent waiting for us.
+            //
+            uint32_t status = save_and_disable_interrupts();
+            uint32_t end = rx_buffer_.write_position();
+            uint32_t arrival = rx_pending_ ? rx_cycles_ : Telemetry::cycles();
+            rx_pending_ = false;
+            restore_interrupts(status);
+
+            for (; scan_position_ != end; ++scan_position_)
+            {
+                char character = rx_buffer_.peek(scan_position_);
+                if ((character != '\r') && (character != '\n'))
+                    continue;
+
+                uint32_t start = scan_line_start_;
+                scan_line_start_ = scan_position_ + 1;
+
+                // Skip lines too long to be commands or partly consumed.
+                //
+                if ((scan_position_ - start > static_cast<uint32_t>(MAX_COMMAND_LEN)) ||
+                    (static_cast<int32_t>(start - rx_buffer_.read_position()) < 0))
+                    continue;
+
+                static const char* const PLAIN_OUTPUT_OFF[] = { R"("command_number")", R"("enable_out")" };
+                uint32_t first = skip_blanks(start, scan_position_);
+                if ((first != scan_position_) && (rx_buffer_.peek(first) != '{'))
+                {
+                    if (line_is_scpi_output_off(start, scan_position_))
+                        expedite(start, arrival, false);
+                }
+                else if (line_has_field(start, scan_position_, R"("abort")", "true"))
+                {
+                    expedite(start, arrival, true);
+                }
+                else if (line_has_field(start, scan_position_, R"("enable_out")", "false") &&
+                         line_has_only_fields(start, scan_position_, PLAIN_OUTPUT_OFF, 2))
+                {
+                    expedite(start, arrival, false);
+                }
+            }
+        }
+
+        /**
+         * @brief  Turn the output off for a priority command, and for an
+         *         abort flush everything ahead of it.
+         * @param  line_start  Receive position of the priority line.
+         * @param  arrival     Cycle count when its terminator arrived.
+         * @param  flush       Flush what was received or queued before it.
+         */
+        auto expedite(uint32_t line_start, uint32_t arrival, bool flush) -> void
+        {
+            if (output_off_callback_)
+                output_off_callback_(output_off_param_);
+            telemetry.abort_cycles.add(Telemetry::cycles_since(arrival));
+            telemetry.count_abort();
+            TRACE_EVENT(output_off, line_start);
+            if (!flush)
+                return;
+
+            for (command_t& queued : commands_)
+            {
+                if (queued.error.has_value())
+                    continue;
+                queued.error = std::make_optional("Flushed by output off");
+                telemetry.count_flushed();
+            }
+
+            flush_until_ = line_start;
+            flush_pending_ = true;
+        }
+
+        /**
+         * @brief  Return true if a received line holds a field with the
+         *         given literal value.
+         * @param  start  Receive position of the first character.
+         * @param  end    Receive position of the terminator.
+         * @param  name   Field name, with its quotes.
+         * @param  value  Literal value.
+         */
+        auto line_has_field(uint32_t start, uint32_t end, const char* name, const char* value) -> bool
+        {
+            size_t name_len = strlen(name);
+            for (uint32_t position = start; end - position > name_len; ++position)
+            {
+                if (!matches(position, end, name))
+                    continue;
+
+                uint32_t next = skip_blanks(position + name_len, end);
+                if ((next == end) || (rx_buffer_.peek(next) != ':'))
+                    continue;
+
+                next = skip_blanks(next + 1, end);
+                if (matches(next, end, value))
+                    return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief  Return true if the field names in a received line,
+         *         strings followed by a colon at any depth, are exactly
+         *         the given ones, each once.
+         * @param  start  Receive position of the first character.
+         * @param  end    Receive position of the terminator.
+         * @param  names  Field names, with their quotes.
+         * @param  count  Number of names, at most 32.
+         */
+        auto line_has_only_fields(uint32_t start, uint32_t end, const char* const* names, size_t count) -> bool
+        {
+            uint32_t seen = 0;
+            uint32_t opening = start;
+            bool in_string = false;
+            for (uint32_t position = start; position != end; ++position)
+            {
+                char character = rx_buffer_.peek(position);
+                if (in_string && (character == '\\') && (position + 1 != end))
+                {
+                    ++position;
+                    continue;
+                }
+                if (character != '"')
+                    continue;
+
+                in_string = !in_string;
+                if (in_string)
+                {
+                    opening = position;
+                    continue;
+                }
+
+                uint32_t next = skip_blanks(position + 1, end);
+                if ((next == end) || (rx_buffer_.peek(next) != ':'))
+                    continue;
+
+                size_t name = 0;
+                while ((name < count) &&
+                       ((strlen(names[name]) != position + 1 - opening) || !matches(opening, end, names[name])))
+                    ++name;
+                if ((name == count) || (seen & (1u << name)))
+                    return false;
+                seen |= 1u << name;
+            }
+            return seen == ((1u << count) - 1);
+        }
+
+        /**
+         * @brief  Return true if a received line is an SCPI output-off
+         *         and nothing else.
+         * @param  start  Receive position of the first character.
+         * @param  end    Receive position of the terminator.
+         * @note   The line is copied out to run the SCPI tokenizer over
+         *         it; lines too long to be a lone output-off aren't.
+         */
+        auto line_is_scpi_output_off(uint32_t start, uint32_t end) -> bool
+        {
+            char line[SCPI_OUTPUT_OFF_MAX_LEN + 1];
+            if (end - start > SCPI_OUTPUT_OFF_MAX_LEN)
+                return false;
+
+            size_t length = 0;
+            for (uint32_t position = start; position != end; ++position)
+                line[length++] = rx_buffer_.peek(position);
+            line[length] = '\0';
+
+            ScpiTokenizer tokenizer(line);
+            scpi_unit_t unit;
+            if (!tokenizer.next(unit) || unit.query)
+                return false;
+
+            scpi_unit_t extra;
+            bool enable;
+            ScpiTokenizer::strip_node(unit.header, "SOURCE", 4);
+            return is_scpi_output_header(unit.header) &&
+                   ScpiTokenizer::parse_boolean(unit.parameter, enable) && !enable &&
+                   !tokenizer.next(extra) && tokenizer.is_valid();
+        }
+
+        /**
+         * @brief  Return true if an SCPI header is OUTPut[:STATe].
+         */
+        static auto is_scpi_output_header(const scpi_token_t& header) -> bool
+        {
+            scpi_token_t node = header;
+            if (ScpiTokenizer::strip_node(node, "OUTPUT", 4))
+                return ScpiTokenizer::header_is(node, "STATE", 4);
+            return ScpiTokenizer::header_is(header, "OUTPUT", 4);
+        }
+
+        /**
+         * @brief  Return true if received text at a position starts with
+         *         a string.
+         */
+        auto matches(uint32_t position, uint32_t end, const char* text) -> bool
+        {
+            for (; *text; ++text, ++position)
+            {
+                if ((position == end) || (rx_buffer_.peek(position) != *text))
+                    return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief  Return the position of the first non-blank received
+         *         character at or after a position.
+         */
+        auto skip_blanks(uint32_t position, uint32_t end) -> uint32_t
+        {
+            while ((position != end) &&
+                   ((rx_buffer_.peek(position) == ' ') || (rx_buffer_.peek(position) == '\t')))
+                ++position;
+            return position;
         }
 
         /**
@@ -206,12 +893,19 @@ namespace
             // If conversion fails just return the default 
             // command structure.
             //
+            // Integers are decoded once while parsing rather than on
+            // each read below.
+            //
             json_t mem[MAX_JSON_DEPTH];
-            json_t const* json = json_create( command_buffer_, mem, sizeof(mem) / sizeof(*mem) );
+            jsonStaticPool_t spool;
+            jsonPool_t* pool = json_initStaticPool( &spool, mem, sizeof(mem) / sizeof(*mem) );
+            pool->cacheIntegers = true;
+            json_t const* json = json_createWithPool( command_buffer_, pool );
             if (!json)
             {
                 command_struct.error = 
                     std::make_optional("Error creating json from command buffer");
+                command_struct.error_type = parse_error_t::json;
                 return command_struct;
             }
 
@@ -222,6 +916,7 @@ namespace
             {
                 command_struct.error =
                     std::make_optional("Error parsing command number");
+                command_struct.error_type = parse_error_t::command_number;
                 return command_struct;
             }
             command_struct.command_number =
@@ -269,22 +964,734 @@ namespace
                     std::make_optional(static_cast<uint32_t>(json_getInteger( phase_deg )));
             }
 
-            return command_struct;
-        }
+            // Relative changes, for jog wheels.  They apply on top of a
+            // frequency or phase in the same command.
+            //
+            json_t const* delta_hz = json_getProperty(json, "delta_hz");
+            if (delta_hz)
+            {
+                if ((JSON_INTEGER != json_getType( delta_hz )) ||
+                    (json_getInteger( delta_hz ) < INT32_MIN) || (json_getInteger( delta_hz ) > INT32_MAX))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing frequency change.");
+                    return command_struct;
+                }
+                command_struct.delta_hz =
+                    std::make_optional(static_cast<int32_t>(json_getInteger( delta_hz )));
+            }
 
+            json_t const* delta_phase = json_getProperty(json, "delta_phase");
+            if (delta_phase)
+            {
+                if ((JSON_INTEGER != json_getType( delta_phase )) ||
+                    (json_getInteger( delta_phase ) < INT32_MIN) || (json_getInteger( delta_phase ) > INT32_MAX))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing phase change.");
+                    return command_struct;
+                }
+                command_struct.delta_phase =
+                    std::make_optional(static_cast<int32_t>(json_getInteger( delta_phase )));
+            }
 
-        // FIFO for storing received commands.
-        //
-        std::vector<command_t> commands_ {  };
+            json_t const* arm = json_getProperty(json, "arm");
+            if (arm)
+            {
+                if (JSON_BOOLEAN != json_getType( arm ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing arm flag.");
+                    return command_struct;
+                }
+                command_struct.arm =
+                    std::make_optional(json_getBoolean( arm ));
+            }
 
-        // Buffer used to store incoming chaacters.
-        //
-        char command_buffer_[COMMAND_BUFFER_LEN];
+            json_t const* trigger_edge = json_getProperty(json, "trigger_edge");
+            if (trigger_edge)
+            {
+                char const* edge = (JSON_TEXT == json_getType( trigger_edge ))
+                    ? json_getValue( trigger_edge ) : "";
+                if (strcmp(edge, "rising") && strcmp(edge, "falling"))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing trigger edge.");
+                    return command_struct;
+                }
+                command_struct.trigger_falling =
+                    std::make_optional(strcmp(edge, "falling") == 0);
+            }
+
+            json_t const* stats = json_getProperty(json, "stats");
+            if (stats)
+            {
+                if (JSON_BOOLEAN != json_getType( stats ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing stats flag.");
+                    return command_struct;
+                }
+                command_struct.stats =
+                    std::make_optional(json_getBoolean( stats ));
+            }
+
+            json_t const* credits = json_getProperty(json, "credits");
+            if (credits)
+            {
+                if (JSON_BOOLEAN != json_getType( credits ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing credits flag.");
+                    return command_struct;
+                }
+                command_struct.credits =
+                    std::make_optional(json_getBoolean( credits ));
+            }
+
+            json_t const* encoder_step = json_getProperty(json, "encoder_step");
+            if (encoder_step)
+            {
+                if ((JSON_INTEGER != json_getType( encoder_step )) || (json_getInteger( encoder_step ) < 0) ||
+                    (json_getInteger( encoder_step ) > QuadratureEncoder::MAX_STEP_HZ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing encoder step.");
+                    return command_struct;
+                }
+                command_struct.encoder_step_hz =
+                    std::make_optional(static_cast<uint32_t>(json_getInteger( encoder_step )));
+            }
+
+            json_t const* encoder_accel = json_getProperty(json, "encoder_accel");
+            if (encoder_accel)
+            {
+                if (JSON_BOOLEAN != json_getType( encoder_accel ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing encoder acceleration flag.");
+                    return command_struct;
+                }
+                command_struct.encoder_accel =
+                    std::make_optional(json_getBoolean( encoder_accel ));
+            }
+
+            json_t const* critical_commit = json_getProperty(json, "critical_commit");
+            if (critical_commit)
+            {
+                if (JSON_BOOLEAN != json_getType( critical_commit ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing critical commit flag.");
+                    return command_struct;
+                }
+                command_struct.critical_commit =
+                    std::make_optional(json_getBoolean( critical_commit ));
+            }
+
+            json_t const* commit_budget = json_getProperty(json, "commit_budget_cycles");
+            if (commit_budget)
+            {
+                if ((JSON_INTEGER != json_getType( commit_budget )) || (json_getInteger( commit_budget ) <= 0) ||
+                    (json_getInteger( commit_budget ) > Telemetry::MAX_CYCLES))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing commit budget.");
+                    return command_struct;
+                }
+                command_struct.commit_budget_cycles =
+                    std::make_optional(static_cast<uint32_t>(json_getInteger( commit_budget )));
+            }
+
+            json_t const* reset_stats = json_getProperty(json, "reset_stats");
+            if (reset_stats)
+            {
+                if (JSON_BOOLEAN != json_getType( reset_stats ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing reset stats flag.");
+                    return command_struct;
+                }
+                command_struct.reset_stats =
+                    std::make_optional(json_getBoolean( reset_stats ));
+            }
+
+            json_t const* trace = json_getProperty(json, "trace");
+            if (trace)
+            {
+                if (JSON_BOOLEAN != json_getType( trace ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing trace flag.");
+                    return command_struct;
+                }
+                command_struct.trace =
+                    std::make_optional(json_getBoolean( trace ));
+            }
+
+            json_t const* abort = json_getProperty(json, "abort");
+            if (abort)
+            {
+                if (JSON_BOOLEAN != json_getType( abort ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing abort flag.");
+                    return command_struct;
+                }
+                command_struct.abort =
+                    std::make_optional(json_getBoolean( abort ));
+            }
+
+            json_t const* marker = json_getProperty(json, "marker");
+            if (marker)
+            {
+                static const struct { char const* name; marker_mode_t mode; } modes[] = {
+                    { "off",   marker_mode_t::off   },
+                    { "every", marker_mode_t::every },
+                    { "start", marker_mode_t::start },
+                    { "nth",   marker_mode_t::nth   },
+                };
+                char const* name = (JSON_TEXT == json_getType( marker ))
+                    ? json_getValue( marker ) : "";
+                for (auto const& mode : modes)
+                {
+                    if (!strcmp(name, mode.name))
+                        command_struct.marker = std::make_optional(mode.mode);
+                }
+                if (!command_struct.marker.has_value())
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing marker mode.");
+                    return command_struct;
+                }
+            }
+
+            json_t const* marker_n = json_getProperty(json, "marker_n");
+            if (marker_n)
+            {
+                if ((JSON_INTEGER != json_getType( marker_n )) || (json_getInteger( marker_n ) < 1))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing marker interval.");
+                    return command_struct;
+                }
+                command_struct.marker_n =
+                    std::make_optional(static_cast<uint32_t>(json_getInteger( marker_n )));
+            }
+
+            json_t const* sweep_start = json_getProperty(json, "sweep_start");
+            if (sweep_start)
+            {
+                if (JSON_BOOLEAN != json_getType( sweep_start ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing sweep start flag.");
+                    return command_struct;
+                }
+                command_struct.sweep_start =
+                    std::make_optional(json_getBoolean( sweep_start ));
+            }
+
+            json_t const* sweep = json_getProperty(json, "sweep");
+            if (sweep)
+            {
+                sweep_config_t config;
+                if ((JSON_OBJ != json_getType( sweep )) ||
+                    !get_object_field(sweep, "start", true, config.start_hz) ||
+                    !get_object_field(sweep, "stop", true, config.stop_hz) ||
+                    !get_object_field(sweep, "points", true, config.points) ||
+                    !get_object_field(sweep, "settle_us", false, config.settle_us) ||
+                    !get_object_field(sweep, "samples", false, config.samples))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing sweep.");
+                    return command_struct;
+                }
+                command_struct.sweep = std::make_optional(config);
+            }
+
+            json_t const* dither = json_getProperty(json, "dither");
+            if (dither)
+            {
+                static const struct { char const* name; dither_profile_t profile; } profiles[] = {
+                    { "random",   dither_profile_t::random   },
+                    { "triangle", dither_profile_t::triangle },
+                };
+                dither_config_t config;
+                bool valid = (JSON_OBJ == json_getType( dither )) &&
+                    get_object_field(dither, "deviation", true, config.deviation_hz) &&
+                    get_object_field(dither, "rate", false, config.rate_hz) &&
+                    get_object_field(dither, "steps", false, config.steps) &&
+                    get_object_field(dither, "duration_ms", false, config.duration_ms);
+
+                json_t const* profile = valid ? json_getProperty(dither, "profile") : nullptr;
+                if (profile)
+                {
+                    char const* name = (JSON_TEXT == json_getType( profile ))
+                        ? json_getValue( profile ) : "";
+                    valid = false;
+                    for (auto const& entry : profiles)
+                    {
+                        if (!strcmp(name, entry.name))
+                        {
+                            config.profile = entry.profile;
+                            valid = true;
+                        }
+                    }
+                }
+                if (!valid)
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing dither.");
+                    return command_struct;
+                }
+                command_struct.dither = std::make_optional(config);
+            }
+
+            json_t const* lock_time = json_getProperty(json, "lock_time");
+            if (lock_time)
+            {
+                lock_config_t config;
+                json_t const* steps = (JSON_OBJ == json_getType( lock_time ))
+                    ? json_getProperty(lock_time, "steps") : nullptr;
+                bool valid = steps && (JSON_TEXT == json_getType( steps )) &&
+                    LockTimer::parse_steps(json_getValue( steps ), config.steps) &&
+                    get_object_field(lock_time, "repeat", false, config.repeat) &&
+                    get_object_field(lock_time, "dwell_us", false, config.dwell_us) &&
+                    get_object_field(lock_time, "timeout_us", false, config.timeout_us) &&
+                    get_object_field(lock_time, "bin_ns", false, config.bin_ns);
+
+                json_t const* edge = valid ? json_getProperty(lock_time, "edge") : nullptr;
+                if (edge)
+                {
+                    valid = (JSON_BOOLEAN == json_getType( edge ));
+                    config.edge = valid && json_getBoolean( edge );
+                }
+                json_t const* active_low = valid ? json_getProperty(lock_time, "active_low") : nullptr;
+                if (active_low)
+                {
+                    valid = (JSON_BOOLEAN == json_getType( active_low ));
+                    config.active_low = valid && json_getBoolean( active_low );
+                }
+                if (!valid)
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing lock time.");
+                    return command_struct;
+                }
+                command_struct.lock_time = std::make_optional(config);
+            }
+
+            json_t const* pulse = json_getProperty(json, "pulse");
+            if (pulse)
+            {
+                pulse_config_t config;
+                bool valid = (JSON_OBJ == json_getType( pulse )) &&
+                    get_object_field(pulse, "width_ns", true, config.width_ns) &&
+                    get_object_field(pulse, "interval_ns", true, config.interval_ns) &&
+                    get_object_field(pulse, "count", false, config.count);
+
+                json_t const* gate = valid ? json_getProperty(pulse, "gate") : nullptr;
+                if (gate)
+                {
+                    valid = (JSON_BOOLEAN == json_getType( gate ));
+                    config.gate = valid && json_getBoolean( gate );
+                }
+                json_t const* active_low = valid ? json_getProperty(pulse, "gate_active_low") : nullptr;
+                if (active_low)
+                {
+                    valid = (JSON_BOOLEAN == json_getType( active_low ));
+                    config.gate_active_low = valid && json_getBoolean( active_low );
+                }
+                if (!valid)
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing pulse.");
+                    return command_struct;
+                }
+                command_struct.pulse = std::make_optional(config);
+            }
+
+            json_t const* subscribe = json_getProperty(json, "subscribe");
+            if (subscribe)
+            {
+                subscribe_t config;
+                bool valid = (JSON_OBJ == json_getType( subscribe )) &&
+                    get_object_field(subscribe, "interval_ms", false, config.interval_ms) &&
+                    ((config.interval_ms == 0) || (config.interval_ms >= MIN_PUSH_INTERVAL_MS));
+
+                json_t const* on_change = valid ? json_getProperty(subscribe, "on_change") : nullptr;
+                if (on_change)
+                {
+                    valid = (JSON_BOOLEAN == json_getType( on_change ));
+                    config.on_change = valid && json_getBoolean( on_change );
+                }
+                if (!valid)
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing subscribe.");
+                    return command_struct;
+                }
+                command_struct.subscribe = std::make_optional(config);
+            }
+
+            // A sequence is loaded from "sequence", or added to from
+            // "sequence_append".
+            //
+            json_t const* sequence = json_getProperty(json, "sequence");
+            json_t const* sequence_append = json_getProperty(json, "sequence_append");
+            if (sequence || sequence_append)
+            {
+                json_t const* text = sequence ? sequence : sequence_append;
+                if ((sequence && sequence_append) || (JSON_TEXT != json_getType( text )))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing sequence.");
+                    return command_struct;
+                }
+                command_struct.sequence = std::make_optional(std::string(json_getValue( text )));
+                command_struct.sequence_append = (sequence_append != nullptr);
+            }
+
+            // A frequency table is sent in base64 pieces, the first in
+            // "table" and the rest in "table_append".
+            //
+            json_t const* table = json_getProperty(json, "table");
+            json_t const* table_append = json_getProperty(json, "table_append");
+            if (table || table_append)
+            {
+                json_t const* text = table ? table : table_append;
+                if ((table && table_append) || (JSON_TEXT != json_getType( text )))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing table.");
+                    return command_struct;
+                }
+                command_struct.table = std::make_optional(std::string(json_getValue( text )));
+                command_struct.table_append = (table_append != nullptr);
+            }
+
+            json_t const* table_run = json_getProperty(json, "table_run");
+            if (table_run)
+            {
+                if (JSON_BOOLEAN != json_getType( table_run ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing table run flag.");
+                    return command_struct;
+                }
+                command_struct.table_run =
+                    std::make_optional(json_getBoolean( table_run ));
+            }
+
+            static const struct { char const* name; std::optional<uint32_t> command_t::*field; } table_fields[] = {
+                { "table_start",       &command_t::table_start       },
+                { "table_count",       &command_t::table_count       },
+                { "table_interval_us", &command_t::table_interval_us },
+            };
+            for (auto const& field : table_fields)
+            {
+                json_t const* property = json_getProperty(json, field.name);
+                if (!property)
+                    continue;
+                if ((JSON_INTEGER != json_getType( property )) || (json_getInteger( property ) < 0) ||
+                    (json_getInteger( property ) > UINT32_MAX))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing table field.");
+                    return command_struct;
+                }
+                command_struct.*field.field =
+                    std::make_optional(static_cast<uint32_t>(json_getInteger( property )));
+            }
+
+            json_t const* ack = json_getProperty(json, "ack");
+            if (ack)
+            {
+                static const struct { char const* name; ack_policy_t policy; } policies[] = {
+                    { "full",      ack_policy_t::full      },
+                    { "minimal",   ack_policy_t::minimal   },
+                    { "errors",    ack_policy_t::errors    },
+                    { "aggregate", ack_policy_t::aggregate },
+                };
+                char const* name = (JSON_TEXT == json_getType( ack ))
+                    ? json_getValue( ack ) : "";
+                for (auto const& policy : policies)
+                {
+                    if (!strcmp(name, policy.name))
+                        command_struct.ack = std::make_optional(policy.policy);
+                }
+                if (!command_struct.ack.has_value())
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing ack policy.");
+                    return command_struct;
+                }
+            }
+
+            json_t const* ack_every = json_getProperty(json, "ack_every");
+            if (ack_every)
+            {
+                if ((JSON_INTEGER != json_getType( ack_every )) || (json_getInteger( ack_every ) < 1))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing ack interval.");
+                    return command_struct;
+                }
+                command_struct.ack_every =
+                    std::make_optional(static_cast<uint32_t>(json_getInteger( ack_every )));
+            }
+
+            json_t const* ack_interval_ms = json_getProperty(json, "ack_interval_ms");
+            if (ack_interval_ms)
+            {
+                if ((JSON_INTEGER != json_getType( ack_interval_ms )) || (json_getInteger( ack_interval_ms ) < 0))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing ack time interval.");
+                    return command_struct;
+                }
+                command_struct.ack_interval_ms =
+                    std::make_optional(static_cast<uint32_t>(json_getInteger( ack_interval_ms )));
+            }
+
+            static const struct { char const* name; std::optional<bool> command_t::*flag; } sequence_flags[] = {
+                { "sequence_run",     &command_t::sequence_run     },
+                { "sequence_save",    &command_t::sequence_save    },
+                { "sequence_autorun", &command_t::sequence_autorun },
+            };
+            for (auto const& flag : sequence_flags)
+            {
+                json_t const* property = json_getProperty(json, flag.name);
+                if (!property)
+                    continue;
+                if (JSON_BOOLEAN != json_getType( property ))
+                {
+                    command_struct.error =
+                        std::make_optional("Error parsing sequence flag.");
+                    return command_struct;
+                }
+                command_struct.*flag.flag = std::make_optional(json_getBoolean( property ));
+            }
+
+            return command_struct;
+        }
+
+        /**
+         * @brief  Parse the command buffer as a line of SCPI commands.
+         * @note   The `;` separated commands of a line make up a single
+         *         command, so they're applied with one commit and their
+         *         queries are answered together, with the state after
+         *         the commit.  Any error rejects the whole line.
+         */
+        auto parse_scpi_command_buffer() -> std::optional<command_t>
+        {
+            command_t command_struct;
+            command_struct.scpi = true;
+
+            ScpiTokenizer tokenizer(command_buffer_);
+            scpi_unit_t unit;
+            while (tokenizer.next(unit))
+            {
+                const char* error = parse_scpi_unit(unit, command_struct);
+                if (error)
+                {
+                    command_struct.error = std::make_optional(error);
+                    command_struct.error_type = (error == SCPI_UNDEFINED_HEADER)
+                        ? parse_error_t::json : parse_error_t::field;
+                    return command_struct;
+                }
+            }
+
+            if (!tokenizer.is_valid())
+            {
+                command_struct.error = std::make_optional(SCPI_SYNTAX_ERROR);
+                command_struct.error_type = parse_error_t::json;
+            }
+            return command_struct;
+        }
+
+        /**
+         * @brief  Add one SCPI command to a command.
+         * @param  unit     The tokenized command.
+         * @param  command  Command to add it to.
+         * @return An SCPI error, or null.
+         */
+        auto parse_scpi_unit(const scpi_unit_t& unit, command_t& command) -> const char*
+        {
+            scpi_token_t header = unit.header;
+            ScpiTokenizer::strip_node(header, "SOURCE", 4);
+            bool has_parameter = (unit.parameter.length > 0);
+
+            // Common commands.
+            //
+            if (header.text[0] == '*')
+            {
+                if (ScpiTokenizer::token_is(header, "*IDN") && unit.query)
+                    command.queries.push_back(scpi_query_t::idn);
+                else if (ScpiTokenizer::token_is(header, "*OPC") && unit.query)
+                    command.queries.push_back(scpi_query_t::opc);
+                else if (ScpiTokenizer::token_is(header, "*CLS") && !unit.query)
+                    command.scpi_clear = true;
+                else if (ScpiTokenizer::token_is(header, "*RST") && !unit.query)
+                {
+                    command.frequency_hz = std::make_optional(0);
+                    command.phase_deg = std::make_optional(0);
+                    command.enable_out = std::make_optional(false);
+                    command.arm = std::make_optional(false);
+                }
+                else
+                    return SCPI_UNDEFINED_HEADER;
+                return has_parameter ? SCPI_PARAMETER_NOT_ALLOWED : nullptr;
+            }
+
+            // SYSTem:ERRor[:NEXT]? takes the oldest error off the queue.
+            //
+            scpi_token_t node = header;
+            if (ScpiTokenizer::strip_node(node, "SYSTEM", 4))
+            {
+                bool valid = ScpiTokenizer::strip_node(node, "ERROR", 3)
+                    ? ScpiTokenizer::header_is(node, "NEXT", 4) : ScpiTokenizer::header_is(node, "ERROR", 3);
+                if (!valid || !unit.query)
+                    return SCPI_UNDEFINED_HEADER;
+                if (has_parameter)
+                    return SCPI_PARAMETER_NOT_ALLOWED;
+                command.queries.push_back(scpi_query_t::error);
+                return nullptr;
+            }
+
+            std::optional<scpi_query_t> query = std::nullopt;
+            if (ScpiTokenizer::header_is(header, "FREQUENCY", 4))
+                query = scpi_query_t::frequency;
+            else if (ScpiTokenizer::header_is(header, "PHASE", 4))
+                query = scpi_query_t::phase;
+            else if (is_scpi_output_header(header))
+                query = scpi_query_t::output;
+            else
+                return SCPI_UNDEFINED_HEADER;
+
+            if (unit.query)
+            {
+                if (has_parameter)
+                    return SCPI_PARAMETER_NOT_ALLOWED;
+                command.queries.push_back(query.value());
+                return nullptr;
+            }
+
+            if (!has_parameter)
+                return SCPI_MISSING_PARAMETER;
+
+            // Frequency is in Hz, with an optional HZ, KHZ or MHZ suffix,
+            // and phase in degrees, kept in .01 deg like the json field.
+            //
+            scpi_token_t suffix;
+            uint64_t value;
+            switch (query.value())
+            {
+                case scpi_query_t::frequency:
+                {
+                    static const struct { const char* name; int decimals; } units[] = {
+                        { "", 0 }, { "HZ", 0 }, { "KHZ", 3 }, { "MHZ", 6 },
+                    };
+                    ScpiTokenizer::parse_decimal(unit.parameter, 0, value, suffix);
+                    for (auto const& scale : units)
+                    {
+                        if (ScpiTokenizer::token_is(suffix, scale.name))
+                        {
+                            if (!ScpiTokenizer::parse_decimal(unit.parameter, scale.decimals, value, suffix))
+                                return SCPI_DATA_ERROR;
+                            if (value > UINT32_MAX)
+                                return SCPI_OUT_OF_RANGE;
+                            command.frequency_hz = std::make_optional(static_cast<uint32_t>(value));
+                            return nullptr;
+                        }
+                    }
+                    return (suffix.length == unit.parameter.length) ? SCPI_DATA_ERROR : SCPI_SUFFIX_ERROR;
+                }
+
+                case scpi_query_t::phase:
+                    if (!ScpiTokenizer::parse_decimal(unit.parameter, 2, value, suffix))
+                        return SCPI_DATA_ERROR;
+                    if ((suffix.length > 0) && !ScpiTokenizer::token_is(suffix, "DEG"))
+                        return SCPI_SUFFIX_ERROR;
+                    if (value > UINT32_MAX)
+                        return SCPI_OUT_OF_RANGE;
+                    command.phase_deg = std::make_optional(static_cast<uint32_t>(value));
+                    return nullptr;
+
+                default:
+                {
+                    bool enable;
+                    if (!ScpiTokenizer::parse_boolean(unit.parameter, enable))
+                        return SCPI_DATA_ERROR;
+                    command.enable_out = std::make_optional(enable);
+                    return nullptr;
+                }
+            }
+        }
+
+        /**
+         * @brief  Read a non-negative integer field of an object, such
+         *         as a sweep.
+         * @param  object    The object.
+         * @param  name      Field name.
+         * @param  required  Fail if the field is missing.  Otherwise value
+         *                   keeps its default.
+         * @param  value     Set to the field value.
+         * @return false if the field is missing when required, or invalid.
+         */
+        auto get_object_field(json_t const* object, const char* name, bool required, uint32_t& value) -> bool
+        {
+            json_t const* field = json_getProperty(object, name);
+            if (!field)
+                return !required;
+
+            if ((JSON_INTEGER != json_getType( field )) || (json_getInteger( field ) < 0) ||
+                (json_getInteger( field ) > UINT32_MAX))
+                return false;
+
+            value = static_cast<uint32_t>(json_getInteger( field ));
+            return true;
+        }
+
+
+        CommandChannel& channel_;       // See constructor for these value definitions.
+
+        // FIFO for storing received commands, up to MAX_QUEUED_COMMANDS.
+        //
+        std::vector<command_t> commands_ {  };
+
+        // Characters received by the callback, waiting for loop().
+        //
+        RingBuffer<char, RX_BUFFER_LEN> rx_buffer_;
+        rx_stats_t rx_stats_;
+
+        // Buffer used to store incoming chaacters.
+        //
+        char command_buffer_[COMMAND_BUFFER_LEN];
         int command_buffer_index_;
 
         // Flags used to control local state.
         //
         bool show_prompt_;
         bool crlf_;
+        bool overflow_ = false;
+        bool echo_ = true;
+        line_type_t line_type_ = line_type_t::unknown;
+
+        void (*output_off_callback_)(void*) = nullptr;
+        void* output_off_param_ = nullptr;
+        void (*busy_callback_)(void*, CommandProcessor&, const command_t&) = nullptr;
+        void* busy_param_ = nullptr;
+
+        uint32_t scan_position_ = 0;    // Receive positions for the priority scan.
+        uint32_t scan_line_start_ = 0;
+        uint32_t flush_until_ = 0;      // Lines ending before this are flushed.
+        bool flush_pending_ = false;
+        volatile uint32_t rx_cycles_ = 0;   // Arrival of the oldest unscanned bytes.
+        volatile bool rx_pending_ = false;
+        volatile bool rx_left_ = false;     // The channel held more than would fit.
+        volatile uint32_t overrun_position_ = 0;    // Receive position a channel overrun was found at.
+        volatile bool overrun_pending_ = false;
     };
 }
\ No newline at end of file
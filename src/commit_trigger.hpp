@@ -0,0 +1,271 @@
+#pragma once
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/pio_instructions.h"
+#include "hardware/sync.h"
+
+#include "AD9850.hpp"
+#include "trace.hpp"
+
+// Hardware-triggered commit.  The next word is preloaded into the AD9850
+// input register and a PIO state machine, waiting on the trigger input,
+// generates the FQ_UD pulse.  Trigger-to-update latency is the input
+// synchronizer plus a couple of PIO cycles; no interrupt is involved.
+//
+// The marker output is side-set by the same instruction that raises
+// FQ_UD.  It only reaches the pin when the armed update is to be marked,
+// which is decided by giving the marker pin to the PIO or leaving it with
+// the SIO, so marking costs no extra cycles.
+//
+// A GPIO interrupt on the same edge only does the bookkeeping: it counts
+// triggers, and uses the token the state machine pushes after firing to
+// tell a trigger that fired the armed word from one that was missed.
+//
+namespace
+{
+    class CommitTrigger
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  pio      PIO block to run the state machine on.
+         * @param  trigger  Trigger input GPIO.
+         * @param  fq_ud    AD9850 FQ_UD GPIO.
+         * @param  marker   Marker GPIO.
+         */
+        CommitTrigger(PIO pio, uint trigger, uint fq_ud, uint marker)
+            : pio_(pio)
+            , trigger_(trigger)
+            , fq_ud_(fq_ud)
+            , marker_(marker)
+        {
+            instance_ = this;
+
+            // Build the program around the trigger pin.  The state machine
+            // stalls on the pull until it is armed, then waits for a
+            // rising edge, pulses FQ_UD and raises the marker, and
+            // reports that it fired.
+            //
+            instructions_[0] = pio_encode_pull(false, true);
+            instructions_[1] = pio_encode_wait_gpio(false, trigger_);
+            instructions_[2] = pio_encode_wait_gpio(true, trigger_);
+            instructions_[3] = pio_encode_set(pio_pins, 1) | pio_encode_sideset_opt(1, 1) |
+                pio_encode_delay(FQ_UD_HIGH_CYCLES - 1);
+            instructions_[4] = pio_encode_set(pio_pins, 0);
+            instructions_[5] = pio_encode_push(false, false);
+
+            pio_program_t program = { };
+            program.instructions = instructions_;
+            program.length = PROGRAM_LEN;
+            program.origin = -1;
+
+            sm_ = pio_claim_unused_sm(pio_, true);
+            offset_ = pio_add_program(pio_, &program);
+
+            pio_sm_config config = pio_get_default_sm_config();
+            sm_config_set_wrap(&config, offset_, offset_ + PROGRAM_LEN - 1);
+            sm_config_set_set_pins(&config, fq_ud_, 1);
+            sm_config_set_sideset_pins(&config, marker_);
+            sm_config_set_sideset(&config, 2, true, false);
+            sm_config_set_clkdiv(&config, 1.0f);
+            pio_sm_init(pio_, sm_, offset_, &config);
+
+            // The pins stay under SIO control until the trigger is armed,
+            // so make sure the state machine drives them low when it takes
+            // over.
+            //
+            uint32_t pin_mask = (1u << fq_ud_) | (1u << marker_);
+            pio_sm_set_pins_with_mask(pio_, sm_, 0, pin_mask);
+            pio_sm_set_pindirs_with_mask(pio_, sm_, pin_mask, pin_mask);
+            pio_sm_set_enabled(pio_, sm_, true);
+
+            gpio_init(trigger_);
+            gpio_set_dir(trigger_, GPIO_IN);
+            gpio_set_irq_enabled_with_callback(trigger_, GPIO_IRQ_EDGE_RISE, true, &trigger_irq);
+        }
+
+        /**
+         * @brief  Select the trigger edge.
+         * @param  falling  Trigger on the falling edge if true, otherwise
+         *                  on the rising edge.
+         * @note   Implemented by inverting the input, so the state machine
+         *         and the edge interrupt always see a rising edge.
+         */
+        auto set_falling_edge(bool falling) -> void
+        {
+            gpio_set_inover(trigger_, falling ? GPIO_OVERRIDE_INVERT : GPIO_OVERRIDE_NORMAL);
+            falling_edge_ = falling;
+        }
+
+        /**
+         * @brief  Return true if triggering on the falling edge.
+         */
+        auto get_falling_edge() -> bool
+        {
+            return falling_edge_;
+        }
+
+        /**
+         * @brief  Preload the pending DDS state and arm the trigger.
+         * @param  dds  DDS to update on the trigger.
+         */
+        auto arm(AD9850& dds) -> void
+        {
+            disarm();
+            dds.preload();
+            marked_ = dds.preload_marked();
+
+            // Hand FQ_UD, and the marker if this update is marked, to the
+            // state machine and release it.  Interrupts are held off so an
+            // edge can't be counted before we are armed.
+            //
+            uint32_t status = save_and_disable_interrupts();
+            gpio_set_function(fq_ud_, pio_function());
+            if (marked_)
+                gpio_set_function(marker_, pio_function());
+            pio_sm_put(pio_, sm_, 1);
+            armed_ = true;
+            restore_interrupts(status);
+        }
+
+        /**
+         * @brief  Cancel a pending trigger and return FQ_UD to the driver.
+         */
+        auto disarm() -> void
+        {
+            if (!armed_)
+                return;
+
+            release_pins(false);
+        }
+
+        /**
+         * @brief  Finish off a trigger that has fired.  Call from the main
+         *         loop; it brings the driver's state up to date.
+         * @param  dds  DDS that was armed.
+         * @return true if the armed word went live since the last call.
+         */
+        auto poll(AD9850& dds) -> bool
+        {
+            if (!fired_)
+                return false;
+
+            fired_ = false;
+            release_pins(true);
+            dds.apply_preload();
+            return true;
+        }
+
+        /**
+         * @brief  Return true if armed and waiting for a trigger.
+         */
+        auto is_armed() -> bool
+        {
+            return armed_;
+        }
+
+        /**
+         * @brief  Return the number of trigger edges seen.
+         */
+        auto get_trigger_count() -> uint32_t
+        {
+            return trigger_count_;
+        }
+
+        /**
+         * @brief  Return the number of trigger edges seen while not armed.
+         */
+        auto get_missed_count() -> uint32_t
+        {
+            return missed_count_;
+        }
+
+    private:
+
+        static const uint PROGRAM_LEN = 6;
+        static const uint FQ_UD_HIGH_CYCLES = 2;
+
+        /**
+         * @brief  Trigger edge interrupt.  Only counts; the update itself
+         *         has already been done by the state machine.
+         */
+        static auto trigger_irq(uint gpio, uint32_t events) -> void
+        {
+            CommitTrigger* self = instance_;
+            if (!self || (gpio != self->trigger_))
+                return;
+
+            self->trigger_count_ += 1;
+            if (!pio_sm_is_rx_fifo_empty(self->pio_, self->sm_))
+            {
+                pio_sm_get(self->pio_, self->sm_);
+                self->armed_ = false;
+                self->fired_ = true;
+                TRACE_EVENT(trigger, 1);
+                __sev();
+            }
+            else
+            {
+                self->missed_count_ += 1;
+                TRACE_EVENT(trigger, 0);
+            }
+        }
+
+        /**
+         * @brief  Return the GPIO function that connects a pin to our PIO.
+         */
+        auto pio_function() -> gpio_function
+        {
+            return (pio_ == pio0) ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1;
+        }
+
+        /**
+         * @brief  Give FQ_UD and the marker back to the SIO so the driver
+         *         can pulse them, and return the state machine to the top
+         *         of the program with empty FIFOs and its pins low.
+         * @param  hold_marker  Keep a raised marker high.  After a trigger
+         *                      the SIO holds it until the driver starts
+         *                      the next word, as after a software commit.
+         */
+        auto release_pins(bool hold_marker) -> void
+        {
+            armed_ = false;
+
+            gpio_put(fq_ud_, false);
+            gpio_set_function(fq_ud_, GPIO_FUNC_SIO);
+            if (marked_)
+            {
+                gpio_put(marker_, hold_marker);
+                gpio_set_function(marker_, GPIO_FUNC_SIO);
+                marked_ = false;
+            }
+
+            pio_sm_set_enabled(pio_, sm_, false);
+            pio_sm_clear_fifos(pio_, sm_);
+            pio_sm_restart(pio_, sm_);
+            pio_sm_set_pins_with_mask(pio_, sm_, 0, (1u << fq_ud_) | (1u << marker_));
+            pio_sm_exec(pio_, sm_, pio_encode_jmp(offset_));
+            pio_sm_set_enabled(pio_, sm_, true);
+        }
+
+        static inline CommitTrigger* instance_ = nullptr;
+
+        PIO pio_;                       // See constructor for these value definitions.
+        uint trigger_;
+        uint fq_ud_;
+        uint marker_;
+
+        uint sm_ = 0;                   // State machine and program location.
+        uint offset_ = 0;
+        uint16_t instructions_[PROGRAM_LEN] { };
+
+        bool falling_edge_ = false;
+        bool marked_ = false;           // Marker pin handed to the PIO.
+        volatile bool armed_ = false;   // Shared with the trigger interrupt.
+        volatile bool fired_ = false;
+        volatile uint32_t trigger_count_ = 0;
+        volatile uint32_t missed_count_ = 0;
+    };
+}
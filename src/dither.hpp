@@ -0,0 +1,271 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+#include "AD9850.hpp"
+
+// Frequency dither, for a carrier with a controlled spread.  The tuning
+// word is moved around the live frequency at a fixed update rate, either
+// to pseudo-random points from an LFSR (a 32 bit xorshift, which has a
+// period of 2^32 - 1) or up and down a triangle.  The bounds are turned
+// into tuning words before the run starts, so an update is shifts and
+// adds and a word that was preloaded while waiting for it, put out with
+// FQ_UD.  Random points take the LFSR bits under the span's mask and
+// draw again when they land past the span, which keeps them even over
+// the band without a multiply (a 64 bit one is a library call on the
+// Cortex-M0+).
+//
+namespace
+{
+    // Dither profiles.
+    //
+    enum class dither_profile_t : uint8_t {
+        random,                         // Pseudo-random points between the bounds.
+        triangle,                       // Ramps between the bounds.
+    };
+
+    // Dither parameters.
+    //
+    using dither_config_t = struct {
+        dither_profile_t profile = dither_profile_t::random;
+        uint32_t deviation_hz = 0;      // Either side of the live frequency.
+        uint32_t rate_hz = 0;           // Updates per second, or 0 for as fast as possible.
+        uint32_t steps = 64;            // Triangle updates from one bound to the other.
+        uint32_t duration_ms = 0;       // Run time, or 0 to run until stopped.
+    };
+
+    // Result of a run.
+    //
+    using dither_result_t = struct {
+        uint32_t updates;               // Words put out.
+        uint32_t rate_hz;               // Updates per second achieved.
+        uint32_t low_hz;                // Lowest and highest frequencies put out.
+        uint32_t high_hz;
+        bool stopped;                   // Stopped before the duration was up.
+    };
+
+    class Dither
+    {
+    public:
+        static const uint32_t MAX_RATE_HZ = 1000000;
+
+        /**
+         * @brief  Constructor
+         * @param  dds  DDS to dither.
+         */
+        Dither(AD9850& dds)
+            : dds_(dds)
+        {
+        }
+
+        /**
+         * @brief  Return an error message if a dither can't be run about
+         *         the live frequency, or null if it can.
+         */
+        auto check(const dither_config_t& config) -> const char*
+        {
+            uint32_t center = dds_.get_frequency_register();
+            uint32_t deviation = dds_.tuning_word(config.deviation_hz);
+            if ((deviation == 0) || (deviation > center) || (deviation > UINT32_MAX - center))
+                return "Dither deviation out of range";
+            if (config.rate_hz > MAX_RATE_HZ)
+                return "Dither rate out of range";
+            if ((config.steps == 0) || (config.steps > 2 * deviation))
+                return "Dither steps out of range";
+            return nullptr;
+        }
+
+        /**
+         * @brief  Dither the live frequency, then go back to it.  The
+         *         output enable and phase are left as they are.
+         * @param  config  Dither parameters, already checked.
+         * @param  poll    Called while waiting, and every so many updates
+         *                 if not waiting, so the run can be stopped; may
+         *                 be null.
+         * @param  param   Passed to poll.
+         */
+        auto run(const dither_config_t& config, void (*poll)(void*), void* param) -> dither_result_t
+        {
+            stop_ = false;
+            uint32_t center = dds_.get_frequency_register();
+            uint32_t phase_register = dds_.get_phase_register();
+            bool enable = dds_.get_enabled();
+
+            // Bounds, as tuning words.  The span is inclusive, and the
+            // triangle turns at the bounds.
+            //
+            uint32_t deviation = dds_.tuning_word(config.deviation_hz);
+            uint32_t low = center - deviation;
+            uint32_t span = 2 * deviation;
+            uint32_t step = span / config.steps;
+            bool random = (config.profile == dither_profile_t::random);
+
+            // Smallest all-ones mask covering the span, so a draw lands
+            // inside it more than half the time.
+            //
+            uint32_t mask = span;
+            mask |= mask >> 1;
+            mask |= mask >> 2;
+            mask |= mask >> 4;
+            mask |= mask >> 8;
+            mask |= mask >> 16;
+
+            // The interval is kept exact over the run by carrying the
+            // remainder, rather than dividing on every update.
+            //
+            uint32_t interval_us = (config.rate_hz > 0) ? US_PER_S / config.rate_hz : 0;
+            uint32_t remainder = (config.rate_hz > 0) ? US_PER_S % config.rate_hz : 0;
+            uint32_t carried = 0;
+
+            uint32_t offset = deviation;
+            bool rising = true;
+            lowest_ = UINT32_MAX;
+            highest_ = 0;
+
+            dither_result_t result = { 0, 0, 0, 0, false };
+            progress_ = 0;
+            uint64_t start_us = time_us_64();
+            start_us_ = start_us;
+            uint64_t end_us = start_us + config.duration_ms * 1000ull;
+            uint64_t deadline_us = start_us;
+            dds_.restart_marker();
+            dds_.preload(low + offset, phase_register, enable);
+            while (!stop_)
+            {
+                dds_.fire();
+                result.updates += 1;
+                progress_ = result.updates;
+                uint32_t word = low + offset;
+                lowest_ = (word < lowest_) ? word : lowest_;
+                highest_ = (word > highest_) ? word : highest_;
+
+                // Work out and preload the next word while this one plays.
+                //
+                if (random)
+                {
+                    do
+                    {
+                        lfsr_ ^= lfsr_ << 13;
+                        lfsr_ ^= lfsr_ >> 17;
+                        lfsr_ ^= lfsr_ << 5;
+                    } while ((lfsr_ & mask) > span);
+                    offset = lfsr_ & mask;
+                }
+                else if (rising)
+                {
+                    offset += step;
+                    rising = (span - offset >= step);
+                }
+                else
+                {
+                    offset -= step;
+                    rising = (offset < step);
+                }
+                dds_.preload(low + offset, phase_register, enable);
+
+                if (interval_us > 0)
+                {
+                    deadline_us += interval_us;
+                    carried += remainder;
+                    if (carried >= config.rate_hz)
+                    {
+                        carried -= config.rate_hz;
+                        deadline_us += 1;
+                    }
+                    wait_until(deadline_us, poll, param);
+                }
+                else if (poll && (result.updates % POLL_UPDATES == 0))
+                {
+                    poll(param);
+                }
+
+                if ((config.duration_ms > 0) && (time_us_64() >= end_us))
+                    break;
+            }
+
+            // Back to the carrier.  If the output was turned off to stop
+            // the run it stays off.
+            //
+            result.stopped = stop_;
+            dds_.set_registers(center, phase_register, dds_.get_enabled());
+            dds_.commit();
+
+            result.rate_hz = get_rate_hz();
+            result.low_hz = dds_.register_frequency(lowest_);
+            result.high_hz = dds_.register_frequency(highest_);
+            return result;
+        }
+
+        /**
+         * @brief  Stop a running dither.  Safe to call from a poll
+         *         callback.
+         */
+        auto stop() -> void
+        {
+            stop_ = true;
+        }
+
+        /**
+         * @brief  Return the updates put out so far in the
+         *         current or last run.
+         */
+        auto get_progress() -> uint32_t
+        {
+            return progress_;
+        }
+
+        /**
+         * @brief  Return the updates a second the current run has
+         *         achieved so far.
+         */
+        auto get_rate_hz() -> uint32_t
+        {
+            uint64_t elapsed_us = time_us_64() - start_us_;
+            return (elapsed_us > 0)
+                ? static_cast<uint32_t>(static_cast<uint64_t>(progress_) * US_PER_S / elapsed_us) : 0;
+        }
+
+        /**
+         * @brief  Return half the spread of the frequencies put out so
+         *         far in the current or last run, in Hz.
+         */
+        auto get_deviation_hz() -> uint32_t
+        {
+            return (progress_ > 0) ? dds_.register_frequency(highest_ - lowest_) / 2 : 0;
+        }
+
+    private:
+        static const uint32_t US_PER_S = 1000000;
+        static const uint64_t POLL_MARGIN_US = 20;
+        static const uint32_t POLL_UPDATES = 64;
+
+        /**
+         * @brief  Wait for a deadline.  The input is polled until the
+         *         deadline is close, then the last few microseconds are
+         *         spun out so the next update goes out on time.
+         */
+        auto wait_until(uint64_t deadline_us, void (*poll)(void*), void* param) -> void
+        {
+            while (!stop_ && (time_us_64() + POLL_MARGIN_US < deadline_us))
+            {
+                if (poll)
+                    poll(param);
+            }
+            while (!stop_ && (time_us_64() < deadline_us))
+            {
+            }
+        }
+
+        AD9850& dds_;                   // See constructor for these value definitions.
+
+        volatile bool stop_ = false;
+        uint32_t progress_ = 0;         // Updates put out by the current run.
+        uint64_t start_us_ = 0;         // When the current run started.
+        uint32_t lowest_ = UINT32_MAX;  // Lowest and highest words put out by it.
+        uint32_t highest_ = 0;
+        uint32_t lfsr_ = 0x2545f491;    // Carried between runs, so each run differs.
+    };
+}
@@ -0,0 +1,442 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "AD9850.hpp"
+
+// Compressed frequency table, for chirps and hop lists too long to keep
+// as one word per point.  Points are AD9850 tuning words, split into
+// blocks.  Each block has an anchor (its first word) and a step with a
+// 16 bit fraction, and every later word is the one before plus the step
+// plus a signed delta.  The fraction lets a straight line through
+// rounded tuning words be followed exactly.  The deltas of a block are
+// all the same width, 0, 1, 2 or 4 bytes, the narrowest that holds
+// them, so a linear chirp costs nothing per point and a smooth one a
+// byte.  Anchors are kept in an index at the front, so any point can be
+// reached by decoding at most one block.
+//
+// Layout, little endian:
+//
+//   header      16 bytes: "SGFT", version, points per block, points,
+//               size of the whole table in bytes.
+//   index       16 bytes per block: anchor, step, step fraction and the
+//               fraction's starting value (1/65536ths), and the offset
+//               of the deltas from the start of the table (24 bits)
+//               with the delta width above it.
+//   deltas      Points per block - 1 deltas for each block, the last
+//               block's possibly fewer.  Each block starts on a 4 byte
+//               boundary.
+//
+// Tables are built on the host by python/siggen-table and sent in
+// base64 pieces.  Tuning words wrap, so steps and deltas are taken
+// modulo 2^32.
+//
+namespace
+{
+    // Result of a run.
+    //
+    using table_result_t = struct {
+        uint32_t points;                // Points played.
+        bool stopped;                   // Stopped before the end.
+    };
+
+    class FrequencyTable
+    {
+    public:
+        static const size_t MAX_BYTES = 128 * 1024;
+        static const uint32_t MAX_BLOCK_POINTS = 256;
+
+        /**
+         * @brief  Constructor
+         * @param  dds  DDS the table is played on.
+         */
+        FrequencyTable(AD9850& dds)
+            : dds_(dds)
+        {
+        }
+
+        /**
+         * @brief  Add received table bytes, in base64.
+         * @param  text    Base64 text.
+         * @param  append  Add to the bytes received so far instead of
+         *                 starting a new table.
+         * @return An error message, or null.  The table is checked once
+         *         the size given in its header has arrived.  After an
+         *         error, pieces are refused until a new table is started,
+         *         so the rest of a broken upload can't be taken as one.
+         */
+        auto load(const char* text, bool append) -> const char*
+        {
+            if (!append)
+            {
+                received_ = 0;
+                valid_ = false;
+                failed_ = false;
+            }
+            else if (valid_)
+            {
+                return "Table already complete";
+            }
+            else if (failed_)
+            {
+                return "Table load failed";
+            }
+
+            // Four characters make three bytes.  Padding can only come
+            // at the end.
+            //
+            uint32_t group = 0;
+            int count = 0;
+            int padding = 0;
+            for (; *text; ++text)
+            {
+                int value = base64_value(*text);
+                if (*text == '=')
+                {
+                    ++padding;
+                    value = 0;
+                }
+                else if ((value < 0) || padding)
+                    return fail("Error decoding table");
+
+                group = (group << 6) | value;
+                if (++count < 4)
+                    continue;
+
+                if (received_ + 3 - padding > MAX_BYTES)
+                    return fail("Table too big");
+                for (int shift = 16; shift >= 8 * padding; shift -= 8)
+                    data_[received_++] = static_cast<uint8_t>(group >> shift);
+                group = 0;
+                count = 0;
+            }
+            if (count != 0)
+                return fail("Error decoding table");
+
+            if ((received_ >= sizeof(table_header_t)) && (received_ >= header().size))
+                return check();
+            return nullptr;
+        }
+
+        /**
+         * @brief  Return the number of table bytes received.
+         */
+        auto get_bytes() -> uint32_t
+        {
+            return received_;
+        }
+
+        /**
+         * @brief  Return the number of points, or 0 if the table isn't
+         *         complete.
+         */
+        auto get_points() -> uint32_t
+        {
+            return valid_ ? header().points : 0;
+        }
+
+        /**
+         * @brief  Move to a point, ready for next().
+         * @param  point  Point number.  Must be less than get_points().
+         */
+        auto seek(uint32_t point) -> void
+        {
+            uint32_t block_points = header().block_points;
+            decode_block(point / block_points);
+            position_ = point % block_points;
+        }
+
+        /**
+         * @brief  Return the tuning word at the current point and move to
+         *         the next.  Past the last point it starts over.
+         */
+        auto next() -> uint32_t
+        {
+            if (position_ == block_length_)
+            {
+                uint32_t block = block_ + 1;
+                decode_block((block < block_count()) ? block : 0);
+                position_ = 0;
+            }
+            return words_[position_++];
+        }
+
+        /**
+         * @brief  Play points of a complete table, one every interval,
+         *         at the live phase and output enable.
+         * @param  start        First point.
+         * @param  count        Points to play.  Wraps past the end.
+         * @param  interval_us  Time between points, or 0 for as fast as
+         *                      the AD9850 can be written.
+         * @param  poll   Called while waiting, and every so many points
+         *                if not waiting, so the run can be stopped; may
+         *                be null.
+         * @param  param  Passed to poll.
+         */
+        auto run(uint32_t start, uint32_t count, uint32_t interval_us,
+                 void (*poll)(void*), void* param) -> table_result_t
+        {
+            stop_ = false;
+            uint32_t phase_register = dds_.get_phase_register();
+            bool enable = dds_.get_enabled();
+
+            // Each point is preloaded while the one before it plays, so
+            // only the FQ_UD edge comes after the deadline.
+            //
+            table_result_t result = { 0, false };
+            progress_ = 0;
+            uint64_t deadline_us = time_us_64();
+            seek(start);
+            dds_.restart_marker();
+            dds_.preload(next(), phase_register, enable);
+            while ((result.points < count) && !stop_)
+            {
+                dds_.fire();
+                result.points += 1;
+                progress_ = result.points;
+                if (result.points < count)
+                    dds_.preload(next(), phase_register, enable);
+
+                if (interval_us > 0)
+                {
+                    deadline_us += interval_us;
+                    wait_until(deadline_us, poll, param);
+                }
+                else if (poll && (result.points % POLL_POINTS == 0))
+                {
+                    poll(param);
+                }
+            }
+
+            result.stopped = stop_;
+            return result;
+        }
+
+        /**
+         * @brief  Stop a running table.  Safe to call from a poll
+         *         callback.
+         */
+        auto stop() -> void
+        {
+            stop_ = true;
+        }
+
+        /**
+         * @brief  Return the points played so far in the
+         *         current or last run.
+         */
+        auto get_progress() -> uint32_t
+        {
+            return progress_;
+        }
+
+    private:
+        static constexpr const char* TABLE_MAGIC = "SGFT";
+        static const uint16_t TABLE_VERSION = 1;
+        static const uint64_t POLL_MARGIN_US = 20;
+        static const uint32_t POLL_POINTS = 64;
+        static const uint32_t OFFSET_MASK = 0x00ffffff;
+        static const uint32_t WIDTH_SHIFT = 24;
+
+        using table_header_t = struct {
+            char magic[4];                  // "SGFT"
+            uint16_t version;
+            uint16_t block_points;          // Points per block.
+            uint32_t points;
+            uint32_t size;                  // Bytes in the whole table.
+        };
+
+        using table_block_t = struct {
+            uint32_t anchor;                // First tuning word.
+            uint32_t step;                  // Added for every later word.
+            uint16_t fraction;              // Step fraction, in 1/65536ths.
+            uint16_t fraction_start;        // Fraction carried in.
+            uint32_t location;              // Delta offset | width << 24.
+        };
+
+        static_assert(sizeof(table_header_t) == 16, "table header layout");
+        static_assert(sizeof(table_block_t) == 16, "table block layout");
+
+        auto header() -> const table_header_t&
+        {
+            return *reinterpret_cast<const table_header_t*>(data_);
+        }
+
+        auto block_count() -> uint32_t
+        {
+            return (header().points + header().block_points - 1) / header().block_points;
+        }
+
+        auto block(uint32_t index) -> const table_block_t&
+        {
+            return reinterpret_cast<const table_block_t*>(data_ + sizeof(table_header_t))[index];
+        }
+
+        /**
+         * @brief  Check a table once it has all arrived.  Every block's
+         *         deltas must lie inside it, aligned for their width, so
+         *         decoding needs no checks.
+         * @return An error message, or null.
+         */
+        auto check() -> const char*
+        {
+            const table_header_t& table = header();
+            if (memcmp(table.magic, TABLE_MAGIC, sizeof(table.magic)) ||
+                (table.version != TABLE_VERSION) ||
+                (table.block_points == 0) || (table.block_points > MAX_BLOCK_POINTS) ||
+                (table.points == 0) || (table.size != received_))
+                return fail("Bad table header");
+
+            uint32_t blocks = block_count();
+            if (blocks > (received_ - sizeof(table_header_t)) / sizeof(table_block_t))
+                return fail("Bad table header");
+
+            // Deltas come after the index, so a block can't decode the
+            // header or index as deltas.
+            //
+            uint32_t deltas_start = sizeof(table_header_t) + blocks * sizeof(table_block_t);
+
+            for (uint32_t index = 0; index < blocks; ++index)
+            {
+                const table_block_t& entry = block(index);
+                uint32_t deltas = block_points(index) - 1;
+                uint32_t offset = entry.location & OFFSET_MASK;
+                uint32_t width = entry.location >> WIDTH_SHIFT;
+                if (((width != 0) && (width != 1) && (width != 2) && (width != 4)) ||
+                    (offset % 4 != 0) || (offset < deltas_start) || (offset > received_) ||
+                    (deltas * width > received_ - offset))
+                    return fail("Bad table block");
+            }
+
+            valid_ = true;
+            seek(0);
+            return nullptr;
+        }
+
+        /**
+         * @brief  Drop the bytes received and refuse further pieces
+         *         until a new table is started.
+         * @param  error  Error message to return.
+         */
+        auto fail(const char* error) -> const char*
+        {
+            received_ = 0;
+            failed_ = true;
+            return error;
+        }
+
+        /**
+         * @brief  Return the number of points in a block.
+         */
+        auto block_points(uint32_t index) -> uint32_t
+        {
+            uint32_t first = index * header().block_points;
+            uint32_t left = header().points - first;
+            return (left < header().block_points) ? left : header().block_points;
+        }
+
+        /**
+         * @brief  Decode a block's tuning words into words_.  One loop per
+         *         delta width keeps the width test out of the loop.
+         */
+        auto decode_block(uint32_t index) -> void
+        {
+            const table_block_t& entry = block(index);
+            const uint8_t* deltas = data_ + (entry.location & OFFSET_MASK);
+            uint32_t length = block_points(index);
+
+            words_[0] = entry.anchor;
+            switch (entry.location >> WIDTH_SHIFT)
+            {
+                case 0:
+                    decode_deltas(static_cast<const int8_t*>(nullptr), entry, length);
+                    break;
+                case 1:
+                    decode_deltas(reinterpret_cast<const int8_t*>(deltas), entry, length);
+                    break;
+                case 2:
+                    decode_deltas(reinterpret_cast<const int16_t*>(deltas), entry, length);
+                    break;
+                case 4:
+                    decode_deltas(reinterpret_cast<const int32_t*>(deltas), entry, length);
+                    break;
+            }
+
+            block_ = index;
+            block_length_ = length;
+        }
+
+        /**
+         * @brief  Decode the words after a block's anchor.
+         * @param  deltas  The block's deltas, or null if they're all 0.
+         */
+        template <typename Delta>
+        auto decode_deltas(const Delta* deltas, const table_block_t& entry, uint32_t length) -> void
+        {
+            uint32_t word = entry.anchor;
+            uint32_t fraction = entry.fraction_start;
+            for (uint32_t i = 1; i < length; ++i)
+            {
+                fraction += entry.fraction;
+                word += entry.step + (fraction >> 16);
+                fraction &= 0xffff;
+                if (deltas)
+                    word += static_cast<uint32_t>(deltas[i - 1]);
+                words_[i] = word;
+            }
+        }
+
+        /**
+         * @brief  Return the value of a base64 character, or -1.
+         */
+        static auto base64_value(char character) -> int
+        {
+            if ((character >= 'A') && (character <= 'Z'))
+                return character - 'A';
+            if ((character >= 'a') && (character <= 'z'))
+                return character - 'a' + 26;
+            if ((character >= '0') && (character <= '9'))
+                return character - '0' + 52;
+            if (character == '+')
+                return 62;
+            if (character == '/')
+                return 63;
+            return -1;
+        }
+
+        /**
+         * @brief  Wait for a deadline.  The input is polled until the
+         *         deadline is close, then the last few microseconds are
+         *         spun out so the next point goes out on time.
+         */
+        auto wait_until(uint64_t deadline_us, void (*poll)(void*), void* param) -> void
+        {
+            while (!stop_ && (time_us_64() + POLL_MARGIN_US < deadline_us))
+            {
+                if (poll)
+                    poll(param);
+            }
+            while (!stop_ && (time_us_64() < deadline_us))
+            {
+            }
+        }
+
+        AD9850& dds_;                   // See constructor for these value definitions.
+
+        volatile bool stop_ = false;
+        uint32_t progress_ = 0;         // Points played by the current run.
+        alignas(4) uint8_t data_[MAX_BYTES] { };
+        uint32_t received_ = 0;         // Bytes of the table received.
+        bool valid_ = false;            // Whole table received and checked.
+        bool failed_ = false;           // Error since the table was started.
+
+        uint32_t words_[MAX_BLOCK_POINTS] { };  // Decoded block.
+        uint32_t block_ = 0;
+        uint32_t block_length_ = 0;
+        uint32_t position_ = 0;         // Next word in words_.
+    };
+}
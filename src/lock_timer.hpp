@@ -0,0 +1,410 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/pio_instructions.h"
+
+#include "AD9850.hpp"
+#include "command_channel.hpp"
+
+// Settling and lock time measurement, for PLLs and filters on the bench.
+// The DDS is stepped between pairs of frequencies with commit(), and a
+// PIO state machine times from the FQ_UD edge to the device under test
+// asserting its lock or ready output.  Both pins go through the same
+// input synchronizer, so the count is the time between the two edges,
+// to two system clocks (16 ns).  The results go back as a binary block
+// with the min/avg/max and a histogram for each pair.
+//
+namespace
+{
+    // A frequency step.
+    //
+    using lock_step_t = struct {
+        uint32_t from_hz;
+        uint32_t to_hz;
+    };
+
+    // Measurement parameters.
+    //
+    using lock_config_t = struct {
+        std::vector<lock_step_t> steps { };
+        uint32_t repeat = 10;           // Steps timed per pair.
+        uint32_t dwell_us = 1000;       // Time at the from frequency before each step.
+        uint32_t timeout_us = 10000;    // Longest wait for lock.
+        uint32_t bin_ns = 1000;         // Histogram bin width.
+        bool edge = false;              // Wait for lock to drop and come back.
+        bool active_low = false;        // Lock output is low when locked.
+    };
+
+    // Result of a run.
+    //
+    using lock_result_t = struct {
+        uint32_t steps;                 // Pairs measured.
+        uint32_t timeouts;              // Steps that didn't lock, over all pairs.
+        bool stopped;                   // Stopped before every pair was measured.
+    };
+
+    const uint32_t LOCK_BINS = 32;
+
+    // Results for one pair, 160 bytes, little-endian on the wire.  The
+    // times are from the FQ_UD edge, in ns.
+    //
+    using lock_record_t = struct {
+        uint32_t from_hz;
+        uint32_t to_hz;
+        uint32_t locked;                // Steps that locked within the timeout.
+        uint32_t timeouts;              // Steps that didn't.
+        uint32_t min_ns;
+        uint32_t avg_ns;
+        uint32_t max_ns;
+        uint32_t reserved;
+        uint32_t histogram[LOCK_BINS];  // Steps by lock time, bin_ns wide; the last bin takes the rest.
+    };
+
+    // Header sent ahead of the records.
+    //
+    using lock_header_t = struct {
+        char magic[4];                  // "SGLK"
+        uint16_t version;
+        uint16_t record_size;
+        uint32_t count;                 // Records that follow.
+        uint32_t bin_ns;                // Histogram bin width.
+    };
+
+    class LockTimer
+    {
+    public:
+        static const uint32_t MAX_STEPS = 16;
+        static const uint32_t MAX_REPEAT = 10000;
+        static const uint32_t MAX_TIME_US = 1000000;
+
+        /**
+         * @brief  Constructor
+         * @param  dds    DDS to step.
+         * @param  pio    PIO block to run the state machine on.
+         * @param  lock   Lock input GPIO from the device under test.
+         * @param  fq_ud  AD9850 FQ_UD GPIO, watched as an input.
+         */
+        LockTimer(AD9850& dds, PIO pio, uint lock, uint fq_ud)
+            : dds_(dds)
+            , pio_(pio)
+            , lock_(lock)
+            , fq_ud_(fq_ud)
+        {
+            // The state machine takes a count and an entry point, waits
+            // for FQ_UD to rise, then counts x down every two cycles
+            // until the lock input is high and pushes what is left.  A
+            // count that runs out pushes 0xffffffff.  In edge mode it
+            // first waits, counting, for the input to go low.
+            //
+            instructions_[0] = pio_encode_pull(false, true);
+            instructions_[1] = pio_encode_mov(pio_x, pio_osr);
+            instructions_[2] = pio_encode_pull(false, true);
+            instructions_[3] = pio_encode_wait_gpio(false, fq_ud_);
+            instructions_[4] = pio_encode_wait_gpio(true, fq_ud_);
+            instructions_[5] = pio_encode_out(pio_pc, 5);
+            instructions_[EDGE_ENTRY] = pio_encode_jmp_pin(8);
+            instructions_[7] = pio_encode_jmp(LEVEL_ENTRY);
+            instructions_[8] = pio_encode_jmp_x_dec(EDGE_ENTRY);
+            instructions_[9] = pio_encode_jmp(12);
+            instructions_[LEVEL_ENTRY] = pio_encode_jmp_pin(12);
+            instructions_[11] = pio_encode_jmp_x_dec(LEVEL_ENTRY);
+            instructions_[12] = pio_encode_mov(pio_isr, pio_x);
+            instructions_[13] = pio_encode_push(false, true);
+
+            pio_program_t program = { };
+            program.instructions = instructions_;
+            program.length = PROGRAM_LEN;
+            program.origin = -1;
+
+            sm_ = pio_claim_unused_sm(pio_, true);
+            offset_ = pio_add_program(pio_, &program);
+
+            gpio_init(lock_);
+            gpio_set_dir(lock_, GPIO_IN);
+
+            pio_sm_config config = pio_get_default_sm_config();
+            sm_config_set_wrap(&config, offset_, offset_ + PROGRAM_LEN - 1);
+            sm_config_set_jmp_pin(&config, lock_);
+            sm_config_set_out_shift(&config, true, false, 32);
+            sm_config_set_clkdiv(&config, 1.0f);
+            pio_sm_init(pio_, sm_, offset_, &config);
+            pio_sm_set_enabled(pio_, sm_, true);
+        }
+
+        /**
+         * @brief  Read steps written as from:to pairs, in Hz, separated by
+         *         blanks or commas, e.g. "10000000:10100000 10100000:10000000".
+         * @param  text   The steps.
+         * @param  steps  Set to the steps read.
+         * @return false if the text isn't a list of pairs.
+         */
+        static auto parse_steps(const char* text, std::vector<lock_step_t>& steps) -> bool
+        {
+            steps.clear();
+            while (*text)
+            {
+                if ((*text == ' ') || (*text == ',') || (*text == '\t'))
+                {
+                    ++text;
+                    continue;
+                }
+
+                lock_step_t step;
+                if (!parse_number(text, step.from_hz) || (*text++ != ':') ||
+                    !parse_number(text, step.to_hz) || (steps.size() == MAX_STEPS))
+                    return false;
+                steps.push_back(step);
+            }
+            return true;
+        }
+
+        /**
+         * @brief  Return an error message if a measurement can't be run,
+         *         or null if it can.
+         */
+        static auto check(const lock_config_t& config) -> const char*
+        {
+            if (config.steps.empty() || (config.steps.size() > MAX_STEPS))
+                return "Lock steps out of range";
+            for (const lock_step_t& step : config.steps)
+            {
+                if ((step.from_hz > AD9850::OSC_HZ / 2) || (step.to_hz > AD9850::OSC_HZ / 2))
+                    return "Lock step frequency out of range";
+            }
+            if ((config.repeat == 0) || (config.repeat > MAX_REPEAT))
+                return "Lock repeat out of range";
+            if ((config.dwell_us > MAX_TIME_US) || (config.timeout_us == 0) || (config.timeout_us > MAX_TIME_US))
+                return "Lock time out of range";
+            if (config.bin_ns == 0)
+                return "Lock histogram bin out of range";
+            return nullptr;
+        }
+
+        /**
+         * @brief  Time the steps.  The output is enabled for the run and
+         *         left at the last step's to frequency.
+         * @param  config  Measurement parameters, already checked.
+         * @param  poll    Called while waiting, so input can be watched and
+         *                 the run stopped; may be null.
+         * @param  param   Passed to poll.
+         */
+        auto run(const lock_config_t& config, void (*poll)(void*), void* param) -> lock_result_t
+        {
+            stop_ = false;
+            count_ = 0;
+            bin_ns_ = config.bin_ns;
+            gpio_set_inover(lock_, config.active_low ? GPIO_OVERRIDE_INVERT : GPIO_OVERRIDE_NORMAL);
+
+            uint32_t cycles_per_us = clock_get_hz(clk_sys) / US_PER_S;
+            uint32_t timeout_count = static_cast<uint32_t>(
+                static_cast<uint64_t>(config.timeout_us) * cycles_per_us / LOOP_CYCLES);
+            uint32_t entry = offset_ + (config.edge ? EDGE_ENTRY : LEVEL_ENTRY);
+
+            lock_result_t result = { 0, 0, false };
+            dds_.restart_marker();
+            dds_.enable_out(true);
+            for (const lock_step_t& step : config.steps)
+            {
+                lock_record_t& record = records_[count_];
+                record = lock_record_t { };
+                record.from_hz = step.from_hz;
+                record.to_hz = step.to_hz;
+                record.min_ns = UINT32_MAX;
+                uint64_t total_ns = 0;
+
+                for (uint32_t i = 0; (i < config.repeat) && !stop_; ++i)
+                {
+                    dds_.set_frequency(step.from_hz);
+                    dds_.commit();
+                    wait_until(time_us_64() + config.dwell_us, poll, param);
+                    if (stop_)
+                        break;
+
+                    // Start the state machine waiting for the edge, then
+                    // step.
+                    //
+                    pio_sm_put(pio_, sm_, timeout_count);
+                    pio_sm_put(pio_, sm_, entry);
+                    dds_.set_frequency(step.to_hz);
+                    dds_.commit();
+
+                    uint64_t deadline_us = time_us_64() + config.timeout_us + TIMEOUT_MARGIN_US;
+                    while (pio_sm_is_rx_fifo_empty(pio_, sm_) && !stop_ && (time_us_64() < deadline_us))
+                    {
+                        if (poll)
+                            poll(param);
+                    }
+
+                    // A run stopped mid-step, or an edge the state machine
+                    // didn't see, leaves it waiting; start it over.
+                    //
+                    if (pio_sm_is_rx_fifo_empty(pio_, sm_))
+                    {
+                        restart();
+                        if (stop_)
+                            break;
+                        record.timeouts += 1;
+                        continue;
+                    }
+
+                    uint32_t left = pio_sm_get(pio_, sm_);
+                    if (left == TIMED_OUT)
+                    {
+                        record.timeouts += 1;
+                        continue;
+                    }
+                    uint32_t ns = static_cast<uint32_t>(
+                        static_cast<uint64_t>(timeout_count - left) * LOOP_CYCLES * 1000 / cycles_per_us);
+                    add(record, ns);
+                    total_ns += ns;
+                }
+
+                if (record.locked > 0)
+                    record.avg_ns = static_cast<uint32_t>(total_ns / record.locked);
+                else
+                    record.min_ns = 0;
+                result.timeouts += record.timeouts;
+                if (stop_)
+                    break;
+                count_ += 1;
+            }
+
+            result.steps = count_;
+            result.stopped = stop_;
+            return result;
+        }
+
+        /**
+         * @brief  Stop a running measurement.  Safe to call from a poll
+         *         callback.
+         */
+        auto stop() -> void
+        {
+            stop_ = true;
+        }
+
+        /**
+         * @brief  Return the pairs measured so far in the
+         *         current or last run.
+         */
+        auto get_progress() -> uint32_t
+        {
+            return count_;
+        }
+
+        /**
+         * @brief  Return the size of the block write_results() will write.
+         */
+        auto results_size() -> size_t
+        {
+            return sizeof(lock_header_t) + count_ * sizeof(lock_record_t);
+        }
+
+        /**
+         * @brief  Write the results of the last run to a channel.
+         * @param  channel  Channel to write to.
+         */
+        auto write_results(CommandChannel& channel) -> void
+        {
+            lock_header_t header = { { 'S', 'G', 'L', 'K' }, LOCK_VERSION,
+                sizeof(lock_record_t), count_, bin_ns_ };
+
+            channel.begin_binary_block();
+            channel.write_binary(&header, sizeof(header));
+            channel.write_binary(records_, count_ * sizeof(lock_record_t));
+            channel.end_binary_block();
+        }
+
+    private:
+        static const uint PROGRAM_LEN = 14;
+        static const uint EDGE_ENTRY = 6;
+        static const uint LEVEL_ENTRY = 10;
+        static const uint32_t US_PER_S = 1000000;
+        static const uint32_t LOOP_CYCLES = 2;          // Per count of x.
+        static const uint32_t TIMED_OUT = 0xffffffff;
+        static const uint64_t TIMEOUT_MARGIN_US = 1000;
+        static const uint16_t LOCK_VERSION = 1;
+
+        static_assert(sizeof(lock_record_t) == 160, "lock record layout");
+        static_assert(sizeof(lock_header_t) == 16, "lock header layout");
+
+        /**
+         * @brief  Read a decimal number, leaving text after it.
+         * @return false if there is no number, or it overflows.
+         */
+        static auto parse_number(const char*& text, uint32_t& value) -> bool
+        {
+            if ((*text < '0') || (*text > '9'))
+                return false;
+
+            uint64_t number = 0;
+            for (; (*text >= '0') && (*text <= '9'); ++text)
+            {
+                number = number * 10 + (*text - '0');
+                if (number > UINT32_MAX)
+                    return false;
+            }
+            value = static_cast<uint32_t>(number);
+            return true;
+        }
+
+        /**
+         * @brief  Add a lock time to a pair's results.
+         */
+        auto add(lock_record_t& record, uint32_t ns) -> void
+        {
+            record.locked += 1;
+            record.min_ns = (ns < record.min_ns) ? ns : record.min_ns;
+            record.max_ns = (ns > record.max_ns) ? ns : record.max_ns;
+            uint32_t bin = ns / bin_ns_;
+            record.histogram[(bin < LOCK_BINS) ? bin : LOCK_BINS - 1] += 1;
+        }
+
+        /**
+         * @brief  Wait for a deadline, polling the input.
+         */
+        auto wait_until(uint64_t deadline_us, void (*poll)(void*), void* param) -> void
+        {
+            while (!stop_ && (time_us_64() < deadline_us))
+            {
+                if (poll)
+                    poll(param);
+            }
+        }
+
+        /**
+         * @brief  Return the state machine to the top of the program with
+         *         empty FIFOs.
+         */
+        auto restart() -> void
+        {
+            pio_sm_set_enabled(pio_, sm_, false);
+            pio_sm_clear_fifos(pio_, sm_);
+            pio_sm_restart(pio_, sm_);
+            pio_sm_exec(pio_, sm_, pio_encode_jmp(offset_));
+            pio_sm_set_enabled(pio_, sm_, true);
+        }
+
+        AD9850& dds_;                   // See constructor for these value definitions.
+        PIO pio_;
+        uint lock_;
+        uint fq_ud_;
+
+        uint sm_ = 0;                   // State machine and program location.
+        uint offset_ = 0;
+        uint16_t instructions_[PROGRAM_LEN] { };
+
+        volatile bool stop_ = false;
+        uint32_t count_ = 0;            // Pairs measured by the last run.
+        uint32_t bin_ns_ = 1000;
+        lock_record_t records_[MAX_STEPS] { };
+    };
+}
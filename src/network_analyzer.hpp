@@ -0,0 +1,224 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+#include "AD9850.hpp"
+#include "adc_capture.hpp"
+#include "command_channel.hpp"
+
+// Scalar network analyzer.  Steps the DDS through a sweep and, after a
+// settle time following each FQ_UD, averages a block of ADC samples from
+// a detector on the device under test.  The results go back as a binary
+// block of (frequency, magnitude) pairs.
+//
+namespace
+{
+    // Sweep parameters.
+    //
+    using sweep_config_t = struct {
+        uint32_t start_hz = 0;
+        uint32_t stop_hz = 0;
+        uint32_t points = 0;
+        uint32_t settle_us = 100;       // Wait after each FQ_UD.
+        uint32_t samples = 64;          // ADC samples averaged per point.
+    };
+
+    // One result, 8 bytes, little-endian on the wire.
+    //
+    using sweep_point_t = struct {
+        uint32_t frequency_hz;
+        uint16_t magnitude;             // Average ADC reading, in 1/16 LSB.
+        uint16_t reserved;
+    };
+
+    // Header sent ahead of the results.
+    //
+    using sweep_header_t = struct {
+        char magic[4];                  // "SGSW"
+        uint16_t version;
+        uint16_t record_size;
+        uint32_t count;                 // Points that follow.
+        uint32_t samples;               // Samples averaged per point.
+    };
+
+    class NetworkAnalyzer
+    {
+    public:
+        static const uint32_t MAX_POINTS = 1024;
+        static const uint32_t MAX_SAMPLES = 4096;
+
+        /**
+         * @brief  Constructor
+         * @param  dds  DDS to sweep.
+         * @param  adc  ADC capture from the detector.
+         */
+        NetworkAnalyzer(AD9850& dds, AdcCapture& adc)
+            : dds_(dds)
+            , adc_(adc)
+        {
+        }
+
+        /**
+         * @brief  Return an error message if a sweep can't be run, or
+         *         null if it can.
+         */
+        static auto check(const sweep_config_t& config) -> const char*
+        {
+            if ((config.start_hz > AD9850::OSC_HZ / 2) || (config.stop_hz > AD9850::OSC_HZ / 2))
+                return "Sweep frequency out of range";
+            if ((config.points == 0) || (config.points > MAX_POINTS))
+                return "Sweep points out of range";
+            if ((config.samples == 0) || (config.samples > MAX_SAMPLES))
+                return "Sweep samples out of range";
+            return nullptr;
+        }
+
+        /**
+         * @brief  Run a sweep.  The output is enabled for the sweep and
+         *         left at the last point.
+         * @param  config  Sweep parameters, already checked.
+         * @param  poll    Called while waiting, so input can be watched and
+         *                 the sweep stopped; may be null.
+         * @param  param   Passed to poll.
+         * @return The number of points measured.  Fewer than asked for if
+         *         the sweep was stopped.
+         */
+        auto run(const sweep_config_t& config, void (*poll)(void*), void* param) -> uint32_t
+        {
+            stop_ = false;
+            count_ = 0;
+            samples_ = config.samples;
+
+            // Each point is preloaded while the one before it is sampled,
+            // so only the FQ_UD edge starts its settling time.
+            //
+            uint32_t phase_register = dds_.get_phase_register();
+            dds_.restart_marker();
+            dds_.preload(dds_.tuning_word(point_frequency(config, 0)), phase_register, true);
+            for (uint32_t point = 0; (point < config.points) && !stop_; ++point)
+            {
+                uint32_t frequency_hz = point_frequency(config, point);
+                dds_.fire();
+
+                uint64_t settled_us = time_us_64() + config.settle_us;
+                while ((time_us_64() < settled_us) && !stop_)
+                {
+                    if (poll)
+                        poll(param);
+                }
+
+                adc_.start(samples_buffer_, config.samples);
+                if (point + 1 < config.points)
+                    dds_.preload(dds_.tuning_word(point_frequency(config, point + 1)), phase_register, true);
+                while (adc_.is_busy())
+                {
+                    if (poll)
+                        poll(param);
+                    if (stop_)
+                    {
+                        adc_.stop();
+                        break;
+                    }
+                }
+                if (stop_)
+                    break;
+
+                results_[count_].frequency_hz = frequency_hz;
+                results_[count_].magnitude = average(samples_buffer_, config.samples);
+                results_[count_].reserved = 0;
+                count_ += 1;
+            }
+
+            return count_;
+        }
+
+        /**
+         * @brief  Stop a running sweep.  Safe to call from a poll callback.
+         */
+        auto stop() -> void
+        {
+            stop_ = true;
+        }
+
+        /**
+         * @brief  Return the points measured so far in the
+         *         current or last run.
+         */
+        auto get_progress() -> uint32_t
+        {
+            return count_;
+        }
+
+        /**
+         * @brief  Return the size of the block write_results() will write.
+         */
+        auto results_size() -> size_t
+        {
+            return sizeof(sweep_header_t) + count_ * sizeof(sweep_point_t);
+        }
+
+        /**
+         * @brief  Write the results of the last sweep to a channel.
+         * @param  channel  Channel to write to.
+         */
+        auto write_results(CommandChannel& channel) -> void
+        {
+            sweep_header_t header = { { 'S', 'G', 'S', 'W' }, SWEEP_VERSION,
+                sizeof(sweep_point_t), count_, samples_ };
+
+            channel.begin_binary_block();
+            channel.write_binary(&header, sizeof(header));
+            channel.write_binary(results_, count_ * sizeof(sweep_point_t));
+            channel.end_binary_block();
+        }
+
+        /**
+         * @brief  Return the frequency of a sweep point, in Hz.
+         * @param  config  Sweep parameters.
+         * @param  point   Point index.
+         */
+        static auto point_frequency(const sweep_config_t& config, uint32_t point) -> uint32_t
+        {
+            if (config.points < 2)
+                return config.start_hz;
+
+            int64_t span = static_cast<int64_t>(config.stop_hz) - config.start_hz;
+            return static_cast<uint32_t>(config.start_hz + span * point / (config.points - 1));
+        }
+
+        /**
+         * @brief  Average a block of 12-bit samples.
+         * @param  samples  The samples.
+         * @param  count    Number of samples, at least 1.
+         * @return The average in 1/16 LSB, keeping the resolution gained
+         *         by averaging.
+         */
+        static auto average(const uint16_t* samples, uint32_t count) -> uint16_t
+        {
+            uint32_t sum = 0;
+            for (uint32_t i = 0; i < count; ++i)
+                sum += samples[i] & ADC_MASK;
+            return static_cast<uint16_t>((static_cast<uint64_t>(sum) * 16 + count / 2) / count);
+        }
+
+    private:
+        static const uint16_t SWEEP_VERSION = 1;
+        static const uint16_t ADC_MASK = 0x0fff;
+
+        static_assert(sizeof(sweep_point_t) == 8, "sweep point layout");
+        static_assert(sizeof(sweep_header_t) == 16, "sweep header layout");
+
+        AD9850& dds_;                   // See constructor for these value definitions.
+        AdcCapture& adc_;
+
+        volatile bool stop_ = false;
+        uint32_t count_ = 0;            // Points measured by the last sweep.
+        uint32_t samples_ = 0;
+
+        uint16_t samples_buffer_[MAX_SAMPLES] { };
+        sweep_point_t results_[MAX_POINTS] { };
+    };
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/pio_instructions.h"
+
+#include "AD9850.hpp"
+
+// Pulsed carrier, for radar-style receiver tests.  The live frequency is
+// switched on and off with the AD9850's power-down bit, by a PIO state
+// machine that takes over W_CLK, DATA and FQ_UD: it shifts in the on (or
+// off) word, counts out the time to the edge, and pulses FQ_UD.  The two
+// words and the two counts are worked out before the run and fed to the
+// state machine from a 16-byte ring by DMA, so the edges are placed to
+// the system clock (8 ns) and the core only watches for the end.
+//
+// An optional gate input holds each on edge until the gate is active,
+// for pulses only while an external gate is up, or lined up with it.
+//
+namespace
+{
+    // Pulse parameters.
+    //
+    using pulse_config_t = struct {
+        uint32_t width_ns = 0;          // On time.
+        uint32_t interval_ns = 0;       // On edge to on edge.
+        uint32_t count = 0;             // Pulses in the burst, or 0 to run until stopped.
+        bool gate = false;              // Hold on edges until the gate input is active.
+        bool gate_active_low = false;
+    };
+
+    // Result of a run.
+    //
+    using pulse_result_t = struct {
+        uint32_t width_ns;              // Width and interval put out, to the system clock.
+        uint32_t interval_ns;
+        bool stopped;                   // Stopped before the burst was out.
+    };
+
+    class PulsedOutput
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  dds    DDS to pulse.
+         * @param  pio    PIO block to run the state machine on.
+         * @param  w_clk  AD9850 W_CLK GPIO.
+         * @param  fq_ud  AD9850 FQ_UD GPIO.
+         * @param  data   AD9850 DATA GPIO.
+         * @param  gate   Gate input GPIO.
+         */
+        PulsedOutput(AD9850& dds, PIO pio, uint w_clk, uint fq_ud, uint data, uint gate)
+            : dds_(dds)
+            , pio_(pio)
+            , w_clk_(w_clk)
+            , fq_ud_(fq_ud)
+            , data_(data)
+            , gate_(gate)
+        {
+            // One pass of the program puts out a pulse: the on edge, then
+            // the off edge.  Each takes a word in two FIFO entries, the
+            // low 32 bits and then the top 8 bits with the count to wait
+            // before FQ_UD above them.  DATA changes as W_CLK falls.
+            //
+            uint pc = 0;
+            for (bool on : { true, false })
+            {
+                uint start = pc;
+                instructions_[pc++] = pio_encode_set(pio_y, 31) | pio_encode_sideset(1, 0);
+                instructions_[pc++] = pio_encode_out(pio_pins, 1) | pio_encode_sideset(1, 0);
+                instructions_[pc++] = pio_encode_jmp_y_dec(start + 1) | pio_encode_sideset(1, 1);
+                instructions_[pc++] = pio_encode_set(pio_y, 7) | pio_encode_sideset(1, 0);
+                instructions_[pc++] = pio_encode_out(pio_pins, 1) | pio_encode_sideset(1, 0);
+                instructions_[pc++] = pio_encode_jmp_y_dec(start + 4) | pio_encode_sideset(1, 1);
+                instructions_[pc++] = pio_encode_out(pio_x, 24) | pio_encode_sideset(1, 0);
+                instructions_[pc] = pio_encode_jmp_x_dec(pc) | pio_encode_sideset(1, 0);
+                ++pc;
+                if (on)
+                    instructions_[pc++] = pio_encode_wait_gpio(true, gate_) | pio_encode_sideset(1, 0);
+                instructions_[pc++] = pio_encode_set(pio_pins, 1) | pio_encode_sideset(1, 0) |
+                    pio_encode_delay(FQ_UD_HIGH_CYCLES - 1);
+                instructions_[pc++] = pio_encode_set(pio_pins, 0) | pio_encode_sideset(1, 0);
+            }
+
+            pio_program_t program = { };
+            program.instructions = instructions_;
+            program.length = PROGRAM_LEN;
+            program.origin = -1;
+
+            sm_ = pio_claim_unused_sm(pio_, true);
+            offset_ = pio_add_program(pio_, &program);
+
+            gpio_init(gate_);
+            gpio_set_dir(gate_, GPIO_IN);
+
+            pio_sm_config config = pio_get_default_sm_config();
+            sm_config_set_wrap(&config, offset_, offset_ + PROGRAM_LEN - 1);
+            sm_config_set_out_pins(&config, data_, 1);
+            sm_config_set_set_pins(&config, fq_ud_, 1);
+            sm_config_set_sideset_pins(&config, w_clk_);
+            sm_config_set_sideset(&config, 1, false, false);
+            sm_config_set_out_shift(&config, true, true, 32);
+            sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_TX);
+            sm_config_set_clkdiv(&config, 1.0f);
+            pio_sm_init(pio_, sm_, offset_, &config);
+
+            // The ring is read over and over; the state machine asks for
+            // each entry as it runs.
+            //
+            dma_channel_ = dma_claim_unused_channel(true);
+            dma_config_ = dma_channel_get_default_config(dma_channel_);
+            channel_config_set_transfer_data_size(&dma_config_, DMA_SIZE_32);
+            channel_config_set_read_increment(&dma_config_, true);
+            channel_config_set_write_increment(&dma_config_, false);
+            channel_config_set_ring(&dma_config_, false, RING_BITS);
+            channel_config_set_dreq(&dma_config_, pio_get_dreq(pio_, sm_, true));
+        }
+
+        /**
+         * @brief  Return an error message if the pulses can't be timed
+         *         as asked, or null if they can.
+         */
+        static auto check(const pulse_config_t& config) -> const char*
+        {
+            uint32_t width = cycles(config.width_ns);
+            uint32_t interval = cycles(config.interval_ns);
+            if ((width < WIDTH_OVERHEAD_CYCLES) || (width - WIDTH_OVERHEAD_CYCLES > MAX_WAIT_CYCLES))
+                return "Pulse width out of range";
+            if ((interval <= width) || (interval - width < GAP_OVERHEAD_CYCLES) ||
+                (interval - width - GAP_OVERHEAD_CYCLES > MAX_WAIT_CYCLES))
+                return "Pulse interval out of range";
+            return nullptr;
+        }
+
+        /**
+         * @brief  Pulse the live frequency and phase.  The output is left
+         *         off at the end.
+         * @param  config  Pulse parameters, already checked.
+         * @param  poll    Called while the pulses go out, so input can be
+         *                 watched and the run stopped; may be null.
+         * @param  param   Passed to poll.
+         */
+        auto run(const pulse_config_t& config, void (*poll)(void*), void* param) -> pulse_result_t
+        {
+            stop_ = false;
+            uint32_t width = cycles(config.width_ns);
+            uint32_t interval = cycles(config.interval_ns);
+
+            uint32_t frequency_register = dds_.get_frequency_register();
+            uint32_t phase_register = dds_.get_phase_register();
+            uint64_t on = AD9850::data_word(frequency_register, phase_register, true);
+            uint64_t off = AD9850::data_word(frequency_register, phase_register, false);
+            ring_[0] = static_cast<uint32_t>(on);
+            ring_[1] = static_cast<uint32_t>(on >> 32) | ((interval - width - GAP_OVERHEAD_CYCLES) << 8);
+            ring_[2] = static_cast<uint32_t>(off);
+            ring_[3] = static_cast<uint32_t>(off >> 32) | ((width - WIDTH_OVERHEAD_CYCLES) << 8);
+
+            // Without the gate the input is forced active, so the wait
+            // for it always passes in one cycle.
+            //
+            gpio_set_inover(gate_, !config.gate ? GPIO_OVERRIDE_HIGH
+                : config.gate_active_low ? GPIO_OVERRIDE_INVERT : GPIO_OVERRIDE_NORMAL);
+
+            // Start from the top of the program with the pins low, then
+            // give them to the state machine and let the DMA feed it.
+            //
+            pio_sm_set_enabled(pio_, sm_, false);
+            pio_sm_clear_fifos(pio_, sm_);
+            pio_sm_restart(pio_, sm_);
+            pio_sm_exec(pio_, sm_, pio_encode_jmp(offset_));
+            pio_sm_set_pins_with_mask(pio_, sm_, 0, pin_mask());
+            pio_sm_set_pindirs_with_mask(pio_, sm_, pin_mask(), pin_mask());
+            set_pin_function(pio_function());
+            pio_->fdebug = 1u << (PIO_FDEBUG_TXSTALL_LSB + sm_);
+
+            transfers_ = (config.count > 0) ? config.count * RING_WORDS : CONTINUOUS_TRANSFERS;
+            loaded_ = 0;
+            dma_channel_configure(dma_channel_, &dma_config_, &pio_->txf[sm_], ring_, transfers_, true);
+            pio_sm_set_enabled(pio_, sm_, true);
+            running_ = true;
+
+            // A burst is over once the DMA has fed it all and the state
+            // machine has stalled for more, after the last off edge.  A
+            // continuous run is topped up whenever the DMA finishes.
+            //
+            while (!stop_)
+            {
+                if (poll)
+                    poll(param);
+                if (dma_channel_is_busy(dma_channel_))
+                    continue;
+                if (config.count == 0)
+                {
+                    loaded_ += CONTINUOUS_TRANSFERS / RING_WORDS;
+                    dma_channel_set_trans_count(dma_channel_, CONTINUOUS_TRANSFERS, true);
+                }
+                else if (pio_->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + sm_)))
+                    break;
+            }
+
+            // Take the pins back, unless stop() already has, and put the
+            // driver's state in step with the output, which is off (or
+            // turned off now if stopped mid-pulse).
+            //
+            if (running_)
+                release();
+            dds_.power_down();
+
+            return pulse_result_t { nanoseconds(width), nanoseconds(interval), stop_ };
+        }
+
+        /**
+         * @brief  Stop a running pulse train.  Safe to call from a poll
+         *         callback.  The state machine is stopped and the pins
+         *         handed back at once, so the DDS can be powered down
+         *         straight after rather than once run() returns.
+         */
+        auto stop() -> void
+        {
+            stop_ = true;
+            if (running_)
+                release();
+        }
+
+        /**
+         * @brief  Return the pulses handed to the state machine so far in
+         *         the current run.  It holds up to two ahead of the one
+         *         going out.
+         */
+        auto get_progress() -> uint32_t
+        {
+            uint32_t left = dma_channel_hw_addr(dma_channel_)->transfer_count;
+            return loaded_ + (transfers_ - left) / RING_WORDS;
+        }
+
+    private:
+        static const uint PROGRAM_LEN = 21;
+        static const uint FQ_UD_HIGH_CYCLES = 2;
+        static const uint RING_BITS = 4;                // 16 bytes: one pulse.
+        static const uint32_t RING_WORDS = 4;
+        static const uint32_t CONTINUOUS_TRANSFERS = 0xfffffffc;
+        static const uint32_t US_PER_S = 1000000;
+        static const uint32_t MAX_WAIT_CYCLES = 0x00ffffff;
+
+        // Cycles from one FQ_UD edge to the next with no wait counted:
+        // the 40-bit shift at two cycles a bit, the FQ_UD pulse, and the
+        // instructions around them.  The on edge has the gate wait too.
+        //
+        static const uint32_t WIDTH_OVERHEAD_CYCLES = 87;
+        static const uint32_t GAP_OVERHEAD_CYCLES = 88;
+
+        /**
+         * @brief  Return the system clock cycles nearest a time.
+         * @param  ns  Time, in ns.
+         */
+        static auto cycles(uint32_t ns) -> uint32_t
+        {
+            uint32_t cycles_per_us = clock_get_hz(clk_sys) / US_PER_S;
+            return static_cast<uint32_t>((static_cast<uint64_t>(ns) * cycles_per_us + 500) / 1000);
+        }
+
+        /**
+         * @brief  Return the time taken by a number of system clock
+         *         cycles, in ns.
+         */
+        static auto nanoseconds(uint32_t cycles) -> uint32_t
+        {
+            uint32_t cycles_per_us = clock_get_hz(clk_sys) / US_PER_S;
+            return static_cast<uint32_t>(static_cast<uint64_t>(cycles) * 1000 / cycles_per_us);
+        }
+
+        /**
+         * @brief  Stop the state machine and the DMA feeding it, and give
+         *         the pins back to SIO, low.  A word cut off part way is
+         *         pushed out of the AD9850 by the next one written.
+         */
+        auto release() -> void
+        {
+            pio_sm_set_enabled(pio_, sm_, false);
+            dma_channel_abort(dma_channel_);
+            pio_sm_clear_fifos(pio_, sm_);
+            gpio_clr_mask(pin_mask());
+            set_pin_function(GPIO_FUNC_SIO);
+            running_ = false;
+        }
+
+        /**
+         * @brief  Return the mask of W_CLK, FQ_UD and DATA.
+         */
+        auto pin_mask() -> uint32_t
+        {
+            return (1u << w_clk_) | (1u << fq_ud_) | (1u << data_);
+        }
+
+        /**
+         * @brief  Return the GPIO function that connects a pin to our PIO.
+         */
+        auto pio_function() -> gpio_function
+        {
+            return (pio_ == pio0) ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1;
+        }
+
+        /**
+         * @brief  Connect W_CLK, FQ_UD and DATA to a peripheral.
+         */
+        auto set_pin_function(gpio_function function) -> void
+        {
+            gpio_set_function(w_clk_, function);
+            gpio_set_function(fq_ud_, function);
+            gpio_set_function(data_, function);
+        }
+
+        AD9850& dds_;                   // See constructor for these value definitions.
+        PIO pio_;
+        uint w_clk_;
+        uint fq_ud_;
+        uint data_;
+        uint gate_;
+
+        uint sm_ = 0;                   // State machine and program location.
+        uint offset_ = 0;
+        uint16_t instructions_[PROGRAM_LEN] { };
+
+        uint dma_channel_ = 0;
+        dma_channel_config dma_config_;
+
+        volatile bool stop_ = false;
+        bool running_ = false;          // The state machine has the pins.
+        uint32_t transfers_ = 0;        // Words the DMA was last started with.
+        uint32_t loaded_ = 0;           // Pulses from earlier starts in a continuous run.
+        alignas(16) uint32_t ring_[RING_WORDS] { };   // Aligned to its size for the DMA ring.
+    };
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+#include "hardware/pio_instructions.h"
+
+// Quadrature encoder for tuning at the bench.  A PIO state machine
+// samples the A and B inputs and pushes the pair whenever it changes, so
+// no edge is lost however long the main loop takes to get round to it.
+// The Gray code is decoded into detents in software, where contact
+// bounce and a missed state can be dealt with, and where the decoder can
+// be run on the host against made-up edge sequences (sim/encoder-check).
+//
+// Each detent moves the frequency by the step size, times a multiplier
+// that grows the faster the knob is turned, so a slow turn trims and a
+// fast spin covers a band.
+//
+namespace
+{
+    // Gray code decoder.  States are B << 1 | A.  The encoder rests at
+    // the state it was first seen in, and for encoders with a detent
+    // every half cycle at the opposite state too; a detent is counted on
+    // getting back to a rest state having moved at least half a detent
+    // that way.  Bounce moves the count back and forth and cancels out,
+    // and a transition where both inputs change is ignored.
+    //
+    class QuadratureDecoder
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  edges_per_detent  Edges between detents: 4, 2 or 1.
+         */
+        QuadratureDecoder(uint32_t edges_per_detent = 4)
+            : edges_per_detent_(edges_per_detent)
+        {
+        }
+
+        /**
+         * @brief  Take a sampled state.
+         * @param  state  B << 1 | A.
+         * @return +1 for a detent forward (A leading B), -1 for one back,
+         *         otherwise 0.
+         */
+        auto update(uint32_t state) -> int
+        {
+            state &= 3;
+            if (!started_)
+            {
+                rest_ = state;
+                previous_ = state;
+                started_ = true;
+                return 0;
+            }
+
+            quarters_ += QUARTERS[(previous_ << 2) | state];
+            previous_ = state;
+            if (!at_rest(state))
+                return 0;
+
+            int threshold = static_cast<int>(edges_per_detent_ + 1) / 2;
+            int detent = (quarters_ >= threshold) ? 1 : (quarters_ <= -threshold) ? -1 : 0;
+            quarters_ = 0;
+            return detent;
+        }
+
+        /**
+         * @brief  Forget the rest state, for an encoder that may have
+         *         been moved while not watched.
+         */
+        auto reset() -> void
+        {
+            started_ = false;
+            quarters_ = 0;
+        }
+
+    private:
+        // Quarter steps for each transition, indexed by the previous
+        // state and the new one.  Forward is 00, 01, 11, 10.
+        //
+        static constexpr int8_t QUARTERS[16] = {
+             0, +1, -1,  0,
+            -1,  0,  0, +1,
+            +1,  0,  0, -1,
+             0, -1, +1,  0,
+        };
+
+        auto at_rest(uint32_t state) -> bool
+        {
+            switch (edges_per_detent_)
+            {
+                case 1:
+                    return true;
+                case 2:
+                    return (state == rest_) || (state == (rest_ ^ 3));
+                default:
+                    return state == rest_;
+            }
+        }
+
+        uint32_t edges_per_detent_;     // See constructor for these value definitions.
+
+        bool started_ = false;
+        uint32_t rest_ = 0;             // State at a detent.
+        uint32_t previous_ = 0;
+        int quarters_ = 0;              // Quarter steps since the last rest state.
+    };
+
+    class QuadratureEncoder
+    {
+    public:
+        static const uint32_t DEFAULT_STEP_HZ = 100;
+        static const uint32_t MAX_STEP_HZ = 1000000;
+
+        /**
+         * @brief  Constructor
+         * @param  pio    PIO block to run the state machine on.
+         * @param  pin_a  Encoder A input GPIO.  B is the next GPIO up.
+         * @param  edges_per_detent  Edges between detents: 4, 2 or 1.
+         */
+        QuadratureEncoder(PIO pio, uint pin_a, uint32_t edges_per_detent = 4)
+            : pio_(pio)
+            , pin_a_(pin_a)
+            , decoder_(edges_per_detent)
+        {
+            // Sample both pins, and push them when they differ from the
+            // last pair pushed, held in y.  A push is dropped rather than
+            // stalling if the FIFO is full; the decoder skips the gap.
+            //
+            instructions_[0] = pio_encode_mov(pio_isr, pio_null);
+            instructions_[1] = pio_encode_in(pio_pins, 2);
+            instructions_[2] = pio_encode_mov(pio_x, pio_isr);
+            instructions_[3] = pio_encode_jmp_x_ne_y(5);
+            instructions_[4] = pio_encode_jmp(0);
+            instructions_[5] = pio_encode_mov(pio_y, pio_x);
+            instructions_[6] = pio_encode_push(false, false);
+
+            pio_program_t program = { };
+            program.instructions = instructions_;
+            program.length = PROGRAM_LEN;
+            program.origin = -1;
+
+            sm_ = pio_claim_unused_sm(pio_, true);
+            uint offset = pio_add_program(pio_, &program);
+
+            // The inputs are pulled up for switch contacts to ground, and
+            // sampled at about 200 kHz, plenty for a hand-turned knob.
+            //
+            for (uint pin = pin_a_; pin < pin_a_ + 2; ++pin)
+            {
+                gpio_init(pin);
+                gpio_set_dir(pin, GPIO_IN);
+                gpio_pull_up(pin);
+            }
+
+            pio_sm_config config = pio_get_default_sm_config();
+            sm_config_set_wrap(&config, offset, offset + PROGRAM_LEN - 1);
+            sm_config_set_in_pins(&config, pin_a_);
+            sm_config_set_in_shift(&config, false, false, 32);
+            sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+            sm_config_set_clkdiv(&config, SAMPLE_CLKDIV);
+            pio_sm_init(pio_, sm_, offset, &config);
+            pio_sm_set_enabled(pio_, sm_, true);
+        }
+
+        /**
+         * @brief  Set the frequency step for a detent.
+         * @param  step_hz  Step, in Hz, or 0 to ignore the encoder.
+         */
+        auto set_step(uint32_t step_hz) -> void
+        {
+            step_hz_ = step_hz;
+        }
+
+        /**
+         * @brief  Return the frequency step for a detent, in Hz.
+         */
+        auto get_step() -> uint32_t
+        {
+            return step_hz_;
+        }
+
+        /**
+         * @brief  Turn acceleration on or off.
+         */
+        auto set_acceleration(bool accelerate) -> void
+        {
+            accelerate_ = accelerate;
+        }
+
+        /**
+         * @brief  Return true if acceleration is on.
+         */
+        auto get_acceleration() -> bool
+        {
+            return accelerate_;
+        }
+
+        /**
+         * @brief  Take the states the state machine has pushed.  Call
+         *         from the main loop.
+         * @param  now_us  Time now, for the acceleration.
+         * @return Frequency change, in Hz, to apply; 0 if none.
+         */
+        auto poll(uint64_t now_us) -> int32_t
+        {
+            // Every state drained here gets the same time, so only the
+            // first detent among them can be timed.  The rest are a
+            // backlog from the main loop being busy, not a fast spin,
+            // and move a plain step each.
+            //
+            int32_t change = 0;
+            bool timed = true;
+            while (!pio_sm_is_rx_fifo_empty(pio_, sm_))
+            {
+                int32_t step = update(pio_sm_get(pio_, sm_), now_us, timed);
+                if (step != 0)
+                    timed = false;
+                change += step;
+            }
+            return change;
+        }
+
+        /**
+         * @brief  Take one sampled state.  Used by poll(), and by the host
+         *         check to feed in edge sequences.
+         * @param  state   B << 1 | A.
+         * @param  now_us  Time the state was seen.
+         * @param  timed   False if now_us isn't when a detent happened, as
+         *                 for the backlog in a poll; it then gets no
+         *                 acceleration.
+         * @return Frequency change, in Hz, to apply; 0 if none.
+         */
+        auto update(uint32_t state, uint64_t now_us, bool timed = true) -> int32_t
+        {
+            int detent = decoder_.update(state);
+            if ((detent == 0) || (step_hz_ == 0))
+                return 0;
+
+            // Turning back starts again from the plain step, so the
+            // setting doesn't overshoot when it is being homed in on.
+            //
+            uint32_t multiplier = 1;
+            if (accelerate_ && timed && (detent == last_detent_))
+                multiplier = acceleration(now_us - last_detent_us_);
+            last_detent_ = detent;
+            last_detent_us_ = now_us;
+            return detent * static_cast<int32_t>(step_hz_ * multiplier);
+        }
+
+        /**
+         * @brief  Return the step multiplier for the time between two
+         *         detents the same way.
+         */
+        static auto acceleration(uint64_t interval_us) -> uint32_t
+        {
+            for (const acceleration_t& entry : ACCELERATION)
+            {
+                if (interval_us < entry.interval_us)
+                    return entry.multiplier;
+            }
+            return 1;
+        }
+
+    private:
+        static const uint PROGRAM_LEN = 7;
+        static constexpr float SAMPLE_CLKDIV = 125.0f;     // 1 MHz, 5 cycles a sample.
+
+        using acceleration_t = struct {
+            uint64_t interval_us;       // Detents closer together than this...
+            uint32_t multiplier;        // ...move this many steps.
+        };
+
+        static constexpr acceleration_t ACCELERATION[] = {
+            { 8000, 100 },
+            { 20000, 10 },
+            { 50000, 2 },
+        };
+
+        PIO pio_;                       // See constructor for these value definitions.
+        uint pin_a_;
+        QuadratureDecoder decoder_;
+
+        uint sm_ = 0;
+        uint16_t instructions_[PROGRAM_LEN] { };
+
+        uint32_t step_hz_ = DEFAULT_STEP_HZ;
+        bool accelerate_ = true;
+        int last_detent_ = 0;           // Direction and time of the last detent.
+        uint64_t last_detent_us_ = 0;
+    };
+}
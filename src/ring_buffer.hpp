@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace
+{
+    // Lock-free single-producer/single-consumer ring buffer.  The producer
+    // is typically an interrupt handler and the consumer the main loop, so
+    // neither side ever blocks or disables interrupts.
+    //
+    template <typename T, size_t N>
+    class RingBuffer
+    {
+        static_assert((N & (N - 1)) == 0, "Ring buffer size must be a power of two");
+
+    public:
+        /**
+         * @brief  Add a value.  Producer side only.
+         * @param  value  Value to add.
+         * @return false if the buffer is full.
+         */
+        auto push(T value) -> bool
+        {
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) >= N)
+                return false;
+
+            buffer_[head & MASK] = value;
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief  Remove the oldest value.  Consumer side only.
+         * @param  value  Set to the value removed.
+         * @return false if the buffer is empty.
+         */
+        auto pop(T& value) -> bool
+        {
+            uint32_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail == head_.load(std::memory_order_acquire))
+                return false;
+
+            value = buffer_[tail & MASK];
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief  Read a value without removing it.  Consumer side only.
+         * @param  position  Position of the value, between
+         *                   read_position() and write_position().
+         */
+        auto peek(uint32_t position) -> T
+        {
+            return buffer_[position & MASK];
+        }
+
+        /**
+         * @brief  Return the position of the oldest value.  Positions
+         *         count every value ever added, so they identify a value
+         *         for as long as it is in the buffer.
+         */
+        auto read_position() -> uint32_t
+        {
+            return tail_.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief  Return the position the next value will be added at.
+         */
+        auto write_position() -> uint32_t
+        {
+            return head_.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief  Return the number of values in the buffer.
+         */
+        auto size() -> size_t
+        {
+            return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief  Return the number of free slots in the buffer.
+         */
+        auto free() -> size_t
+        {
+            return N - size();
+        }
+
+        /**
+         * @brief  Return true if the buffer is empty.
+         */
+        auto empty() -> bool
+        {
+            return size() == 0;
+        }
+
+        /**
+         * @brief  Return true if the buffer is full.
+         */
+        auto full() -> bool
+        {
+            return size() >= N;
+        }
+
+    private:
+        static const uint32_t MASK = N - 1;
+
+        T buffer_[N];
+        std::atomic<uint32_t> head_ { 0 };      // Next slot to write.
+        std::atomic<uint32_t> tail_ { 0 };      // Next slot to read.
+    };
+}
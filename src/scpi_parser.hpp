@@ -0,0 +1,333 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Zero-copy tokenizer for SCPI-style program messages, such as
+// `FREQ 1000000;PHAS 22.5;OUTP ON` or `*IDN?`.  Tokens point into the
+// command buffer, so a line is split and its numbers decoded in one pass
+// with no copies and no document built.
+//
+namespace
+{
+    // SCPI queries, answered in order once the line has been applied.
+    //
+    enum class scpi_query_t : uint8_t {
+        idn,                            // *IDN?
+        opc,                            // *OPC?
+        frequency,                      // FREQ?
+        phase,                          // PHAS?
+        output,                         // OUTP?
+        error,                          // SYST:ERR?
+    };
+
+    // A span of the command buffer.
+    //
+    using scpi_token_t = struct {
+        const char* text;
+        size_t length;
+    };
+
+    // One program message unit: a header, whether it's a query, and its
+    // parameter, which is empty if there isn't one.
+    //
+    using scpi_unit_t = struct {
+        scpi_token_t header;
+        bool query;
+        scpi_token_t parameter;
+    };
+
+    class ScpiTokenizer
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  text  Null terminated line.  Must outlive the tokenizer
+         *               and the tokens it returns.
+         */
+        explicit ScpiTokenizer(const char* text)
+            : next_(text)
+        {
+        }
+
+        /**
+         * @brief  Take the next `;` separated unit.
+         * @param  unit  Set to the unit.
+         * @return false at the end of the line, or if the unit has no
+         *         header (see is_valid()).
+         */
+        auto next(scpi_unit_t& unit) -> bool
+        {
+            skip_blanks();
+            if (*next_ == '\0')
+                return false;
+
+            // An optional leading colon is the root of the command tree.
+            //
+            if (*next_ == ':')
+                ++next_;
+
+            unit.header.text = next_;
+            while (is_header_char(*next_))
+                ++next_;
+            unit.header.length = next_ - unit.header.text;
+            if (unit.header.length == 0)
+            {
+                valid_ = false;
+                return false;
+            }
+
+            unit.query = (*next_ == '?');
+            if (unit.query)
+                ++next_;
+
+            // The parameter runs to the separator, less trailing blanks.
+            //
+            skip_blanks();
+            unit.parameter.text = next_;
+            while ((*next_ != '\0') && (*next_ != ';'))
+                ++next_;
+            const char* end = next_;
+            while ((end > unit.parameter.text) && is_blank(end[-1]))
+                --end;
+            unit.parameter.length = end - unit.parameter.text;
+
+            if (*next_ == ';')
+                ++next_;
+            return true;
+        }
+
+        /**
+         * @brief  Return false if the line had a unit without a header.
+         */
+        auto is_valid() -> bool
+        {
+            return valid_;
+        }
+
+        /**
+         * @brief  Return true if a header is a mnemonic, in its short or
+         *         long form, ignoring case.
+         * @param  header        Header token.
+         * @param  long_form     Mnemonic in upper case, e.g. "FREQUENCY".
+         * @param  short_length  Length of the short form, e.g. 4 for FREQ.
+         */
+        static auto header_is(const scpi_token_t& header, const char* long_form, size_t short_length) -> bool
+        {
+            size_t long_length = strlen(long_form);
+            if ((header.length != short_length) && (header.length != long_length))
+                return false;
+            return matches(header.text, long_form, header.length);
+        }
+
+        /**
+         * @brief  Remove an optional mnemonic node, such as SOURce:, from
+         *         the front of a header.
+         * @param  header        Header token.  Updated if the node is there.
+         * @param  long_form     Node mnemonic in upper case.
+         * @param  short_length  Length of the node's short form.
+         * @return true if the node was there.
+         */
+        static auto strip_node(scpi_token_t& header, const char* long_form, size_t short_length) -> bool
+        {
+            for (size_t length = 0; length < header.length; ++length)
+            {
+                if (header.text[length] != ':')
+                    continue;
+
+                scpi_token_t node = { header.text, length };
+                if (!header_is(node, long_form, short_length))
+                    return false;
+                header.text += length + 1;
+                header.length -= length + 1;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * @brief  Decode a boolean parameter: ON, OFF, 1 or 0.
+         * @param  parameter  Parameter token.
+         * @param  value      Set to the value.
+         * @return false if the parameter isn't a boolean.
+         */
+        static auto parse_boolean(const scpi_token_t& parameter, bool& value) -> bool
+        {
+            if (token_is(parameter, "ON") || token_is(parameter, "1"))
+                value = true;
+            else if (token_is(parameter, "OFF") || token_is(parameter, "0"))
+                value = false;
+            else
+                return false;
+            return true;
+        }
+
+        /**
+         * @brief  Decode a non-negative decimal parameter, with optional
+         *         fraction, exponent and unit suffix, as a fixed point
+         *         integer.  E.g. with 2 decimals "22.5" is 2250.
+         * @param  parameter  Parameter token.
+         * @param  decimals   Decimal places of the result.
+         * @param  value      Set to the value, rounded to nearest.  Values
+         *                    too big for 32 bits are set to UINT64_MAX.
+         * @param  suffix     Set to the unit suffix, if any, e.g. "MHZ".
+         * @return false if the parameter isn't a number.
+         */
+        static auto parse_decimal(const scpi_token_t& parameter, int decimals, uint64_t& value,
+                                  scpi_token_t& suffix) -> bool
+        {
+            // The suffix is the trailing letters.  An exponent always
+            // ends in a digit so it stays with the number.
+            //
+            const char* end = parameter.text + parameter.length;
+            while ((end > parameter.text) && is_letter(end[-1]))
+                --end;
+            suffix = { end, static_cast<size_t>(parameter.text + parameter.length - end) };
+            while ((end > parameter.text) && is_blank(end[-1]))
+                --end;
+
+            const char* next = parameter.text;
+            if ((next < end) && (*next == '+'))
+                ++next;
+
+            // Mantissa.  Digits past what fits in 64 bits only move the
+            // exponent.
+            //
+            uint64_t mantissa = 0;
+            int exponent = decimals;
+            bool digits = false;
+            bool point = false;
+            for (; next < end; ++next)
+            {
+                if ((*next == '.') && !point)
+                {
+                    point = true;
+                    continue;
+                }
+                if (!is_digit(*next))
+                    break;
+
+                digits = true;
+                if (mantissa < MANTISSA_LIMIT)
+                {
+                    mantissa = mantissa * 10 + (*next - '0');
+                    exponent -= point ? 1 : 0;
+                }
+                else
+                {
+                    exponent += point ? 0 : 1;
+                }
+            }
+            if (!digits)
+                return false;
+
+            if ((next < end) && ((*next == 'E') || (*next == 'e')))
+            {
+                ++next;
+                bool negative = (next < end) && (*next == '-');
+                if ((next < end) && ((*next == '-') || (*next == '+')))
+                    ++next;
+                if ((next == end) || !is_digit(*next))
+                    return false;
+
+                int power = 0;
+                for (; (next < end) && is_digit(*next); ++next)
+                {
+                    if (power < MAX_EXPONENT)
+                        power = power * 10 + (*next - '0');
+                }
+                exponent += negative ? -power : power;
+            }
+            if (next != end)
+                return false;
+
+            // Scale to the fixed point.
+            //
+            for (; (exponent > 0) && (mantissa != 0); --exponent)
+            {
+                if (mantissa > UINT32_MAX)
+                    break;
+                mantissa *= 10;
+            }
+            // Round once, after the last divide: rounding each digit as
+            // it goes would take 1.49 up to 1.5 and then to 2.  Halves
+            // round up, so the first digit dropped decides.
+            //
+            uint64_t dropped = 0;
+            for (; exponent < 0; ++exponent)
+            {
+                dropped = mantissa % 10;
+                mantissa /= 10;
+            }
+            if (dropped >= 5)
+                mantissa += 1;
+            value = ((exponent > 0) && (mantissa != 0)) ? UINT64_MAX : mantissa;
+            return true;
+        }
+
+        /**
+         * @brief  Return true if a token is a word, ignoring case.
+         * @param  token  Token.
+         * @param  word   Word in upper case.
+         */
+        static auto token_is(const scpi_token_t& token, const char* word) -> bool
+        {
+            return (token.length == strlen(word)) && matches(token.text, word, token.length);
+        }
+
+    private:
+        static const uint64_t MANTISSA_LIMIT = 100000000000000000ull;   // 10^17
+        static const int MAX_EXPONENT = 1000;
+
+        /**
+         * @brief  Compare text to an upper case word, ignoring case.
+         */
+        static auto matches(const char* text, const char* word, size_t length) -> bool
+        {
+            for (size_t i = 0; i < length; ++i)
+            {
+                char character = text[i];
+                if ((character >= 'a') && (character <= 'z'))
+                    character -= 'a' - 'A';
+                if (character != word[i])
+                    return false;
+            }
+            return true;
+        }
+
+        static auto is_blank(char character) -> bool
+        {
+            return (character == ' ') || (character == '\t');
+        }
+
+        static auto is_digit(char character) -> bool
+        {
+            return (character >= '0') && (character <= '9');
+        }
+
+        static auto is_letter(char character) -> bool
+        {
+            return ((character >= 'A') && (character <= 'Z')) ||
+                   ((character >= 'a') && (character <= 'z'));
+        }
+
+        static auto is_header_char(char character) -> bool
+        {
+            return is_letter(character) || is_digit(character) ||
+                   (character == '*') || (character == ':') || (character == '_');
+        }
+
+        /**
+         * @brief  Step over blanks.
+         */
+        auto skip_blanks() -> void
+        {
+            while (is_blank(*next_))
+                ++next_;
+        }
+
+        const char* next_;              // Next character to look at.
+        bool valid_ = true;
+    };
+}
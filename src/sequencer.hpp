@@ -0,0 +1,555 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#include "AD9850.hpp"
+#include "commit_trigger.hpp"
+
+// Programmable sequencer.  A sequence is a short bytecode program run
+// from RAM that stages DDS states, updates the output, waits and loops,
+// for repeatable multi-segment stimulus.  Frequencies and phases are
+// turned into AD9850 register values when the sequence is loaded, so a
+// step at run time is only a word shifted out, and waits are timed from
+// a running deadline so the time taken by the steps doesn't add up.
+//
+// Sequences are loaded as text, one step per token:
+//
+//   F<hz>         Stage a frequency.
+//   A<hz>         Stage the staged frequency plus a signed step.
+//   P<phase>      Stage a phase, in .01 deg.
+//   E1 / E0       Stage the output enabled or disabled.
+//   U             Update: program the staged state and pulse FQ_UD.
+//   W<us>         Wait.
+//   T             Arm the staged state on the trigger input and wait for
+//                 it to go live.
+//   L<step>:<n>   Loop back to a step, so the steps from there to here
+//                 run n times in all.
+//   J<step>       Jump to a step.
+//   X             End.  Also implied after the last step.
+//
+// For example, hold 10 MHz for 5 ms, sweep to 12 MHz in 200 steps of
+// 50 us, wait for a trigger, and do it all 100 times:
+//
+//   F10000000 E1 U W5000 A10000 U W50 L4:200 T L0:100
+//
+// A sequence can be saved to the last sector of flash, and run at
+// power-up.
+//
+namespace
+{
+    // Step opcodes.
+    //
+    enum class sequence_op_t : uint8_t {
+        end = 0,
+        frequency,                      // value: tuning word.
+        frequency_step,                 // value: tuning word step, two's complement.
+        phase,                          // value: phase register.
+        enable,                         // value: 1 to enable.
+        update,
+        wait_us,                        // value: microseconds.
+        wait_trigger,
+        loop,                           // value: target step, count: passes.
+        jump,                           // value: target step.
+    };
+
+    // One step, 8 bytes.
+    //
+    using sequence_step_t = struct {
+        sequence_op_t op;
+        uint8_t reserved;
+        uint16_t count;
+        uint32_t value;
+    };
+
+    // Result of a run.
+    //
+    using sequence_result_t = struct {
+        uint32_t steps;                 // Steps carried out.
+        bool stopped;                   // Stopped before the end.
+    };
+
+    class Sequencer
+    {
+    public:
+        static const uint32_t MAX_STEPS = 254;
+
+        /**
+         * @brief  Constructor
+         * @param  dds      DDS to drive.
+         * @param  trigger  Hardware commit trigger for trigger waits.
+         */
+        Sequencer(AD9850& dds, CommitTrigger& trigger)
+            : dds_(dds)
+            , trigger_(trigger)
+        {
+        }
+
+        /**
+         * @brief  Load a sequence from text.
+         * @param  text    Steps, see above.
+         * @param  append  Add to the loaded sequence instead of replacing
+         *                 it, for sequences too long for one command.
+         * @return An error message, or null.  On error the loaded
+         *         sequence is left as it was.
+         */
+        auto load(const char* text, bool append) -> const char*
+        {
+            uint32_t length = append ? image_.header.length : 0;
+            while (*text)
+            {
+                if ((*text == ' ') || (*text == ',') || (*text == '\t'))
+                {
+                    ++text;
+                    continue;
+                }
+
+                if (length == MAX_STEPS)
+                    return "Sequence too long";
+                const char* error = parse_step(text, steps_scratch_[length]);
+                if (error)
+                    return error;
+                ++length;
+            }
+
+            // Copy the new steps over only once they have all parsed.
+            //
+            uint32_t first = append ? image_.header.length : 0;
+            memcpy(&image_.steps[first], &steps_scratch_[first], (length - first) * sizeof(sequence_step_t));
+            image_.header.length = length;
+            return nullptr;
+        }
+
+        /**
+         * @brief  Return an error message if the loaded sequence can't be
+         *         run, or null if it can.
+         */
+        auto check() -> const char*
+        {
+            for (uint32_t index = 0; index < image_.header.length; ++index)
+            {
+                const sequence_step_t& step = image_.steps[index];
+                if (((step.op == sequence_op_t::loop) || (step.op == sequence_op_t::jump)) &&
+                    (step.value >= image_.header.length))
+                    return "Sequence step out of range";
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief  Return the number of steps loaded.
+         */
+        auto get_length() -> uint32_t
+        {
+            return image_.header.length;
+        }
+
+        /**
+         * @brief  Return true if the sequence is to run at power-up.
+         */
+        auto get_autorun() -> bool
+        {
+            return image_.header.autorun != 0;
+        }
+
+        /**
+         * @brief  Run the loaded sequence, already checked, to the end.
+         * @param  poll   Called while waiting and on every loop back, so
+         *                input can be watched and the run stopped; may be
+         *                null.
+         * @param  param  Passed to poll.
+         */
+        auto run(void (*poll)(void*), void* param) -> sequence_result_t
+        {
+            stop_ = false;
+            memset(passes_, 0, sizeof(passes_));
+
+            // Start from the live state.
+            //
+            uint32_t frequency_register = dds_.get_frequency_register();
+            uint32_t phase_register = dds_.get_phase_register();
+            bool enable = dds_.get_enabled();
+
+            sequence_result_t result = { 0, false };
+            progress_ = 0;
+            uint64_t deadline_us = time_us_64();
+            uint32_t pc = 0;
+            bool preloaded = false;     // The next update's word is in the DDS.
+            dds_.restart_marker();
+            while ((pc < image_.header.length) && !stop_)
+            {
+                const sequence_step_t& step = image_.steps[pc++];
+                result.steps += 1;
+                progress_ = result.steps;
+                switch (step.op)
+                {
+                    case sequence_op_t::end:
+                        pc = image_.header.length;
+                        break;
+
+                    case sequence_op_t::frequency:
+                        frequency_register = step.value;
+                        break;
+
+                    case sequence_op_t::frequency_step:
+                        frequency_register += step.value;
+                        break;
+
+                    case sequence_op_t::phase:
+                        phase_register = step.value;
+                        break;
+
+                    case sequence_op_t::enable:
+                        enable = (step.value != 0);
+                        break;
+
+                    case sequence_op_t::update:
+                        if (!preloaded || !dds_.fire())
+                        {
+                            dds_.set_registers(frequency_register, phase_register, enable);
+                            dds_.commit();
+                        }
+                        preloaded = false;
+                        break;
+
+                    case sequence_op_t::wait_us:
+                    {
+                        // Shift the next update's word in while waiting,
+                        // if it can be worked out, so the update after the
+                        // wait is only an FQ_UD edge.
+                        //
+                        uint32_t next_frequency = frequency_register;
+                        uint32_t next_phase = phase_register;
+                        bool next_enable = enable;
+                        preloaded = next_update(pc, next_frequency, next_phase, next_enable);
+                        if (preloaded)
+                            dds_.preload(next_frequency, next_phase, next_enable);
+
+                        deadline_us += step.value;
+                        wait_until(deadline_us, poll, param);
+                        break;
+                    }
+
+                    case sequence_op_t::wait_trigger:
+                        dds_.set_registers(frequency_register, phase_register, enable);
+                        trigger_.arm(dds_);
+                        while (!trigger_.poll(dds_) && !stop_)
+                        {
+                            if (poll)
+                                poll(param);
+                        }
+                        trigger_.disarm();
+                        deadline_us = time_us_64();
+                        break;
+
+                    case sequence_op_t::loop:
+                        if (passes_[pc - 1] == 0)
+                            passes_[pc - 1] = step.count;
+                        if (--passes_[pc - 1] > 0)
+                            pc = step.value;
+                        if (poll)
+                            poll(param);
+                        break;
+
+                    case sequence_op_t::jump:
+                        pc = step.value;
+                        if (poll)
+                            poll(param);
+                        break;
+                }
+            }
+
+            result.stopped = stop_;
+            return result;
+        }
+
+        /**
+         * @brief  Stop a running sequence.  Safe to call from a poll
+         *         callback.
+         */
+        auto stop() -> void
+        {
+            stop_ = true;
+        }
+
+        /**
+         * @brief  Return the steps carried out so far in the
+         *         current or last run.
+         */
+        auto get_progress() -> uint32_t
+        {
+            return progress_;
+        }
+
+        /**
+         * @brief  Save the loaded sequence to flash.
+         * @param  autorun  Run it at power-up.
+         * @note   Interrupts are off for the erase and program, some tens
+         *         of milliseconds.
+         */
+        auto save(bool autorun) -> void
+        {
+            memcpy(image_.header.magic, SEQUENCE_MAGIC, sizeof(image_.header.magic));
+            image_.header.version = SEQUENCE_VERSION;
+            image_.header.step_size = sizeof(sequence_step_t);
+            image_.header.autorun = autorun ? 1 : 0;
+
+            uint32_t status = save_and_disable_interrupts();
+            flash_range_erase(FLASH_OFFSET, FLASH_SECTOR_SIZE);
+            flash_range_program(FLASH_OFFSET, reinterpret_cast<const uint8_t*>(&image_), sizeof(image_));
+            restore_interrupts(status);
+        }
+
+        /**
+         * @brief  Load the sequence saved in flash, if there is one.
+         * @return true if a sequence was loaded.
+         */
+        auto restore() -> bool
+        {
+            const sequence_image_t* saved = reinterpret_cast<const sequence_image_t*>(XIP_BASE + FLASH_OFFSET);
+            if (memcmp(saved->header.magic, SEQUENCE_MAGIC, sizeof(saved->header.magic)) ||
+                (saved->header.version != SEQUENCE_VERSION) ||
+                (saved->header.step_size != sizeof(sequence_step_t)) ||
+                (saved->header.length > MAX_STEPS))
+                return false;
+
+            image_ = *saved;
+            return true;
+        }
+
+    private:
+        static constexpr const char* SEQUENCE_MAGIC = "SGSQ";
+        static const uint16_t SEQUENCE_VERSION = 1;
+        static const uint32_t FLASH_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
+        static const uint64_t POLL_MARGIN_US = 20;
+        static const uint32_t LOOKAHEAD_STEPS = 8;
+
+        // Sequence as saved in flash.
+        //
+        using sequence_header_t = struct {
+            char magic[4];                  // "SGSQ"
+            uint16_t version;
+            uint16_t step_size;
+            uint32_t length;                // Steps that follow.
+            uint32_t autorun;               // Run at power-up if non-zero.
+        };
+
+        using sequence_image_t = struct {
+            sequence_header_t header;
+            sequence_step_t steps[MAX_STEPS];
+        };
+
+        static_assert(sizeof(sequence_step_t) == 8, "sequence step layout");
+        static_assert(sizeof(sequence_image_t) % FLASH_PAGE_SIZE == 0, "sequence image must be whole flash pages");
+
+        /**
+         * @brief  Parse one step.
+         * @param  text  Start of the step.  Moved past it.
+         * @param  step  Set to the step.
+         * @return An error message, or null.
+         */
+        auto parse_step(const char*& text, sequence_step_t& step) -> const char*
+        {
+            step = sequence_step_t { sequence_op_t::end, 0, 0, 0 };
+            char op = *text++;
+            const char* error = "Error parsing sequence";
+            switch (op)
+            {
+                case 'F': case 'f':
+                {
+                    uint32_t frequency;
+                    if (!parse_number(text, frequency))
+                        return error;
+                    step.op = sequence_op_t::frequency;
+                    step.value = dds_.tuning_word(frequency);
+                    break;
+                }
+
+                case 'A': case 'a':
+                {
+                    bool negative = (*text == '-');
+                    if ((*text == '-') || (*text == '+'))
+                        ++text;
+                    uint32_t frequency;
+                    if (!parse_number(text, frequency))
+                        return error;
+                    uint32_t word = dds_.tuning_word(frequency);
+                    step.op = sequence_op_t::frequency_step;
+                    step.value = negative ? (0u - word) : word;
+                    break;
+                }
+
+                case 'P': case 'p':
+                {
+                    uint32_t phase;
+                    if (!parse_number(text, phase))
+                        return error;
+                    step.op = sequence_op_t::phase;
+                    step.value = dds_.phase_word(phase);
+                    break;
+                }
+
+                case 'E': case 'e':
+                    if ((*text != '0') && (*text != '1'))
+                        return error;
+                    step.op = sequence_op_t::enable;
+                    step.value = (*text++ == '1') ? 1 : 0;
+                    break;
+
+                case 'W': case 'w':
+                    if (!parse_number(text, step.value))
+                        return error;
+                    step.op = sequence_op_t::wait_us;
+                    break;
+
+                case 'L': case 'l':
+                {
+                    uint32_t count;
+                    if (!parse_number(text, step.value) || (*text++ != ':') ||
+                        !parse_number(text, count) || (count == 0) || (count > UINT16_MAX))
+                        return error;
+                    step.op = sequence_op_t::loop;
+                    step.count = static_cast<uint16_t>(count);
+                    break;
+                }
+
+                case 'J': case 'j':
+                    if (!parse_number(text, step.value))
+                        return error;
+                    step.op = sequence_op_t::jump;
+                    break;
+
+                case 'U': case 'u': step.op = sequence_op_t::update; break;
+                case 'T': case 't': step.op = sequence_op_t::wait_trigger; break;
+                case 'X': case 'x': step.op = sequence_op_t::end; break;
+
+                default:
+                    return error;
+            }
+
+            // Steps are separated by blanks or commas.
+            //
+            if ((*text != '\0') && (*text != ' ') && (*text != ',') && (*text != '\t'))
+                return error;
+            return nullptr;
+        }
+
+        /**
+         * @brief  Parse an unsigned decimal number.
+         * @param  text   Start of the number.  Moved past it.
+         * @param  value  Set to the number.
+         * @return false if there is no number or it doesn't fit.
+         */
+        static auto parse_number(const char*& text, uint32_t& value) -> bool
+        {
+            if ((*text < '0') || (*text > '9'))
+                return false;
+
+            uint64_t number = 0;
+            for (; (*text >= '0') && (*text <= '9'); ++text)
+            {
+                number = number * 10 + (*text - '0');
+                if (number > UINT32_MAX)
+                    return false;
+            }
+            value = static_cast<uint32_t>(number);
+            return true;
+        }
+
+        /**
+         * @brief  Work out the state the next update will put out, by
+         *         following the steps after a wait without carrying them
+         *         out.  Only staging steps, jumps and one loop are
+         *         followed, and only a few of them.
+         * @param  pc  Step after the wait.
+         * @param  frequency_register, phase_register, enable  The staged
+         *         state, updated to the state at the update.
+         * @return true if an update is reached, false if something else
+         *         comes first.
+         */
+        auto next_update(uint32_t pc, uint32_t& frequency_register, uint32_t& phase_register,
+                         bool& enable) -> bool
+        {
+            bool looped = false;
+            for (uint32_t count = 0; (count < LOOKAHEAD_STEPS) && (pc < image_.header.length); ++count)
+            {
+                const sequence_step_t& step = image_.steps[pc++];
+                switch (step.op)
+                {
+                    case sequence_op_t::frequency:
+                        frequency_register = step.value;
+                        break;
+
+                    case sequence_op_t::frequency_step:
+                        frequency_register += step.value;
+                        break;
+
+                    case sequence_op_t::phase:
+                        phase_register = step.value;
+                        break;
+
+                    case sequence_op_t::enable:
+                        enable = (step.value != 0);
+                        break;
+
+                    case sequence_op_t::update:
+                        return true;
+
+                    case sequence_op_t::loop:
+                    {
+                        // The pass isn't counted here, so a second loop
+                        // could be this one again.
+                        //
+                        if (looped)
+                            return false;
+                        looped = true;
+                        uint16_t passes = (passes_[pc - 1] == 0) ? step.count : passes_[pc - 1];
+                        if (passes > 1)
+                            pc = step.value;
+                        break;
+                    }
+
+                    case sequence_op_t::jump:
+                        pc = step.value;
+                        break;
+
+                    default:
+                        return false;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief  Wait for a deadline.  The input is polled until the
+         *         deadline is close, then the last few microseconds are
+         *         spun out so the step after it starts on time.
+         */
+        auto wait_until(uint64_t deadline_us, void (*poll)(void*), void* param) -> void
+        {
+            while (!stop_ && (time_us_64() + POLL_MARGIN_US < deadline_us))
+            {
+                if (poll)
+                    poll(param);
+            }
+            while (!stop_ && (time_us_64() < deadline_us))
+            {
+            }
+        }
+
+        AD9850& dds_;                   // See constructor for these value definitions.
+        CommitTrigger& trigger_;
+
+        volatile bool stop_ = false;
+        uint32_t progress_ = 0;         // Steps carried out by the current run.
+        sequence_image_t image_ { };
+        sequence_step_t steps_scratch_[MAX_STEPS] { };
+        uint16_t passes_[MAX_STEPS] { };        // Passes left for each loop step.
+    };
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+
+// Runtime counters.  Each counter has a single writer (the main loop,
+// apart from the receive counters kept by the command processor), so
+// updates are plain increments with no locking and can stay enabled in
+// production builds.
+//
+namespace
+{
+    // Parse error categories.
+    //
+    enum class parse_error_t {
+        json,                           // Line is not valid JSON.
+        command_number,                 // Missing or invalid command number.
+        field,                          // Invalid field value.
+        overflow,                       // Line longer than the command buffer.
+        count
+    };
+
+    // Min/avg/max of a section timed in system clock cycles.
+    //
+    class CycleStats
+    {
+    public:
+        /**
+         * @brief  Add a sample.
+         * @param  cycles  Cycles spent in the section.
+         */
+        auto add(uint32_t cycles) -> void
+        {
+            count_ += 1;
+            total_ += cycles;
+            if (cycles < min_) min_ = cycles;
+            if (cycles > max_) max_ = cycles;
+        }
+
+        /**
+         * @brief  Discard all samples.
+         */
+        auto reset() -> void
+        {
+            count_ = 0;
+            total_ = 0;
+            min_ = UINT32_MAX;
+            max_ = 0;
+        }
+
+        auto get_count() -> uint32_t { return count_; }
+        auto get_min() -> uint32_t { return (count_ > 0) ? min_ : 0; }
+        auto get_max() -> uint32_t { return max_; }
+        auto get_average() -> uint32_t { return (count_ > 0) ? static_cast<uint32_t>(total_ / count_) : 0; }
+        auto get_jitter() -> uint32_t { return (count_ > 0) ? max_ - min_ : 0; }
+
+    private:
+        uint32_t count_ = 0;
+        uint64_t total_ = 0;
+        uint32_t min_ = UINT32_MAX;
+        uint32_t max_ = 0;
+    };
+
+    class Telemetry
+    {
+    public:
+        // About 4 us at 125 MHz: a fixed-pin word from RAM takes well
+        // under half that.
+        //
+        static const uint32_t DEFAULT_PROGRAM_BUDGET_CYCLES = 500;
+        static const uint32_t MAX_CYCLES = 0x00ffffff;
+
+        /**
+         * @brief  Start SysTick free-running from the processor clock so it
+         *         can be used as a cycle counter.
+         * @note   The Cortex-M0+ has no DWT cycle counter.  SysTick is 24
+         *         bits wide, which covers about 134 ms at 125 MHz.
+         */
+        static auto start_cycle_counter() -> void
+        {
+            systick_hw->rvr = CYCLE_MASK;
+            systick_hw->cvr = 0;
+            systick_hw->csr = SYSTICK_ENABLE | SYSTICK_CLKSOURCE;
+        }
+
+        /**
+         * @brief  Read the cycle counter.
+         */
+        static auto cycles() -> uint32_t
+        {
+            return systick_hw->cvr;
+        }
+
+        /**
+         * @brief  Return the cycles elapsed since a reading.
+         * @param  start  Value returned by cycles().
+         * @note   SysTick counts down.
+         */
+        static auto cycles_since(uint32_t start) -> uint32_t
+        {
+            return (start - static_cast<uint32_t>(systick_hw->cvr)) & CYCLE_MASK;
+        }
+
+        /**
+         * @brief  Zero all the counters.
+         */
+        auto reset() -> void
+        {
+            lines_ = 0;
+            for (auto& errors : parse_errors_)
+                errors = 0;
+            fifo_high_water_ = 0;
+            commits_ = 0;
+            commits_skipped_ = 0;
+            aborts_ = 0;
+            flushed_ = 0;
+            busy_ = 0;
+            loops_ = 0;
+            reset_time_us_ = time_us_64();
+            parse_cycles.reset();
+            program_cycles.reset();
+            program_overruns_ = 0;
+            abort_cycles.reset();
+        }
+
+        auto count_line() -> void { lines_ += 1; }
+        auto count_parse_error(parse_error_t type) -> void { parse_errors_[static_cast<size_t>(type)] += 1; }
+        auto count_commit() -> void { commits_ += 1; }
+        auto count_skipped_commit() -> void { commits_skipped_ += 1; }
+        auto count_abort() -> void { aborts_ += 1; }
+        auto count_flushed() -> void { flushed_ += 1; }
+        auto count_busy() -> void { busy_ += 1; }
+        auto count_loop() -> void { loops_ += 1; }
+
+        /**
+         * @brief  Time an AD9850 word, first bit to FQ_UD, against the
+         *         budget.
+         * @param  cycles  Cycles the word took.
+         */
+        auto count_program(uint32_t cycles) -> void
+        {
+            program_cycles.add(cycles);
+            if (cycles > program_budget_cycles_)
+                program_overruns_ += 1;
+        }
+
+        /**
+         * @brief  Set the most cycles an AD9850 word should take.  Words
+         *         that take longer are counted as overruns.
+         */
+        auto set_program_budget(uint32_t cycles) -> void
+        {
+            program_budget_cycles_ = cycles;
+        }
+
+        /**
+         * @brief  Track the command FIFO high-water mark.
+         * @param  depth  Current FIFO depth.
+         */
+        auto update_fifo_depth(size_t depth) -> void
+        {
+            if (depth > fifo_high_water_)
+                fifo_high_water_ = static_cast<uint32_t>(depth);
+        }
+
+        auto get_lines() -> uint32_t { return lines_; }
+        auto get_parse_errors(parse_error_t type) -> uint32_t { return parse_errors_[static_cast<size_t>(type)]; }
+        auto get_fifo_high_water() -> uint32_t { return fifo_high_water_; }
+        auto get_commits() -> uint32_t { return commits_; }
+        auto get_commits_skipped() -> uint32_t { return commits_skipped_; }
+        auto get_aborts() -> uint32_t { return aborts_; }
+        auto get_flushed() -> uint32_t { return flushed_; }
+        auto get_busy() -> uint32_t { return busy_; }
+        auto get_program_budget() -> uint32_t { return program_budget_cycles_; }
+        auto get_program_overruns() -> uint32_t { return program_overruns_; }
+
+        /**
+         * @brief  Return the time since the counters were reset, in us.
+         */
+        auto get_elapsed_us() -> uint64_t
+        {
+            return time_us_64() - reset_time_us_;
+        }
+
+        /**
+         * @brief  Return the main loop iteration rate since the counters
+         *         were reset, in Hz.
+         */
+        auto get_loop_rate() -> uint32_t
+        {
+            uint64_t elapsed_us = get_elapsed_us();
+            return (elapsed_us > 0) ? static_cast<uint32_t>(loops_ * 1000000ull / elapsed_us) : 0;
+        }
+
+        CycleStats parse_cycles;        // parse_json_command_buffer
+        CycleStats program_cycles;      // AD9850 program_dds, first bit to FQ_UD.
+        CycleStats abort_cycles;        // Line terminator to output off.
+
+    private:
+        static const uint32_t CYCLE_MASK = MAX_CYCLES;
+        static const uint32_t SYSTICK_ENABLE = 0x1;
+        static const uint32_t SYSTICK_CLKSOURCE = 0x4;
+
+        uint32_t lines_ = 0;
+        uint32_t parse_errors_[static_cast<size_t>(parse_error_t::count)] { };
+        uint32_t fifo_high_water_ = 0;
+        uint32_t commits_ = 0;
+        uint32_t commits_skipped_ = 0;
+        uint32_t aborts_ = 0;
+        uint32_t flushed_ = 0;
+        uint32_t busy_ = 0;             // Commands turned away with the fifo full.
+        uint64_t loops_ = 0;
+        uint32_t program_budget_cycles_ = DEFAULT_PROGRAM_BUDGET_CYCLES;
+        uint32_t program_overruns_ = 0; // Words over the budget.
+        uint64_t reset_time_us_ = 0;
+    };
+
+    // The counter block.
+    //
+    Telemetry telemetry;
+}
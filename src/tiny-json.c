@@ -31,14 +31,6 @@
 #include <ctype.h>
 #include "tiny-json.h"
 
-/** Structure to handle a heap of JSON properties. */
-typedef struct jsonStaticPool_s {
-    json_t* mem;      /**< Pointer to array of json properties.      */
-    unsigned int qty; /**< Length of the array of json properties.   */
-    unsigned int nextFree;  /**< The index of the next free json property. */
-    jsonPool_t pool;
-} jsonStaticPool_t;
-
 /* Search a property by its name in a JSON object. */
 json_t const* json_getProperty( json_t const* obj, char const* property ) {
     json_t const* sibling;
@@ -74,6 +66,7 @@ json_t const* json_createWithPool( char *str, jsonPool_t *pool ) {
     obj->name    = 0;
     obj->sibling = 0;
     obj->u.c.child = 0;
+    obj->flags   = 0;
     ptr = objValue( ptr, obj, pool );
     if ( !ptr ) return 0;
     return obj;
@@ -82,11 +75,18 @@ json_t const* json_createWithPool( char *str, jsonPool_t *pool ) {
 /* Parse a string to get a json. */
 json_t const* json_create( char* str, json_t mem[], unsigned int qty ) {
     jsonStaticPool_t spool;
-    spool.mem = mem;
-    spool.qty = qty;
-    spool.pool.init = poolInit;
-    spool.pool.alloc = poolAlloc;
-    return json_createWithPool( str, &spool.pool );
+    return json_createWithPool( str, json_initStaticPool( &spool, mem, qty ) );
+}
+
+/* Initialize a pool over an array of json properties. */
+jsonPool_t* json_initStaticPool( jsonStaticPool_t* spool, json_t mem[], unsigned int qty ) {
+    spool->mem = mem;
+    spool->qty = qty;
+    spool->nextFree = 0;
+    spool->pool.init = poolInit;
+    spool->pool.alloc = poolAlloc;
+    spool->pool.cacheIntegers = false;
+    return &spool->pool;
 }
 
 /** Get a special character with its escape character. Examples:
@@ -262,9 +262,10 @@ static char* fraqValue( char* ptr ) {
   * If the first character after the value is different of '}' or ']' is set to '\0'.
   * @param ptr Pointer to first character.
   * @param property Property handler to set the value and the type: JSON_REAL or JSON_INTEGER.
+  * @param cache Decode an integer value into the property.
   * @retval Pointer to first non white space after the string. If success.
   * @retval Null pointer if any error occur. */
-static char* numValue( char* ptr, json_t* property ) {
+static char* numValue( char* ptr, json_t* property, bool cache ) {
     if ( *ptr == '-' ) ++ptr;
     if ( !isdigit( (int)(*ptr) ) ) return 0;
     if ( *ptr != '0' ) {
@@ -299,6 +300,16 @@ static char* numValue( char* ptr, json_t* property ) {
             if ( 0 > strcmp( threshold, value ) ) return 0;
             *ptr = tmp;
         }
+        if ( cache ) {
+            /* The digits and the range were checked above, so this can't
+               overflow. INT64_MIN is accumulated as its magnitude. */
+            uint64_t magnitude = 0;
+            char const* digit;
+            for( digit = value + negative; digit < ptr; ++digit )
+                magnitude = magnitude * 10 + (uint64_t)( *digit - '0' );
+            property->integer = negative ? (int64_t)( 0 - magnitude ): (int64_t)magnitude;
+            property->flags |= JSON_INTEGER_CACHED;
+        }
     }
     ptr = setToNull( ptr );
     return ptr;
@@ -348,6 +359,7 @@ static char* objValue( char* ptr, json_t* obj, jsonPool_t* pool ) {
         }
         json_t* property = pool->alloc( pool );
         if ( !property ) return 0;
+        property->flags = 0;
         if( obj->type != JSON_ARRAY ) {
             if ( *ptr != '\"' ) return 0;
             ptr = propertyName( ptr, property );
@@ -375,7 +387,7 @@ static char* objValue( char* ptr, json_t* obj, jsonPool_t* pool ) {
             case 't':  ptr = trueValue( ptr, property );  break;
             case 'f':  ptr = falseValue( ptr, property ); break;
             case 'n':  ptr = nullValue( ptr, property );  break;
-            default:   ptr = numValue( ptr, property );   break;
+            default:   ptr = numValue( ptr, property, pool->cacheIntegers ); break;
         }
         if ( !ptr ) return 0;
     }
@@ -51,6 +51,11 @@ typedef enum {
     JSON_INTEGER, JSON_REAL, JSON_NULL
 } jsonType_t;
 
+/** Flags set on a json property by the parser. */
+enum {
+    JSON_INTEGER_CACHED = 1  /**< integer holds the decoded value. */
+};
+
 /** Structure to handle JSON properties. */
 typedef struct json_s {
     struct json_s* sibling;
@@ -62,7 +67,9 @@ typedef struct json_s {
             struct json_s* last_child;
         } c;
     } u;
+    int64_t integer;
     jsonType_t type;
+    unsigned char flags;
 } json_t;
 
 /** Parse a string to get a json.
@@ -140,6 +147,7 @@ static inline bool json_getBoolean( json_t const* property ) {
   * @param property A valid handler of a json object. Its type must be JSON_INTEGER.
   * @return The value stdint. */
 static inline int64_t json_getInteger( json_t const* property ) {
+  if ( property->flags & JSON_INTEGER_CACHED ) return property->integer;
   return strtoll( property->u.value,(char**)NULL, 10);
 }
 
@@ -152,13 +160,32 @@ static inline double json_getReal( json_t const* property ) {
 
 
 
-/** Structure to handle a heap of JSON properties. */
+/** Structure to handle a heap of JSON properties.
+  * The field after alloc is a parser option. False leaves it off, which
+  * behaves exactly as the original parser. */
 typedef struct jsonPool_s jsonPool_t;
 struct jsonPool_s {
     json_t* (*init)( jsonPool_t* pool );
     json_t* (*alloc)( jsonPool_t* pool );
+    bool cacheIntegers;     /**< Decode integers once while parsing. */
 };
 
+/** Structure to handle a heap of JSON properties in an array. */
+typedef struct jsonStaticPool_s {
+    json_t* mem;      /**< Pointer to array of json properties.      */
+    unsigned int qty; /**< Length of the array of json properties.   */
+    unsigned int nextFree;  /**< The index of the next free json property. */
+    jsonPool_t pool;
+} jsonStaticPool_t;
+
+/** Initialize a pool over an array of json properties, with the parser
+  * option off. Set it in the returned pool before parsing.
+  * @param spool The pool to initialize.
+  * @param mem Array of json properties to allocate.
+  * @param qty Number of elements of mem.
+  * @return The pool handler to pass to json_createWithPool. */
+jsonPool_t* json_initStaticPool( jsonStaticPool_t* spool, json_t mem[], unsigned int qty );
+
 /** Parse a string to get a json.
   * @param str String pointer with a JSON object. It will be modified.
   * @param pool Custom json pool pointer.
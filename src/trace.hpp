@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Event trace.  Build with SIGGEN_TRACE defined to record timestamped
+// events at key points of the command path into a RAM ring, which the
+// `trace` command dumps in one binary block for python/siggen-trace to
+// turn into a Chrome/Perfetto trace.  Without SIGGEN_TRACE the
+// tracepoints expand to nothing and the ring isn't built.
+//
+namespace
+{
+    // Event identifiers.  Keep in step with python/siggen-trace.
+    //
+    enum class trace_event_t : uint8_t {
+        rx_byte = 1,                    // Byte received (interrupt).  Arg: byte.
+        line_complete,                  // Line terminator.  Arg: line length.
+        parse_begin,                    // JSON parse started.  Arg: line length.
+        parse_end,                      // JSON parse done.  Arg: command number.
+        dequeue,                        // Command taken from the fifo.  Arg: command number.
+        program_begin,                  // program_dds entered.  Arg: frequency register.
+        fq_ud,                          // FQ_UD pulsed.  Arg: frequency register.
+        trigger,                        // Trigger edge (interrupt).  Arg: 1 if it fired.
+        ack,                            // Response written.  Arg: command number.
+        output_off,                     // Priority output-off done.  Arg: receive position.
+        preload,                        // Word shifted in ahead of its FQ_UD.  Arg: frequency register.
+        fire,                           // FQ_UD pulsed for a preloaded word.  Arg: frequency register.
+    };
+}
+
+#ifdef SIGGEN_TRACE
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "command_channel.hpp"
+#include "telemetry.hpp"
+
+#define TRACE_EVENT(event, arg) trace.record(trace_event_t::event, static_cast<uint32_t>(arg))
+
+namespace
+{
+    // One trace record, 12 bytes, little-endian on the wire.  The
+    // microsecond timer is too coarse for the commit path, whose steps
+    // are a few hundred cycles apart, so each record also carries the
+    // SysTick cycle count.  That wraps every 134 ms, and the microsecond
+    // time places records further apart than that.
+    //
+    using trace_record_t = struct {
+        uint32_t timestamp_us;          // time_us_32() when recorded.
+        uint32_t arg;                   // Event argument.
+        uint32_t event_cycles;          // trace_event_t in bits 0-7, Telemetry::cycles() above.
+    };
+
+    // Header sent ahead of the records.
+    //
+    using trace_header_t = struct {
+        char magic[4];                  // "SGTR"
+        uint16_t version;
+        uint16_t record_size;
+        uint32_t count;                 // Records that follow, oldest first.
+        uint32_t dropped;               // Records overwritten since the last dump.
+        uint32_t cycles_per_us;         // Cycle counter rate.
+    };
+
+    class TraceBuffer
+    {
+    public:
+        /**
+         * @brief  Record an event.  Safe to call from interrupts.  Runs
+         *         from RAM, as it is called on the commit path.
+         * @param  event  Event identifier.
+         * @param  arg    Event argument.
+         */
+        auto __not_in_flash_func(record)(trace_event_t event, uint32_t arg) -> void
+        {
+            uint32_t status = save_and_disable_interrupts();
+            if (enabled_)
+            {
+                trace_record_t& record = records_[head_ & (TRACE_RECORDS - 1)];
+                record.event_cycles = static_cast<uint32_t>(event) | (Telemetry::cycles() << 8);
+                record.timestamp_us = time_us_32();
+                record.arg = arg;
+                head_ += 1;
+            }
+            restore_interrupts(status);
+        }
+
+        /**
+         * @brief  Return the size of the block dump() will write.
+         */
+        auto dump_size() -> size_t
+        {
+            return sizeof(trace_header_t) + count() * sizeof(trace_record_t);
+        }
+
+        /**
+         * @brief  Write the header and the records, oldest first, to a
+         *         channel in one burst and empty the ring.
+         * @param  channel  Channel to write to.
+         * @note   Recording stops while the block is written so the ring
+         *         doesn't change under us; events in that window are lost.
+         */
+        auto dump(CommandChannel& channel) -> void
+        {
+            uint32_t status = save_and_disable_interrupts();
+            enabled_ = false;
+            restore_interrupts(status);
+
+            uint32_t records = count();
+            trace_header_t header = { { 'S', 'G', 'T', 'R' }, TRACE_VERSION,
+                sizeof(trace_record_t), records, head_ - records, CYCLES_PER_US };
+
+            channel.begin_binary_block();
+            channel.write_binary(&header, sizeof(header));
+            for (uint32_t i = head_ - records; i != head_; ++i)
+            {
+                channel.write_binary(&records_[i & (TRACE_RECORDS - 1)], sizeof(trace_record_t));
+            }
+            channel.end_binary_block();
+
+            status = save_and_disable_interrupts();
+            head_ = 0;
+            enabled_ = true;
+            restore_interrupts(status);
+        }
+
+    private:
+        static const uint32_t TRACE_RECORDS = 1024;     // Must be a power of 2.
+        static const uint16_t TRACE_VERSION = 2;
+        static const uint32_t CYCLES_PER_US = 125;      // System clock, in MHz.
+
+        static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "TRACE_RECORDS must be a power of 2");
+        static_assert(sizeof(trace_record_t) == 12, "trace record layout");
+        static_assert(sizeof(trace_header_t) == 20, "trace header layout");
+
+        /**
+         * @brief  Return the number of records held.
+         */
+        auto count() -> uint32_t
+        {
+            return (head_ < TRACE_RECORDS) ? head_ : TRACE_RECORDS;
+        }
+
+        trace_record_t records_[TRACE_RECORDS] { };
+        volatile uint32_t head_ = 0;    // Records written since the last dump.
+        volatile bool enabled_ = true;
+    };
+
+    // The trace ring.
+    //
+    TraceBuffer trace;
+}
+
+#else
+
+#define TRACE_EVENT(event, arg) do { } while (0)
+
+#endif
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iostream>
+#include <streambuf>
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+
+#include "command_channel.hpp"
+
+// Command channel on a UART.  Received bytes are taken from the UART's
+// FIFO into a ring buffer by its interrupt, which fires when the FIFO
+// is half full or when the line has gone idle with bytes left in it
+// (the receive timeout), so the core is interrupted once per 16 bytes
+// or per burst rather than per byte, and is left asleep while nothing
+// arrives.  A DMA channel can't do the receiving, since it would keep
+// the FIFO empty and the receive timeout only fires with bytes in it.
+// Bytes lost to a full ring or FIFO are counted and the line they were
+// part of is answered with an error.  Responses go out through a DMA
+// channel from a pair of buffers, so the main loop only waits on the
+// UART when both are in use.
+//
+// At the default 125 MHz peripheral clock the UART runs up to about
+// 7.8 Mbaud.
+//
+namespace
+{
+    class UartChannel : public CommandChannel, private std::streambuf
+    {
+    public:
+        /**
+         * @brief  Constructor
+         * @param  uart  UART instance, uart0 or uart1.
+         * @param  tx    TX GPIO.
+         * @param  rx    RX GPIO.
+         * @param  baud  Baud rate.
+         * @note   Only one UartChannel is supported, since the UART
+         *         interrupt handler has no parameter.
+         */
+        UartChannel(uart_inst_t* uart, uint tx, uint rx, uint baud)
+            : uart_(uart)
+            , out_(this)
+        {
+            // Pin functions have to be set before calling uart_init to
+            // avoid losing data.
+            //
+            gpio_set_function(tx, UART_FUNCSEL_NUM(uart_, tx));
+            gpio_set_function(rx, UART_FUNCSEL_NUM(uart_, rx));
+            baud_ = uart_init(uart_, baud);
+            uart_set_fifo_enabled(uart_, true);
+
+            // Receive: the FIFO level interrupt at half full, and the
+            // receive timeout, which fires 32 bit times after the last
+            // byte if any are left in the FIFO.
+            //
+            instance_ = this;
+            uart_hw_t* hw = uart_get_hw(uart_);
+            hw_write_masked(&hw->ifls, RX_FIFO_HALF << UART_UARTIFLS_RXIFLSEL_LSB, UART_UARTIFLS_RXIFLSEL_BITS);
+            hw->imsc = UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS;
+
+            uint irq = (uart_get_index(uart_) == 0) ? UART0_IRQ : UART1_IRQ;
+            irq_set_exclusive_handler(irq, uart_irq);
+            irq_set_enabled(irq, true);
+
+            // Transmit: a buffer at a time to the UART.
+            //
+            tx_dma_ = dma_claim_unused_channel(true);
+            dma_channel_config config = dma_channel_get_default_config(tx_dma_);
+            channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+            channel_config_set_read_increment(&config, true);
+            channel_config_set_write_increment(&config, false);
+            channel_config_set_dreq(&config, uart_get_dreq(uart_, true));
+            dma_channel_configure(tx_dma_, &config, &uart_get_hw(uart_)->dr, tx_buffer_[0], 0, false);
+        }
+
+        /**
+         * @brief  Return the baud rate actually set.
+         */
+        auto get_baud() -> uint
+        {
+            return baud_;
+        }
+
+        auto set_chars_available_callback(void (*fn)(void*), void* param) -> void override
+        {
+            uint32_t status = save_and_disable_interrupts();
+            callback_ = fn;
+            callback_param_ = param;
+            restore_interrupts(status);
+        }
+
+        auto read_char() -> int override
+        {
+            if (rx_tail_ == rx_head_)
+                return PICO_ERROR_TIMEOUT;
+
+            int character = rx_ring_[rx_tail_];
+            rx_tail_ = (rx_tail_ + 1) & (RX_RING_LEN - 1);
+            return character;
+        }
+
+        auto take_overrun(uint32_t& position) -> uint32_t override
+        {
+            uint32_t status = save_and_disable_interrupts();
+            uint32_t lost = overruns_;
+            position = overrun_position_;
+            overruns_ = 0;
+            restore_interrupts(status);
+            return lost;
+        }
+
+        auto out() -> std::ostream& override
+        {
+            return out_;
+        }
+
+        auto begin_binary_block() -> void override
+        {
+            out_ << std::flush;
+            translate_crlf_ = false;
+        }
+
+        auto end_binary_block() -> void override
+        {
+            out_ << std::flush;
+            translate_crlf_ = true;
+        }
+
+    private:
+        static const size_t RX_RING_LEN = 1024;            // Must be a power of 2.
+        static const size_t TX_BUFFER_LEN = 256;
+        static const uint32_t RX_FIFO_HALF = 2;             // RXIFLSEL: 16 of 32 bytes.
+
+        static_assert((RX_RING_LEN & (RX_RING_LEN - 1)) == 0, "RX_RING_LEN must be a power of 2");
+
+        /**
+         * @brief  UART interrupt.  Empties the FIFO into the ring, which
+         *         clears the interrupt, and passes on what has arrived.
+         *         Bytes that don't fit, and any the FIFO lost, are counted
+         *         as overruns.
+         */
+        static auto uart_irq() -> void
+        {
+            UartChannel* self = instance_;
+            uart_hw_t* hw = uart_get_hw(self->uart_);
+            uint32_t head = self->rx_head_;
+            while (!(hw->fr & UART_UARTFR_RXFE_BITS))
+            {
+                uint32_t data = hw->dr;
+                uint32_t next = (head + 1) & (RX_RING_LEN - 1);
+                uint32_t lost = ((data & UART_UARTDR_OE_BITS) ? 1 : 0) + ((next == self->rx_tail_) ? 1 : 0);
+                if (lost > 0)
+                {
+                    if (self->overruns_ == 0)
+                        self->overrun_position_ = self->rx_received_;
+                    self->overruns_ += lost;
+                }
+                if (next == self->rx_tail_)
+                    continue;
+
+                self->rx_ring_[head] = static_cast<uint8_t>(data);
+                self->rx_received_ += 1;
+                head = next;
+            }
+            self->rx_head_ = head;
+
+            if (self->callback_ && (self->rx_tail_ != head))
+                self->callback_(self->callback_param_);
+        }
+
+        /**
+         * @brief  streambuf output.  Adds a CR before each LF while not
+         *         in a binary block, as stdio does.
+         */
+        auto overflow(int character) -> int override
+        {
+            if (character == traits_type::eof())
+                return traits_type::not_eof(character);
+
+            if (translate_crlf_ && (character == '\n'))
+                put('\r');
+            put(static_cast<char>(character));
+            return character;
+        }
+
+        /**
+         * @brief  streambuf flush.  Sends what is buffered.
+         */
+        auto sync() -> int override
+        {
+            send();
+            return 0;
+        }
+
+        /**
+         * @brief  Add a byte to the transmit buffer, sending it if full.
+         */
+        auto put(char character) -> void
+        {
+            if (tx_fill_ == TX_BUFFER_LEN)
+                send();
+            tx_buffer_[tx_active_][tx_fill_++] = character;
+        }
+
+        /**
+         * @brief  Start the transmit buffer going out and switch to the
+         *         other one.  Waits for the other one to finish first.
+         */
+        auto send() -> void
+        {
+            if (tx_fill_ == 0)
+                return;
+
+            dma_channel_wait_for_finish_blocking(tx_dma_);
+            dma_channel_transfer_from_buffer_now(tx_dma_, tx_buffer_[tx_active_], tx_fill_);
+            tx_active_ ^= 1;
+            tx_fill_ = 0;
+        }
+
+        static inline UartChannel* instance_ = nullptr;
+
+        uart_inst_t* uart_;             // See constructor for these value definitions.
+        uint baud_ = 0;
+
+        uint tx_dma_ = 0;
+
+        uint8_t rx_ring_[RX_RING_LEN] { };
+        volatile uint32_t rx_head_ = 0; // Next ring index to write.
+        volatile uint32_t rx_tail_ = 0; // Next ring index to read.
+        volatile uint32_t rx_received_ = 0;     // Bytes put in the ring.
+        volatile uint32_t overruns_ = 0;        // Bytes lost since the last take_overrun(),
+        volatile uint32_t overrun_position_ = 0;    // and bytes received before the first.
+
+        void (*callback_)(void*) = nullptr;
+        void* callback_param_ = nullptr;
+
+        char tx_buffer_[2][TX_BUFFER_LEN] { };
+        size_t tx_active_ = 0;          // Buffer being filled.
+        size_t tx_fill_ = 0;
+        bool translate_crlf_ = true;
+
+        std::ostream out_;
+    };
+}